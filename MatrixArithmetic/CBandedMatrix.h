@@ -0,0 +1,181 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CGemmKernel.h"
+#include "CMatrix.h"
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// A matrix whose non-zero elements are all within a band around the main
+// diagonal: element (r, c) can only be non-zero if r - Lower <= c and
+// c <= r + Upper. Each row keeps the Lower + Upper + 1 slots of the band,
+// slot s of row r being column r - Lower + s. Slots that fall outside the
+// matrix at the top and bottom are kept but never used.
+//
+// A tridiagonal n * n matrix takes 3n elements and multiplying it by an
+// n * m matrix takes 3nm multiply-adds, against n * n and n * n * m.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CBandedMatrix
+{
+public:
+    CBandedMatrix(unsigned int uRows, unsigned int uCols, unsigned int uLower, unsigned int uUpper);
+
+    // ---------------------------------------------------------------------------
+    // Takes the band of Matrix, everything outside of it is ignored.
+
+    CBandedMatrix(const CMatrix<T> & Matrix, unsigned int uLower, unsigned int uUpper);
+
+    inline unsigned int NumRows() const { return(m_uRows); }
+    inline unsigned int NumColumns() const { return(m_uColumns); }
+    inline unsigned int LowerBandwidth() const { return(m_uLower); }
+    inline unsigned int UpperBandwidth() const { return(m_uUpper); }
+
+    // ---------------------------------------------------------------------------
+    // Elements outside the band read as zero and cannot be set.
+
+    T GetAt(unsigned int uRow, unsigned int uCol) const;
+    void SetAt(unsigned int uRow, unsigned int uCol, T Element);
+
+    CMatrix<T> ToMatrix() const;
+
+    // ---------------------------------------------------------------------------
+    // this * Matrix
+
+    CMatrix<T> operator*(const CMatrix<T> & Matrix) const;
+
+private:
+    // The columns of a row that are inside both the band and the matrix
+
+    unsigned int FirstColumn(unsigned int uRow) const { return((uRow > m_uLower) ? uRow - m_uLower : 0); }
+
+    unsigned int EndColumn(unsigned int uRow) const
+    {
+        unsigned long long ullEnd = (unsigned long long)uRow + m_uUpper + 1;
+        return((ullEnd < m_uColumns) ? (unsigned int)ullEnd : m_uColumns);
+    }
+
+    bool InBand(unsigned int uRow, unsigned int uCol) const { return(uCol >= FirstColumn(uRow) && uCol < EndColumn(uRow)); }
+    size_t Offset(unsigned int uRow, unsigned int uCol) const { return((size_t)uRow * m_uWidth + uCol + m_uLower - uRow); }
+
+    unsigned int m_uRows;
+    unsigned int m_uColumns;
+    unsigned int m_uLower;
+    unsigned int m_uUpper;
+    unsigned int m_uWidth;
+    std::vector<T> m_Elements;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CBandedMatrix<T>::CBandedMatrix(unsigned int uRows, unsigned int uCols, unsigned int uLower, unsigned int uUpper)
+{
+    m_uRows = uRows;
+    m_uColumns = uCols;
+    m_uLower = uLower;
+    m_uUpper = uUpper;
+    m_uWidth = uLower + uUpper + 1;
+    m_Elements.assign((size_t)uRows * m_uWidth, T());
+}
+
+template <class T>
+CBandedMatrix<T>::CBandedMatrix(const CMatrix<T> & Matrix, unsigned int uLower, unsigned int uUpper)
+{
+    m_uRows = Matrix.m_uRows;
+    m_uColumns = Matrix.m_uColumns;
+    m_uLower = uLower;
+    m_uUpper = uUpper;
+    m_uWidth = uLower + uUpper + 1;
+    m_Elements.assign((size_t)m_uRows * m_uWidth, T());
+
+    for (unsigned int uRow = 0; uRow < m_uRows; uRow++)
+    {
+        for (unsigned int uCol = FirstColumn(uRow); uCol < EndColumn(uRow); uCol++)
+        {
+            m_Elements[Offset(uRow, uCol)] = Matrix.m_pMatrix[(size_t)uRow * m_uColumns + uCol];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CBandedMatrix<T>::GetAt(unsigned int uRow, unsigned int uCol) const
+{
+    if (uRow >= m_uRows || uCol >= m_uColumns)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    return(InBand(uRow, uCol) ? m_Elements[Offset(uRow, uCol)] : T());
+}
+
+template <class T>
+void CBandedMatrix<T>::SetAt(unsigned int uRow, unsigned int uCol, T Element)
+{
+    if (uRow >= m_uRows || uCol >= m_uColumns)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    if (!InBand(uRow, uCol))
+    {
+        throw CAppException("Elements outside the band cannot be set.");
+    }
+
+    m_Elements[Offset(uRow, uCol)] = Element;
+}
+
+template <class T>
+CMatrix<T> CBandedMatrix<T>::ToMatrix() const
+{
+    CMatrix<T> Matrix(m_uRows, m_uColumns);
+
+    for (unsigned int uRow = 0; uRow < m_uRows; uRow++)
+    {
+        for (unsigned int uCol = FirstColumn(uRow); uCol < EndColumn(uRow); uCol++)
+        {
+            Matrix.m_pMatrix[(size_t)uRow * m_uColumns + uCol] = m_Elements[Offset(uRow, uCol)];
+        }
+    }
+
+    return(Matrix);
+}
+
+// ---------------------------------------------------------------------------
+// Row n of the product only takes the rows of Matrix that fall in the band
+// of row n.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CBandedMatrix<T>::operator*(const CMatrix<T> & Matrix) const
+{
+    if (Matrix.m_uRows != m_uColumns)
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const unsigned int uCols = Matrix.m_uColumns;
+    unsigned long long ullWork = (unsigned long long)m_Elements.size() * uCols;
+    CMatrix<T> Product(m_uRows, uCols);
+
+    CMatrix<T>::ForEachRowChunk(m_uRows, ullWork, CMatrix<T>::ParallelMultiplyAdds(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            T * pDest = &Product.m_pMatrix[(size_t)uRow * uCols];
+
+            for (unsigned int uDot = FirstColumn(uRow); uDot < EndColumn(uRow); uDot++)
+            {
+                CGemmKernel<T>::MultiplyAddRow(uCols, m_Elements[Offset(uRow, uDot)], &Matrix.m_pMatrix[(size_t)uDot * uCols], pDest);
+            }
+        }
+    });
+
+    return(Product);
+}
@@ -0,0 +1,471 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CMatrix.h"
+#include <algorithm>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// A boolean matrix with 64 elements packed into each word, 32 times smaller
+// than the same 0/1 matrix in a CMatrix<int>.
+//
+// Every row starts on a new word; element (i, j) is bit j % 64 of word
+// j / 64 of row i. The bits past the last column of each row are always
+// zero, so whole words can be combined and counted without masking.
+//
+// Three products are offered, all of A (m * k) and B (k * n):
+//
+//     BooleanProduct  C(i, j) = OR over d of A(i, d) AND B(d, j)
+//     XorProduct      C(i, j) = XOR over d of A(i, d) AND B(d, j)
+//     CountProduct    C(i, j) = number of d with A(i, d) AND B(d, j)
+//
+// The first is reachability in one step along the edges of two graphs, the
+// second the product over GF(2) and the third the size of the intersection
+// of row set i of A and column set j of B.
+// ---------------------------------------------------------------------------
+
+class CBitMatrix
+{
+public:
+    CBitMatrix(unsigned int uRows, unsigned int uCols);
+
+    // ---------------------------------------------------------------------------
+    // Every non-zero element of Matrix becomes a set bit.
+
+    explicit CBitMatrix(const CMatrix<int> & Matrix);
+
+    static CBitMatrix Identity(unsigned int uSize);
+
+    inline unsigned int NumRows() const { return(m_Words.NumRows()); }
+    inline unsigned int NumColumns() const { return(m_uColumns); }
+    inline unsigned int WordsPerRow() const { return(m_Words.NumColumns()); }
+
+    inline bool GetAt(unsigned int uRow, unsigned int uCol) const;
+    inline void SetAt(unsigned int uRow, unsigned int uCol, bool bValue);
+
+    // ---------------------------------------------------------------------------
+    // The WordsPerRow() words of one row.
+
+    inline const unsigned long long * row_ptr(unsigned int uRow) const { return(m_Words.row_ptr(uRow)); }
+
+    // ---------------------------------------------------------------------------
+    // The matrix as 0/1 ints, and the number of set bits.
+
+    CMatrix<int> ToMatrix() const;
+    unsigned long long Count() const;
+
+    bool operator==(const CBitMatrix & Matrix) const;
+    inline bool operator!=(const CBitMatrix & Matrix) const { return(!(*this == Matrix)); }
+
+    // ---------------------------------------------------------------------------
+    // Element wise OR, AND and XOR, a word at a time.
+
+    CBitMatrix operator|(const CBitMatrix & Matrix) const;
+    CBitMatrix operator&(const CBitMatrix & Matrix) const;
+    CBitMatrix operator^(const CBitMatrix & Matrix) const;
+
+    CBitMatrix Transpose() const;
+
+    CBitMatrix BooleanProduct(const CBitMatrix & Matrix) const;
+    CBitMatrix XorProduct(const CBitMatrix & Matrix) const;
+    CMatrix<int> CountProduct(const CBitMatrix & Matrix) const;
+
+    static unsigned int PopCount(unsigned long long ullWord);
+
+private:
+    struct COr { inline unsigned long long operator()(unsigned long long a, unsigned long long b) const { return(a | b); } };
+    struct CAnd { inline unsigned long long operator()(unsigned long long a, unsigned long long b) const { return(a & b); } };
+    struct CXor { inline unsigned long long operator()(unsigned long long a, unsigned long long b) const { return(a ^ b); } };
+
+    template <class F>
+    CBitMatrix Combine(const CBitMatrix & Matrix, F Operation) const;
+
+    template <class F>
+    CBitMatrix FourRussians(const CBitMatrix & Matrix, F Operation) const;
+
+    static void Transpose64(unsigned long long * pBlock);
+
+    // Rows of B combined by one table, and the words of each table entry.
+
+    static const unsigned int TABLE_BITS = 8;
+    static const unsigned int TABLE_WORDS = 32;
+
+    unsigned int m_uColumns;
+    CMatrix<unsigned long long> m_Words;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CBitMatrix::CBitMatrix(unsigned int uRows, unsigned int uCols)
+    : m_uColumns(uCols), m_Words(uRows, (uCols + 63) / 64)
+{
+}
+
+inline CBitMatrix::CBitMatrix(const CMatrix<int> & Matrix)
+    : m_uColumns(Matrix.NumColumns()), m_Words(Matrix.NumRows(), (Matrix.NumColumns() + 63) / 64)
+{
+    for (unsigned int uRow = 0; uRow < NumRows(); uRow++)
+    {
+        const int * pSource = Matrix.row_ptr(uRow);
+        unsigned long long * pDest = m_Words.row_ptr(uRow);
+
+        for (unsigned int uCol = 0; uCol < m_uColumns; uCol++)
+        {
+            pDest[uCol / 64] |= (unsigned long long)(pSource[uCol] != 0) << (uCol % 64);
+        }
+    }
+}
+
+inline CBitMatrix CBitMatrix::Identity(unsigned int uSize)
+{
+    CBitMatrix Result(uSize, uSize);
+
+    for (unsigned int uIdx = 0; uIdx < uSize; uIdx++)
+    {
+        Result.SetAt(uIdx, uIdx, true);
+    }
+
+    return(Result);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline bool CBitMatrix::GetAt(unsigned int uRow, unsigned int uCol) const
+{
+    if (uRow >= NumRows() || uCol >= m_uColumns)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    return(((m_Words.row_ptr(uRow)[uCol / 64] >> (uCol % 64)) & 1) != 0);
+}
+
+inline void CBitMatrix::SetAt(unsigned int uRow, unsigned int uCol, bool bValue)
+{
+    if (uRow >= NumRows() || uCol >= m_uColumns)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    unsigned long long & ullWord = m_Words.row_ptr(uRow)[uCol / 64];
+    const unsigned long long ullBit = 1ULL << (uCol % 64);
+
+    ullWord = bValue ? (ullWord | ullBit) : (ullWord & ~ullBit);
+}
+
+inline CMatrix<int> CBitMatrix::ToMatrix() const
+{
+    CMatrix<int> Result(NumRows(), m_uColumns);
+
+    for (unsigned int uRow = 0; uRow < NumRows(); uRow++)
+    {
+        const unsigned long long * pSource = m_Words.row_ptr(uRow);
+        int * pDest = Result.row_ptr(uRow);
+
+        for (unsigned int uCol = 0; uCol < m_uColumns; uCol++)
+        {
+            pDest[uCol] = (int)((pSource[uCol / 64] >> (uCol % 64)) & 1);
+        }
+    }
+
+    return(Result);
+}
+
+inline unsigned long long CBitMatrix::Count() const
+{
+    unsigned long long ullCount = 0;
+
+    for (unsigned long long ullWord : m_Words)
+    {
+        ullCount += PopCount(ullWord);
+    }
+
+    return(ullCount);
+}
+
+inline bool CBitMatrix::operator==(const CBitMatrix & Matrix) const
+{
+    return(NumRows() == Matrix.NumRows() && m_uColumns == Matrix.m_uColumns &&
+           std::equal(m_Words.begin(), m_Words.end(), Matrix.m_Words.begin()));
+}
+
+// ---------------------------------------------------------------------------
+// The instruction where there is one, the bit slicing count otherwise.
+// ---------------------------------------------------------------------------
+
+inline unsigned int CBitMatrix::PopCount(unsigned long long ullWord)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return((unsigned int)__popcnt64(ullWord));
+#elif defined(__GNUC__)
+    return((unsigned int)__builtin_popcountll(ullWord));
+#else
+    ullWord = ullWord - ((ullWord >> 1) & 0x5555555555555555ULL);
+    ullWord = (ullWord & 0x3333333333333333ULL) + ((ullWord >> 2) & 0x3333333333333333ULL);
+    ullWord = (ullWord + (ullWord >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+
+    return((unsigned int)((ullWord * 0x0101010101010101ULL) >> 56));
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class F>
+CBitMatrix CBitMatrix::Combine(const CBitMatrix & Matrix, F Operation) const
+{
+    if (NumRows() != Matrix.NumRows() || m_uColumns != Matrix.m_uColumns)
+    {
+        throw CAppException("Matrixes must be the same size to combine them.");
+    }
+
+    CBitMatrix Result(NumRows(), m_uColumns);
+    const unsigned int uWords = WordsPerRow();
+
+    CMatrix<int>::ForEachRowChunk(NumRows(), m_Words.size(), CMatrix<int>::ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIdx = (size_t)uBegin * uWords; uIdx < (size_t)uEnd * uWords; uIdx++)
+        {
+            Result.m_Words.m_pMatrix[uIdx] = Operation(m_Words.m_pMatrix[uIdx], Matrix.m_Words.m_pMatrix[uIdx]);
+        }
+    });
+
+    return(Result);
+}
+
+inline CBitMatrix CBitMatrix::operator|(const CBitMatrix & Matrix) const
+{
+    return(Combine(Matrix, COr()));
+}
+
+inline CBitMatrix CBitMatrix::operator&(const CBitMatrix & Matrix) const
+{
+    return(Combine(Matrix, CAnd()));
+}
+
+inline CBitMatrix CBitMatrix::operator^(const CBitMatrix & Matrix) const
+{
+    return(Combine(Matrix, CXor()));
+}
+
+// ---------------------------------------------------------------------------
+// Transposes a 64 * 64 block of bits in place, one word per row, in six
+// rounds: first the two 32 * 32 off-diagonal quarters are swapped, then
+// the 16 * 16 off-diagonal quarters inside each quarter, and so on down to
+// single bits.
+// ---------------------------------------------------------------------------
+
+inline void CBitMatrix::Transpose64(unsigned long long * pBlock)
+{
+    unsigned long long ullMask = 0x00000000FFFFFFFFULL;
+
+    for (unsigned int uWidth = 32; uWidth != 0; uWidth >>= 1, ullMask ^= ullMask << uWidth)
+    {
+        for (unsigned int uRow = 0; uRow < 64; uRow = ((uRow | uWidth) + 1) & ~uWidth)
+        {
+            unsigned long long ullSwap = ((pBlock[uRow] >> uWidth) ^ pBlock[uRow | uWidth]) & ullMask;
+
+            pBlock[uRow] ^= ullSwap << uWidth;
+            pBlock[uRow | uWidth] ^= ullSwap;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Word w of 64 rows at a time is one block, which turns into word r / 64 of
+// 64 rows of the transpose. Rows and columns past the end read as zero and
+// are not written.
+// ---------------------------------------------------------------------------
+
+inline CBitMatrix CBitMatrix::Transpose() const
+{
+    const unsigned int uRows = NumRows();
+    const unsigned int uWords = WordsPerRow();
+    CBitMatrix Result(m_uColumns, uRows);
+
+    CMatrix<int>::ForEachRowChunk(uWords, m_Words.size(), CMatrix<int>::ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        unsigned long long Block[64];
+
+        for (unsigned int uWord = uBegin; uWord < uEnd; uWord++)
+        {
+            const unsigned int uCols = std::min(64u, m_uColumns - uWord * 64);
+
+            for (unsigned int uRow0 = 0; uRow0 < uRows; uRow0 += 64)
+            {
+                const unsigned int uBlockRows = std::min(64u, uRows - uRow0);
+
+                for (unsigned int uRow = 0; uRow < 64; uRow++)
+                {
+                    Block[uRow] = (uRow < uBlockRows) ? m_Words.row_ptr(uRow0 + uRow)[uWord] : 0;
+                }
+
+                Transpose64(Block);
+
+                for (unsigned int uCol = 0; uCol < uCols; uCol++)
+                {
+                    Result.m_Words.row_ptr(uWord * 64 + uCol)[uRow0 / 64] = Block[uCol];
+                }
+            }
+        }
+    });
+
+    return(Result);
+}
+
+// ---------------------------------------------------------------------------
+// The method of the Four Russians. TABLE_BITS rows of B at a time are
+// combined in every possible way into a table, each entry built from an
+// earlier one and one more row of B. A row of the product then takes one
+// table lookup, indexed by the matching TABLE_BITS bits of its row of A,
+// and one word operation per word of the row instead of one per set bit.
+//
+// The same works for OR and for XOR, the two differ only in how rows are
+// combined. Every worker takes a band of rows of the product and builds
+// its own tables, TABLE_WORDS words wide so that a table stays in the L2
+// cache while the band goes through it.
+// ---------------------------------------------------------------------------
+
+template <class F>
+CBitMatrix CBitMatrix::FourRussians(const CBitMatrix & Matrix, F Operation) const
+{
+    if (m_uColumns != Matrix.NumRows())
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const unsigned int uK = m_uColumns;
+    const unsigned int uWords = Matrix.WordsPerRow();
+    const unsigned long long ullWork = (unsigned long long)NumRows() * ((uK + TABLE_BITS - 1) / TABLE_BITS) * uWords;
+    CBitMatrix Result(NumRows(), Matrix.NumColumns());
+
+    CMatrix<int>::ForEachRowChunk(NumRows(), ullWork, CMatrix<int>::ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        std::vector<unsigned long long> Table((size_t)TABLE_WORDS << TABLE_BITS);
+
+        for (unsigned int uWord0 = 0; uWord0 < uWords; uWord0 += TABLE_WORDS)
+        {
+            const unsigned int uTableWords = (uWords - uWord0 < TABLE_WORDS) ? uWords - uWord0 : TABLE_WORDS;
+
+            for (unsigned int uDot0 = 0; uDot0 < uK; uDot0 += TABLE_BITS)
+            {
+                const unsigned int uBits = (uK - uDot0 < TABLE_BITS) ? uK - uDot0 : TABLE_BITS;
+
+                // Entry s combines the rows of B whose bits are set in s:
+                // entry s without its lowest bit, plus the row of that bit
+
+                std::fill(Table.begin(), Table.begin() + uTableWords, 0ULL);
+
+                for (unsigned int uEntry = 1; uEntry < (1u << uBits); uEntry++)
+                {
+                    unsigned int uLowest = 0;
+
+                    while (((uEntry >> uLowest) & 1) == 0)
+                    {
+                        uLowest++;
+                    }
+
+                    const unsigned long long * pPrevious = &Table[(size_t)(uEntry & (uEntry - 1)) * TABLE_WORDS];
+                    const unsigned long long * pRow = Matrix.m_Words.row_ptr(uDot0 + uLowest) + uWord0;
+                    unsigned long long * pEntry = &Table[(size_t)uEntry * TABLE_WORDS];
+
+                    for (unsigned int uWord = 0; uWord < uTableWords; uWord++)
+                    {
+                        pEntry[uWord] = Operation(pPrevious[uWord], pRow[uWord]);
+                    }
+                }
+
+                for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+                {
+                    const unsigned int uEntry = (unsigned int)(m_Words.row_ptr(uRow)[uDot0 / 64] >> (uDot0 % 64)) & ((1u << TABLE_BITS) - 1);
+
+                    if (uEntry == 0)
+                    {
+                        continue;
+                    }
+
+                    const unsigned long long * pEntry = &Table[(size_t)uEntry * TABLE_WORDS];
+                    unsigned long long * pDest = Result.m_Words.row_ptr(uRow) + uWord0;
+
+                    for (unsigned int uWord = 0; uWord < uTableWords; uWord++)
+                    {
+                        pDest[uWord] = Operation(pDest[uWord], pEntry[uWord]);
+                    }
+                }
+            }
+        }
+    });
+
+    return(Result);
+}
+
+inline CBitMatrix CBitMatrix::BooleanProduct(const CBitMatrix & Matrix) const
+{
+    return(FourRussians(Matrix, COr()));
+}
+
+inline CBitMatrix CBitMatrix::XorProduct(const CBitMatrix & Matrix) const
+{
+    return(FourRussians(Matrix, CXor()));
+}
+
+// ---------------------------------------------------------------------------
+// With B transposed both operands of every element are rows, and the count
+// is the number of bits set in their AND, 64 at a time. The columns are
+// taken in blocks of rows of the transpose that stay in the cache while a
+// band of rows of A goes through them.
+// ---------------------------------------------------------------------------
+
+inline CMatrix<int> CBitMatrix::CountProduct(const CBitMatrix & Matrix) const
+{
+    if (m_uColumns != Matrix.NumRows())
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const CBitMatrix Columns = Matrix.Transpose();
+    const unsigned int uN = Matrix.NumColumns();
+    const unsigned int uWords = WordsPerRow();
+    const unsigned int uBlockN = std::max(1u, 4096 / std::max(1u, uWords));
+    const unsigned long long ullWork = (unsigned long long)NumRows() * uN * uWords;
+    CMatrix<int> Result(NumRows(), uN, CMatrix<int>::CUninitialized());
+
+    CMatrix<int>::ForEachRowChunk(NumRows(), ullWork, CMatrix<int>::ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uCol0 = 0; uCol0 < uN; uCol0 += uBlockN)
+        {
+            const unsigned int uColEnd = std::min(uN, uCol0 + uBlockN);
+
+            for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+            {
+                const unsigned long long * pRow = m_Words.row_ptr(uRow);
+                int * pDest = Result.row_ptr(uRow);
+
+                for (unsigned int uCol = uCol0; uCol < uColEnd; uCol++)
+                {
+                    const unsigned long long * pColumn = Columns.m_Words.row_ptr(uCol);
+                    unsigned int uCount = 0;
+
+                    for (unsigned int uWord = 0; uWord < uWords; uWord++)
+                    {
+                        uCount += PopCount(pRow[uWord] & pColumn[uWord]);
+                    }
+
+                    pDest[uCol] = (int)uCount;
+                }
+            }
+        }
+    });
+
+    return(Result);
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CMatrix.h"
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// A square matrix whose only non-zero elements are on the main diagonal.
+// Only the diagonal is stored. Multiplying a dense matrix by it scales the
+// rows, or the columns when it is on the right, in O(rows * columns).
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CDiagonalMatrix
+{
+public:
+    // ---------------------------------------------------------------------------
+    // pDiagonal holds uSize elements, or is NULL for a zero matrix.
+
+    CDiagonalMatrix(unsigned int uSize, const T * pDiagonal = NULL);
+
+    // ---------------------------------------------------------------------------
+    // Takes the main diagonal of a square matrix, the rest is ignored.
+
+    explicit CDiagonalMatrix(const CMatrix<T> & Matrix);
+
+    inline unsigned int Size() const { return((unsigned int)m_Diagonal.size()); }
+
+    // ---------------------------------------------------------------------------
+    // Elements off the diagonal read as zero and cannot be set.
+
+    T GetAt(unsigned int uRow, unsigned int uCol) const;
+    void SetAt(unsigned int uRow, unsigned int uCol, T Element);
+
+    CMatrix<T> ToMatrix() const;
+
+    // ---------------------------------------------------------------------------
+    // this * Matrix, and Matrix * this.
+
+    CMatrix<T> operator*(const CMatrix<T> & Matrix) const;
+    CMatrix<T> PostMultiply(const CMatrix<T> & Matrix) const;
+
+    // ---------------------------------------------------------------------------
+    // The X for which this * X = B. Throws if a diagonal element is zero.
+
+    CMatrix<T> Solve(const CMatrix<T> & B) const;
+
+private:
+    std::vector<T> m_Diagonal;
+};
+
+// ---------------------------------------------------------------------------
+// Matrix * Diagonal
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> operator*(const CMatrix<T> & Matrix, const CDiagonalMatrix<T> & Diagonal)
+{
+    return(Diagonal.PostMultiply(Matrix));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CDiagonalMatrix<T>::CDiagonalMatrix(unsigned int uSize, const T * pDiagonal)
+{
+    if (pDiagonal)
+    {
+        m_Diagonal.assign(pDiagonal, pDiagonal + uSize);
+    }
+    else
+    {
+        m_Diagonal.assign(uSize, T());
+    }
+}
+
+template <class T>
+CDiagonalMatrix<T>::CDiagonalMatrix(const CMatrix<T> & Matrix)
+{
+    if (Matrix.m_uRows != Matrix.m_uColumns)
+    {
+        throw CAppException("A diagonal matrix must be square.");
+    }
+
+    m_Diagonal.resize(Matrix.m_uRows);
+
+    for (unsigned int uIdx = 0; uIdx < Matrix.m_uRows; uIdx++)
+    {
+        m_Diagonal[uIdx] = Matrix.m_pMatrix[(size_t)uIdx * Matrix.m_uColumns + uIdx];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CDiagonalMatrix<T>::GetAt(unsigned int uRow, unsigned int uCol) const
+{
+    if (uRow >= Size() || uCol >= Size())
+    {
+        throw CAppException("Index out of range");
+    }
+
+    return((uRow == uCol) ? m_Diagonal[uRow] : T());
+}
+
+template <class T>
+void CDiagonalMatrix<T>::SetAt(unsigned int uRow, unsigned int uCol, T Element)
+{
+    if (uRow >= Size() || uCol >= Size())
+    {
+        throw CAppException("Index out of range");
+    }
+
+    if (uRow != uCol)
+    {
+        throw CAppException("Only the diagonal of a diagonal matrix can be set.");
+    }
+
+    m_Diagonal[uRow] = Element;
+}
+
+template <class T>
+CMatrix<T> CDiagonalMatrix<T>::ToMatrix() const
+{
+    CMatrix<T> Matrix(Size(), Size());
+
+    for (unsigned int uIdx = 0; uIdx < Size(); uIdx++)
+    {
+        Matrix.m_pMatrix[(size_t)uIdx * Size() + uIdx] = m_Diagonal[uIdx];
+    }
+
+    return(Matrix);
+}
+
+// ---------------------------------------------------------------------------
+// Row n of the product is row n of Matrix times diagonal element n.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CDiagonalMatrix<T>::operator*(const CMatrix<T> & Matrix) const
+{
+    if (Matrix.m_uRows != Size())
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const unsigned int uCols = Matrix.m_uColumns;
+    CMatrix<T> Product(Size(), uCols, typename CMatrix<T>::CUninitialized());
+
+    CMatrix<T>::ForEachRowChunk(Size(), (unsigned long long)Size() * uCols, CMatrix<T>::ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            const T d = m_Diagonal[uRow];
+            const T * pSource = &Matrix.m_pMatrix[(size_t)uRow * uCols];
+            T * pDest = &Product.m_pMatrix[(size_t)uRow * uCols];
+
+            for (unsigned int uCol = 0; uCol < uCols; uCol++)
+            {
+                pDest[uCol] = d * pSource[uCol];
+            }
+        }
+    });
+
+    return(Product);
+}
+
+// ---------------------------------------------------------------------------
+// Column n of the product is column n of Matrix times diagonal element n,
+// which is done a row at a time so the matrix is read in storage order.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CDiagonalMatrix<T>::PostMultiply(const CMatrix<T> & Matrix) const
+{
+    if (Matrix.m_uColumns != Size())
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const unsigned int uCols = Size();
+    const T * pDiagonal = m_Diagonal.data();
+    CMatrix<T> Product(Matrix.m_uRows, uCols, typename CMatrix<T>::CUninitialized());
+
+    CMatrix<T>::ForEachRowChunk(Matrix.m_uRows, (unsigned long long)Matrix.m_uRows * uCols, CMatrix<T>::ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            const T * pSource = &Matrix.m_pMatrix[(size_t)uRow * uCols];
+            T * pDest = &Product.m_pMatrix[(size_t)uRow * uCols];
+
+            for (unsigned int uCol = 0; uCol < uCols; uCol++)
+            {
+                pDest[uCol] = pSource[uCol] * pDiagonal[uCol];
+            }
+        }
+    });
+
+    return(Product);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CDiagonalMatrix<T>::Solve(const CMatrix<T> & B) const
+{
+    if (B.m_uRows != Size())
+    {
+        throw CAppException("Number of rows of the right hand side must equal the size of the matrix.");
+    }
+
+    for (unsigned int uIdx = 0; uIdx < Size(); uIdx++)
+    {
+        if (m_Diagonal[uIdx] == T())
+        {
+            throw CAppException("Matrix is singular");
+        }
+    }
+
+    const unsigned int uCols = B.m_uColumns;
+    CMatrix<T> X(Size(), uCols, typename CMatrix<T>::CUninitialized());
+
+    CMatrix<T>::ForEachRowChunk(Size(), (unsigned long long)Size() * uCols, CMatrix<T>::ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            const T d = m_Diagonal[uRow];
+            const T * pSource = &B.m_pMatrix[(size_t)uRow * uCols];
+            T * pDest = &X.m_pMatrix[(size_t)uRow * uCols];
+
+            for (unsigned int uCol = 0; uCol < uCols; uCol++)
+            {
+                pDest[uCol] = pSource[uCol] / d;
+            }
+        }
+    });
+
+    return(X);
+}
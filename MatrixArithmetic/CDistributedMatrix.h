@@ -0,0 +1,593 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CMatrix.h"
+#include "CMatrixTransport.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// The ranks of a transport arranged as a NumRows() * NumColumns() grid. Rank
+// r sits in grid row r / NumColumns() and grid column r % NumColumns().
+// ---------------------------------------------------------------------------
+
+class CProcessGrid
+{
+public:
+    CProcessGrid(CMatrixTransport & Transport, int nRows, int nCols);
+
+    inline int NumRows() const { return(m_nRows); }
+    inline int NumColumns() const { return(m_nColumns); }
+    inline int MyRow() const { return(m_nMyRow); }
+    inline int MyColumn() const { return(m_nMyColumn); }
+    inline int RankOf(int nRow, int nCol) const { return(nRow * m_nColumns + nCol); }
+    inline CMatrixTransport & Transport() const { return(m_Transport); }
+
+    // ---------------------------------------------------------------------------
+    // Broadcasts cbSize bytes from the grid column nRootCol to every rank in
+    // our grid row. Every rank of the row must call this with the same root.
+
+    void BroadcastRow(int nRootCol, void * pData, size_t cbSize) const;
+
+    // ---------------------------------------------------------------------------
+    // Broadcasts cbSize bytes from the grid row nRootRow to every rank in our
+    // grid column. Every rank of the column must call this with the same root.
+
+    void BroadcastColumn(int nRootRow, void * pData, size_t cbSize) const;
+
+private:
+    void Broadcast(int nMember, int nRootMember, int nMembers, bool bAlongRow, void * pData, size_t cbSize) const;
+
+    CMatrixTransport & m_Transport;
+    int m_nRows;
+    int m_nColumns;
+    int m_nMyRow;
+    int m_nMyColumn;
+};
+
+// ---------------------------------------------------------------------------
+// A matrix distributed over a process grid using a 2D block-cyclic layout.
+// The global matrix is cut into BlockSize() * BlockSize() blocks and block
+// (I, J) lives on the rank at grid position (I % grid rows, J % grid cols).
+// Each rank keeps all of its blocks packed together in one local CMatrix, in
+// the same relative order as they appear in the global matrix.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CDistributedMatrix
+{
+public:
+    CDistributedMatrix(const CProcessGrid & Grid, unsigned int uRows, unsigned int uCols, unsigned int uBlockSize);
+
+    inline unsigned int NumRows() const { return(m_uRows); }
+    inline unsigned int NumColumns() const { return(m_uColumns); }
+    inline unsigned int BlockSize() const { return(m_uBlockSize); }
+    inline const CProcessGrid & Grid() const { return(m_Grid); }
+
+    // ---------------------------------------------------------------------------
+    // The blocks owned by this rank.
+
+    inline CMatrix<T> & LocalMatrix() { return(m_Local); }
+    inline const CMatrix<T> & LocalMatrix() const { return(m_Local); }
+
+    // ---------------------------------------------------------------------------
+    // Converts a row or column index of the local matrix to the global one.
+
+    unsigned int GlobalRow(unsigned int uLocalRow) const;
+    unsigned int GlobalColumn(unsigned int uLocalCol) const;
+
+    // ---------------------------------------------------------------------------
+    // Distributes a global matrix held by rank nRoot. The other ranks pass
+    // NULL for pGlobal.
+
+    void Scatter(const CMatrix<T> * pGlobal, int nRoot = 0);
+
+    // ---------------------------------------------------------------------------
+    // Collects the whole matrix on rank nRoot. The other ranks get back an
+    // empty matrix.
+
+    CMatrix<T> Gather(int nRoot = 0) const;
+
+    // ---------------------------------------------------------------------------
+    // this = A * B computed with SUMMA. For every block column of A and the
+    // matching block row of B, the owners broadcast them as panels along the
+    // grid rows and columns and each rank adds the product of the two panels
+    // to its local tile. A communication thread broadcasts the next pair of
+    // panels while the current pair is being multiplied. The panels are
+    // read from A and B while this is being built, so neither of them may be
+    // this matrix.
+
+    void Multiply(const CDistributedMatrix<T> & A, const CDistributedMatrix<T> & B);
+
+private:
+    struct CPanels
+    {
+        inline CPanels(unsigned int uRows, unsigned int uDepth, unsigned int uCols) : A(uRows, uDepth), B(uDepth, uCols) {}
+
+        CMatrix<T> A;
+        CMatrix<T> B;
+    };
+
+    static unsigned int LocalCount(unsigned int uGlobal, unsigned int uBlockSize, int nProc, int nProcs);
+    static unsigned int LocalToGlobal(unsigned int uLocal, unsigned int uBlockSize, int nProc, int nProcs);
+
+    static std::vector<T> ToBuffer(const CMatrix<T> & Matrix);
+    static CMatrix<T> FromBuffer(unsigned int uRows, unsigned int uCols, std::vector<T> & Buffer);
+
+    CMatrix<T> ExtractLocal(const CMatrix<T> & Global, int nProcRow, int nProcCol) const;
+    void InsertLocal(CMatrix<T> & Global, const CMatrix<T> & Local, int nProcRow, int nProcCol) const;
+
+    void BroadcastPanels(const CDistributedMatrix<T> & A, const CDistributedMatrix<T> & B, unsigned int uKBlock, CPanels & Panels) const;
+
+    const CProcessGrid & m_Grid;
+    unsigned int m_uRows;
+    unsigned int m_uColumns;
+    unsigned int m_uBlockSize;
+    CMatrix<T> m_Local;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CProcessGrid::CProcessGrid(CMatrixTransport & Transport, int nRows, int nCols) : m_Transport(Transport)
+{
+    if (nRows <= 0 || nCols <= 0 || nRows * nCols != Transport.Size())
+    {
+        throw CAppException("The process grid must cover every rank exactly once.");
+    }
+
+    m_nRows = nRows;
+    m_nColumns = nCols;
+    m_nMyRow = Transport.Rank() / nCols;
+    m_nMyColumn = Transport.Rank() % nCols;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CProcessGrid::BroadcastRow(int nRootCol, void * pData, size_t cbSize) const
+{
+    Broadcast(m_nMyColumn, nRootCol, m_nColumns, true, pData, cbSize);
+}
+
+inline void CProcessGrid::BroadcastColumn(int nRootRow, void * pData, size_t cbSize) const
+{
+    Broadcast(m_nMyRow, nRootRow, m_nRows, false, pData, cbSize);
+}
+
+// ---------------------------------------------------------------------------
+// Binomial tree broadcast. Members are renumbered so the root is zero, then
+// every member receives from the one whose number differs in its lowest set
+// bit and forwards to the members below that bit. The root's send cost
+// grows with log2 of the group size instead of linearly.
+// ---------------------------------------------------------------------------
+
+inline void CProcessGrid::Broadcast(int nMember, int nRootMember, int nMembers, bool bAlongRow, void * pData, size_t cbSize) const
+{
+    int nRelative = (nMember - nRootMember + nMembers) % nMembers;
+    int nMask = 1;
+
+    while (nMask < nMembers)
+    {
+        if (nRelative & nMask)
+        {
+            int nSource = (nRelative - nMask + nRootMember) % nMembers;
+            m_Transport.Receive(bAlongRow ? RankOf(m_nMyRow, nSource) : RankOf(nSource, m_nMyColumn), pData, cbSize);
+            break;
+        }
+
+        nMask <<= 1;
+    }
+
+    nMask >>= 1;
+
+    while (nMask > 0)
+    {
+        if (nRelative + nMask < nMembers)
+        {
+            int nDest = (nRelative + nMask + nRootMember) % nMembers;
+            m_Transport.Send(bAlongRow ? RankOf(m_nMyRow, nDest) : RankOf(nDest, m_nMyColumn), pData, cbSize);
+        }
+
+        nMask >>= 1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CDistributedMatrix<T>::CDistributedMatrix(const CProcessGrid & Grid, unsigned int uRows, unsigned int uCols, unsigned int uBlockSize)
+    : m_Grid(Grid),
+      m_uRows(uRows),
+      m_uColumns(uCols),
+      m_uBlockSize(uBlockSize ? uBlockSize : 1),
+      m_Local(LocalCount(uRows, uBlockSize ? uBlockSize : 1, Grid.MyRow(), Grid.NumRows()),
+              LocalCount(uCols, uBlockSize ? uBlockSize : 1, Grid.MyColumn(), Grid.NumColumns()))
+{
+}
+
+// ---------------------------------------------------------------------------
+// Number of the uGlobal rows (or columns) that land on process nProc when
+// they are dealt out in blocks of uBlockSize to nProcs processes.
+// ---------------------------------------------------------------------------
+
+template <class T>
+unsigned int CDistributedMatrix<T>::LocalCount(unsigned int uGlobal, unsigned int uBlockSize, int nProc, int nProcs)
+{
+    unsigned int uFullBlocks = uGlobal / uBlockSize;
+    unsigned int uCount = (uFullBlocks / nProcs) * uBlockSize;
+    unsigned int uRemaining = uFullBlocks % nProcs;
+
+    if ((unsigned int)nProc < uRemaining)
+    {
+        uCount += uBlockSize;
+    }
+    else if ((unsigned int)nProc == uRemaining)
+    {
+        uCount += uGlobal % uBlockSize;
+    }
+
+    return(uCount);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+unsigned int CDistributedMatrix<T>::LocalToGlobal(unsigned int uLocal, unsigned int uBlockSize, int nProc, int nProcs)
+{
+    unsigned int uLocalBlock = uLocal / uBlockSize;
+    return((uLocalBlock * nProcs + nProc) * uBlockSize + uLocal % uBlockSize);
+}
+
+template <class T>
+unsigned int CDistributedMatrix<T>::GlobalRow(unsigned int uLocalRow) const
+{
+    return(LocalToGlobal(uLocalRow, m_uBlockSize, m_Grid.MyRow(), m_Grid.NumRows()));
+}
+
+template <class T>
+unsigned int CDistributedMatrix<T>::GlobalColumn(unsigned int uLocalCol) const
+{
+    return(LocalToGlobal(uLocalCol, m_uBlockSize, m_Grid.MyColumn(), m_Grid.NumColumns()));
+}
+
+// ---------------------------------------------------------------------------
+// Matrices travel over the transport as their raw element buffer. Both sides
+// always know the dimensions so they are never sent.
+// ---------------------------------------------------------------------------
+
+template <class T>
+std::vector<T> CDistributedMatrix<T>::ToBuffer(const CMatrix<T> & Matrix)
+{
+    unsigned int uNumElements = Matrix.NumRows() * Matrix.NumColumns();
+    std::vector<T> Buffer(uNumElements);
+
+    if (uNumElements)
+    {
+        Matrix.GetAllData(&uNumElements, Buffer.data());
+    }
+
+    return(Buffer);
+}
+
+template <class T>
+CMatrix<T> CDistributedMatrix<T>::FromBuffer(unsigned int uRows, unsigned int uCols, std::vector<T> & Buffer)
+{
+    return(CMatrix<T>(uRows, uCols, Buffer.empty() ? NULL : Buffer.data()));
+}
+
+// ---------------------------------------------------------------------------
+// Walks the blocks that belong to grid position nProcRow, nProcCol and copies
+// them between the global matrix and that process's local matrix.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CDistributedMatrix<T>::ExtractLocal(const CMatrix<T> & Global, int nProcRow, int nProcCol) const
+{
+    unsigned int uLocalRows = LocalCount(m_uRows, m_uBlockSize, nProcRow, m_Grid.NumRows());
+    unsigned int uLocalCols = LocalCount(m_uColumns, m_uBlockSize, nProcCol, m_Grid.NumColumns());
+    CMatrix<T> Local(uLocalRows, uLocalCols);
+
+    for (unsigned int uLocalRow = 0; uLocalRow < uLocalRows; uLocalRow += m_uBlockSize)
+    {
+        unsigned int uRow = LocalToGlobal(uLocalRow, m_uBlockSize, nProcRow, m_Grid.NumRows());
+        unsigned int uHeight = (m_uRows - uRow < m_uBlockSize) ? m_uRows - uRow : m_uBlockSize;
+
+        for (unsigned int uLocalCol = 0; uLocalCol < uLocalCols; uLocalCol += m_uBlockSize)
+        {
+            unsigned int uCol = LocalToGlobal(uLocalCol, m_uBlockSize, nProcCol, m_Grid.NumColumns());
+            unsigned int uWidth = (m_uColumns - uCol < m_uBlockSize) ? m_uColumns - uCol : m_uBlockSize;
+
+            Local.SetSubMatrix(uLocalRow, uLocalCol, Global.SubMatrix(uRow, uCol, uHeight, uWidth));
+        }
+    }
+
+    return(Local);
+}
+
+template <class T>
+void CDistributedMatrix<T>::InsertLocal(CMatrix<T> & Global, const CMatrix<T> & Local, int nProcRow, int nProcCol) const
+{
+    for (unsigned int uLocalRow = 0; uLocalRow < Local.NumRows(); uLocalRow += m_uBlockSize)
+    {
+        unsigned int uRow = LocalToGlobal(uLocalRow, m_uBlockSize, nProcRow, m_Grid.NumRows());
+        unsigned int uHeight = (m_uRows - uRow < m_uBlockSize) ? m_uRows - uRow : m_uBlockSize;
+
+        for (unsigned int uLocalCol = 0; uLocalCol < Local.NumColumns(); uLocalCol += m_uBlockSize)
+        {
+            unsigned int uCol = LocalToGlobal(uLocalCol, m_uBlockSize, nProcCol, m_Grid.NumColumns());
+            unsigned int uWidth = (m_uColumns - uCol < m_uBlockSize) ? m_uColumns - uCol : m_uBlockSize;
+
+            Global.SetSubMatrix(uRow, uCol, Local.SubMatrix(uLocalRow, uLocalCol, uHeight, uWidth));
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CDistributedMatrix<T>::Scatter(const CMatrix<T> * pGlobal, int nRoot)
+{
+    CMatrixTransport & Transport = m_Grid.Transport();
+
+    if (Transport.Rank() == nRoot)
+    {
+        if (pGlobal == NULL || pGlobal->NumRows() != m_uRows || pGlobal->NumColumns() != m_uColumns)
+        {
+            throw CAppException("The matrix to scatter is incorrectly sized.");
+        }
+
+        for (int nRank = 0; nRank < Transport.Size(); nRank++)
+        {
+            CMatrix<T> Local = ExtractLocal(*pGlobal, nRank / m_Grid.NumColumns(), nRank % m_Grid.NumColumns());
+
+            if (nRank == nRoot)
+            {
+                m_Local.SetSubMatrix(0, 0, Local);
+            }
+            else
+            {
+                std::vector<T> Buffer = ToBuffer(Local);
+                Transport.Send(nRank, Buffer.data(), Buffer.size() * sizeof(T));
+            }
+        }
+    }
+    else
+    {
+        std::vector<T> Buffer(m_Local.NumRows() * m_Local.NumColumns());
+        Transport.Receive(nRoot, Buffer.data(), Buffer.size() * sizeof(T));
+        m_Local.SetSubMatrix(0, 0, FromBuffer(m_Local.NumRows(), m_Local.NumColumns(), Buffer));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CDistributedMatrix<T>::Gather(int nRoot) const
+{
+    CMatrixTransport & Transport = m_Grid.Transport();
+
+    if (Transport.Rank() != nRoot)
+    {
+        std::vector<T> Buffer = ToBuffer(m_Local);
+        Transport.Send(nRoot, Buffer.data(), Buffer.size() * sizeof(T));
+
+        return(CMatrix<T>(0, 0));
+    }
+
+    CMatrix<T> Global(m_uRows, m_uColumns);
+
+    for (int nRank = 0; nRank < Transport.Size(); nRank++)
+    {
+        int nProcRow = nRank / m_Grid.NumColumns();
+        int nProcCol = nRank % m_Grid.NumColumns();
+
+        if (nRank == nRoot)
+        {
+            InsertLocal(Global, m_Local, nProcRow, nProcCol);
+        }
+        else
+        {
+            unsigned int uLocalRows = LocalCount(m_uRows, m_uBlockSize, nProcRow, m_Grid.NumRows());
+            unsigned int uLocalCols = LocalCount(m_uColumns, m_uBlockSize, nProcCol, m_Grid.NumColumns());
+            std::vector<T> Buffer(uLocalRows * uLocalCols);
+
+            Transport.Receive(nRank, Buffer.data(), Buffer.size() * sizeof(T));
+            InsertLocal(Global, FromBuffer(uLocalRows, uLocalCols, Buffer), nProcRow, nProcCol);
+        }
+    }
+
+    return(Global);
+}
+
+// ---------------------------------------------------------------------------
+// Block column uKBlock of A lives in grid column uKBlock % grid columns and
+// is broadcast along every grid row. Block row uKBlock of B lives in grid row
+// uKBlock % grid rows and is broadcast along every grid column. Afterwards
+// each rank holds the A rows and B columns matching its own tile of C.
+// Panels is already sized for the block; the owners copy their part of A
+// and B into it and everybody else receives straight into it.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CDistributedMatrix<T>::BroadcastPanels(const CDistributedMatrix<T> & A, const CDistributedMatrix<T> & B, unsigned int uKBlock, CPanels & Panels) const
+{
+    const unsigned int uRows = Panels.A.NumRows();
+    const unsigned int uDepth = Panels.A.NumColumns();
+    const unsigned int uCols = Panels.B.NumColumns();
+
+    int nOwnerCol = uKBlock % m_Grid.NumColumns();
+    int nOwnerRow = uKBlock % m_Grid.NumRows();
+
+    if (m_Grid.MyColumn() == nOwnerCol)
+    {
+        unsigned int uLocalCol = (uKBlock / m_Grid.NumColumns()) * m_uBlockSize;
+        const T * pSource = A.m_Local.data() + uLocalCol;
+
+        for (unsigned int uRow = 0; uRow < uRows; uRow++)
+        {
+            const T * pRow = pSource + (size_t)uRow * A.m_Local.NumColumns();
+            std::copy(pRow, pRow + uDepth, Panels.A.data() + (size_t)uRow * uDepth);
+        }
+    }
+
+    m_Grid.BroadcastRow(nOwnerCol, Panels.A.data(), (size_t)uRows * uDepth * sizeof(T));
+
+    if (m_Grid.MyRow() == nOwnerRow)
+    {
+        unsigned int uLocalRow = (uKBlock / m_Grid.NumRows()) * m_uBlockSize;
+        const T * pSource = B.m_Local.data() + (size_t)uLocalRow * uCols;
+
+        std::copy(pSource, pSource + (size_t)uDepth * uCols, Panels.B.data());
+    }
+
+    m_Grid.BroadcastColumn(nOwnerRow, Panels.B.data(), (size_t)uDepth * uCols * sizeof(T));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CDistributedMatrix<T>::Multiply(const CDistributedMatrix<T> & A, const CDistributedMatrix<T> & B)
+{
+    if (A.m_uColumns != B.m_uRows)
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    if (m_uRows != A.m_uRows || m_uColumns != B.m_uColumns)
+    {
+        throw CAppException("Result matrix is incorrectly sized.");
+    }
+
+    if (&A.m_Grid != &m_Grid || &B.m_Grid != &m_Grid ||
+        A.m_uBlockSize != m_uBlockSize || B.m_uBlockSize != m_uBlockSize)
+    {
+        throw CAppException("Matrices must share the process grid and block size.");
+    }
+
+    if (&A == this || &B == this)
+    {
+        throw CAppException("The result matrix cannot be one of the operands.");
+    }
+
+    std::fill(m_Local.begin(), m_Local.end(), T());
+
+    unsigned int uKBlocks = (A.m_uColumns + m_uBlockSize - 1) / m_uBlockSize;
+
+    if (uKBlocks == 0)
+    {
+        return;
+    }
+
+    // Two full depth panels take turns: one is being multiplied while the
+    // next block is broadcast into the other. A shorter last block gets a
+    // panel of its own.
+
+    const unsigned int uFullBlocks = A.m_uColumns / m_uBlockSize;
+    std::unique_ptr<CPanels> pPanels[3];
+
+    for (unsigned int uIdx = 0; uIdx < 2 && uIdx < uFullBlocks; uIdx++)
+    {
+        pPanels[uIdx].reset(new CPanels(A.m_Local.NumRows(), m_uBlockSize, B.m_Local.NumColumns()));
+    }
+
+    if (uFullBlocks < uKBlocks)
+    {
+        pPanels[2].reset(new CPanels(A.m_Local.NumRows(), A.m_uColumns - uFullBlocks * m_uBlockSize, B.m_Local.NumColumns()));
+    }
+
+    auto PanelsFor = [&](unsigned int uKBlock) -> CPanels &
+    {
+        return(uKBlock < uFullBlocks ? *pPanels[uKBlock % 2] : *pPanels[2]);
+    };
+
+    // Only the communication thread talks to the transport. It may run one
+    // block ahead of the multiplies, never more, since it would otherwise
+    // overwrite the panel that is being multiplied.
+
+    std::mutex Lock;
+    std::condition_variable Changed;
+    unsigned int uBroadcast = 0;
+    unsigned int uMultiplied = 0;
+    std::exception_ptr pError;
+
+    std::thread Communication([&]()
+    {
+        try
+        {
+            for (unsigned int uKBlock = 0; uKBlock < uKBlocks; uKBlock++)
+            {
+                {
+                    std::unique_lock<std::mutex> Guard(Lock);
+                    Changed.wait(Guard, [&]() { return(uKBlock < uMultiplied + 2); });
+                }
+
+                BroadcastPanels(A, B, uKBlock, PanelsFor(uKBlock));
+
+                std::lock_guard<std::mutex> Guard(Lock);
+                uBroadcast++;
+                Changed.notify_all();
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            pError = std::current_exception();
+            Changed.notify_all();
+        }
+    });
+
+    try
+    {
+        for (unsigned int uKBlock = 0; uKBlock < uKBlocks; uKBlock++)
+        {
+            {
+                std::unique_lock<std::mutex> Guard(Lock);
+                Changed.wait(Guard, [&]() { return(uBroadcast > uKBlock || pError); });
+
+                if (pError)
+                {
+                    break;
+                }
+            }
+
+            CPanels & Panels = PanelsFor(uKBlock);
+            m_Local.MultiplyAccumulate(Panels.A, Panels.B);
+
+            std::lock_guard<std::mutex> Guard(Lock);
+            uMultiplied++;
+            Changed.notify_all();
+        }
+    }
+    catch (...)
+    {
+        // The other ranks still expect our part of the broadcasts, so the
+        // communication thread is let run to the end.
+
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            uMultiplied = uKBlocks;
+            Changed.notify_all();
+        }
+
+        Communication.join();
+        throw;
+    }
+
+    Communication.join();
+
+    if (pError)
+    {
+        std::rethrow_exception(pError);
+    }
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+#include "CKernelTuning.h"
+#include <algorithm>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// How the elements of a buffer are laid out. Row major keeps the rows one
+// after the other, column major the columns, as in Fortran and LAPACK. The
+// leading dimension is the distance between consecutive rows or columns.
+// ---------------------------------------------------------------------------
+
+enum EMatrixLayout
+{
+    LayoutRowMajor,
+    LayoutColumnMajor
+};
+
+// ---------------------------------------------------------------------------
+// Whether an operand of Gemm is used as it is or transposed.
+// ---------------------------------------------------------------------------
+
+enum ETranspose
+{
+    TransposeNo,
+    TransposeYes
+};
+
+// ---------------------------------------------------------------------------
+// Cache blocked matrix multiply kernel working on row-major element buffers.
+// The leading dimension of a buffer is the distance, in elements, between the
+// start of two consecutive rows. This lets the kernel work directly on a
+// block that is part of a larger matrix without copying it out first.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CGemmKernel
+{
+public:
+    // ---------------------------------------------------------------------------
+    // C += A * B where A is uM * uK, B is uK * uN and C is uM * uN in size.
+
+    static void MultiplyAdd(unsigned int uM, unsigned int uN, unsigned int uK,
+                            const T * pA, unsigned int uLda,
+                            const T * pB, unsigned int uLdb,
+                            T * pC, unsigned int uLdc);
+
+    // ---------------------------------------------------------------------------
+    // y = A * x where A is uM * uK, x has uK elements and y has uM elements.
+
+    static void MultiplyVector(unsigned int uM, unsigned int uK,
+                               const T * pA, unsigned int uLda,
+                               const T * pX, T * pY);
+
+    // ---------------------------------------------------------------------------
+    // y += a * x where x and y have uN elements.
+
+    static void MultiplyAddRow(unsigned int uN, T a, const T * pX, T * pY);
+
+    // ---------------------------------------------------------------------------
+    // C += X * Y where X is uM * uK, Y is uK * uN and uK is small, a rank uK
+    // update of C. With uK == 1 this is the outer product update of BLAS GER.
+    // Each row of C takes uK row updates, without the blocking of MultiplyAdd
+    // that only pays off for a large uK.
+
+    static void RankUpdate(unsigned int uM, unsigned int uN, unsigned int uK,
+                           const T * pX, unsigned int uLdx,
+                           const T * pY, unsigned int uLdy,
+                           T * pC, unsigned int uLdc);
+
+    // ---------------------------------------------------------------------------
+    // C += A * transpose(A) where A is n * uK and C is n * n, as BLAS SYRK.
+    // Only the lower triangle elements of rows uBegin to uEnd are computed,
+    // each one is added to its mirror element as well. A full update, which
+    // may be split over several calls, takes half the multiply-adds.
+
+    static void SymmetricRankUpdate(unsigned int uK,
+                                    const T * pA, unsigned int uLda,
+                                    T * pC, unsigned int uLdc,
+                                    unsigned int uBegin, unsigned int uEnd);
+
+    // ---------------------------------------------------------------------------
+    // The same with explicit block sizes and inner loop instead of the ones
+    // in CKernelTuning, as used when they are being measured.
+
+    static void MultiplyAdd(unsigned int uM, unsigned int uN, unsigned int uK,
+                            const T * pA, unsigned int uLda,
+                            const T * pB, unsigned int uLdb,
+                            T * pC, unsigned int uLdc,
+                            const CKernelParameters & Params);
+
+    // ---------------------------------------------------------------------------
+    // C = Alpha * op(A) * op(B) + Beta * C, as BLAS GEMM, where op(A) is
+    // uM * uK, op(B) is uK * uN and C is uM * uN. op(X) is X or its transpose
+    // as eTransA and eTransB say, and all three buffers use eLayout. A Beta
+    // of zero overwrites C without reading it.
+
+    static void Gemm(EMatrixLayout eLayout, ETranspose eTransA, ETranspose eTransB,
+                     unsigned int uM, unsigned int uN, unsigned int uK, T Alpha,
+                     const T * pA, unsigned int uLda,
+                     const T * pB, unsigned int uLdb,
+                     T Beta, T * pC, unsigned int uLdc);
+
+private:
+    static void PackA(ETranspose eTrans, const T * pA, unsigned int uLda, unsigned int uRow0, unsigned int uDot0,
+                      unsigned int uRows, unsigned int uDots, T Alpha, T * pPacked);
+    static void PackB(ETranspose eTrans, const T * pB, unsigned int uLdb, unsigned int uDot0, unsigned int uCol0,
+                      unsigned int uDots, unsigned int uCols, T * pPacked);
+};
+
+template <class T>
+void CGemmKernel<T>::MultiplyAdd(unsigned int uM, unsigned int uN, unsigned int uK,
+                                 const T * pA, unsigned int uLda,
+                                 const T * pB, unsigned int uLdb,
+                                 T * pC, unsigned int uLdc)
+{
+    MultiplyAdd(uM, uN, uK, pA, uLda, pB, uLdb, pC, uLdc, CKernelTuning::Parameters<T>());
+}
+
+// ---------------------------------------------------------------------------
+// Block sizes are chosen so that a uBlockK * uBlockN slice of B stays in the
+// L2 cache while the rows of A and C stream through it.
+//
+// The loops are ordered i-k-j so that the innermost loop walks one row of B
+// and one row of C with unit stride. The compiler can vectorize that loop
+// as there is no dependency between its iterations. The four row variant
+// updates four rows of C with each element of B it loads, which cuts the
+// loads of B by four at the cost of more registers.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CGemmKernel<T>::MultiplyAdd(unsigned int uM, unsigned int uN, unsigned int uK,
+                                 const T * pA, unsigned int uLda,
+                                 const T * pB, unsigned int uLdb,
+                                 T * pC, unsigned int uLdc,
+                                 const CKernelParameters & Params)
+{
+    const unsigned int uBlockM = Params.uBlockM;
+    const unsigned int uBlockN = Params.uBlockN;
+    const unsigned int uBlockK = Params.uBlockK;
+
+    for (unsigned int uRow0 = 0; uRow0 < uM; uRow0 += uBlockM)
+    {
+        unsigned int uRowEnd = (uRow0 + uBlockM < uM) ? uRow0 + uBlockM : uM;
+
+        for (unsigned int uDot0 = 0; uDot0 < uK; uDot0 += uBlockK)
+        {
+            unsigned int uDotEnd = (uDot0 + uBlockK < uK) ? uDot0 + uBlockK : uK;
+
+            for (unsigned int uCol0 = 0; uCol0 < uN; uCol0 += uBlockN)
+            {
+                unsigned int uColCount = (uCol0 + uBlockN < uN) ? uBlockN : uN - uCol0;
+                unsigned int uRow = uRow0;
+
+                if (Params.eGemmVariant == GemmFourRows)
+                {
+                    for (; uRow + 4 <= uRowEnd; uRow += 4)
+                    {
+                        T * pCRow0 = &pC[(size_t)uRow * uLdc + uCol0];
+                        T * pCRow1 = pCRow0 + uLdc;
+                        T * pCRow2 = pCRow1 + uLdc;
+                        T * pCRow3 = pCRow2 + uLdc;
+
+                        for (unsigned int uDot = uDot0; uDot < uDotEnd; uDot++)
+                        {
+                            const T a0 = pA[(size_t)uRow * uLda + uDot];
+                            const T a1 = pA[(size_t)(uRow + 1) * uLda + uDot];
+                            const T a2 = pA[(size_t)(uRow + 2) * uLda + uDot];
+                            const T a3 = pA[(size_t)(uRow + 3) * uLda + uDot];
+                            const T * pBRow = &pB[(size_t)uDot * uLdb + uCol0];
+
+                            for (unsigned int uCol = 0; uCol < uColCount; uCol++)
+                            {
+                                const T b = pBRow[uCol];
+
+                                pCRow0[uCol] += a0 * b;
+                                pCRow1[uCol] += a1 * b;
+                                pCRow2[uCol] += a2 * b;
+                                pCRow3[uCol] += a3 * b;
+                            }
+                        }
+                    }
+                }
+
+                for (; uRow < uRowEnd; uRow++)
+                {
+                    T * pCRow = &pC[(size_t)uRow * uLdc + uCol0];
+
+                    for (unsigned int uDot = uDot0; uDot < uDotEnd; uDot++)
+                    {
+                        const T a = pA[(size_t)uRow * uLda + uDot];
+                        const T * pBRow = &pB[(size_t)uDot * uLdb + uCol0];
+
+                        for (unsigned int uCol = 0; uCol < uColCount; uCol++)
+                        {
+                            pCRow[uCol] += a * pBRow[uCol];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Each row is a dot product with x. Four independent partial sums break the
+// dependency chain of a single accumulator so several multiply-adds can be
+// in flight at once.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CGemmKernel<T>::MultiplyVector(unsigned int uM, unsigned int uK,
+                                    const T * pA, unsigned int uLda,
+                                    const T * pX, T * pY)
+{
+    for (unsigned int uRow = 0; uRow < uM; uRow++)
+    {
+        const T * pARow = &pA[(size_t)uRow * uLda];
+        T Sum0 = T();
+        T Sum1 = T();
+        T Sum2 = T();
+        T Sum3 = T();
+        unsigned int uDot = 0;
+
+        for (; uDot + 4 <= uK; uDot += 4)
+        {
+            Sum0 += pARow[uDot] * pX[uDot];
+            Sum1 += pARow[uDot + 1] * pX[uDot + 1];
+            Sum2 += pARow[uDot + 2] * pX[uDot + 2];
+            Sum3 += pARow[uDot + 3] * pX[uDot + 3];
+        }
+
+        for (; uDot < uK; uDot++)
+        {
+            Sum0 += pARow[uDot] * pX[uDot];
+        }
+
+        pY[uRow] = (Sum0 + Sum1) + (Sum2 + Sum3);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CGemmKernel<T>::MultiplyAddRow(unsigned int uN, T a, const T * pX, T * pY)
+{
+    for (unsigned int uIdx = 0; uIdx < uN; uIdx++)
+    {
+        pY[uIdx] += a * pX[uIdx];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CGemmKernel<T>::RankUpdate(unsigned int uM, unsigned int uN, unsigned int uK,
+                                const T * pX, unsigned int uLdx,
+                                const T * pY, unsigned int uLdy,
+                                T * pC, unsigned int uLdc)
+{
+    for (unsigned int uRow = 0; uRow < uM; uRow++)
+    {
+        const T * pXRow = &pX[(size_t)uRow * uLdx];
+        T * pCRow = &pC[(size_t)uRow * uLdc];
+
+        for (unsigned int uDot = 0; uDot < uK; uDot++)
+        {
+            MultiplyAddRow(uN, pXRow[uDot], &pY[(size_t)uDot * uLdy], pCRow);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Element (i, j) of A * transpose(A) is the dot product of rows i and j of
+// A, so both operands are read along their rows. Elements (i, j) and (j, i)
+// with j <= i are only written by the call that covers row i, so calls
+// for separate row ranges can run in parallel.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CGemmKernel<T>::SymmetricRankUpdate(unsigned int uK,
+                                         const T * pA, unsigned int uLda,
+                                         T * pC, unsigned int uLdc,
+                                         unsigned int uBegin, unsigned int uEnd)
+{
+    for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+    {
+        const T * pARow = &pA[(size_t)uRow * uLda];
+
+        for (unsigned int uCol = 0; uCol <= uRow; uCol++)
+        {
+            const T * pAOther = &pA[(size_t)uCol * uLda];
+            T Sum0 = T();
+            T Sum1 = T();
+            unsigned int uDot = 0;
+
+            for (; uDot + 2 <= uK; uDot += 2)
+            {
+                Sum0 += pARow[uDot] * pAOther[uDot];
+                Sum1 += pARow[uDot + 1] * pAOther[uDot + 1];
+            }
+
+            for (; uDot < uK; uDot++)
+            {
+                Sum0 += pARow[uDot] * pAOther[uDot];
+            }
+
+            pC[(size_t)uRow * uLdc + uCol] += Sum0 + Sum1;
+
+            if (uCol != uRow)
+            {
+                pC[(size_t)uCol * uLdc + uRow] += Sum0 + Sum1;
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// A column major matrix read row by row is its transpose, so a column major
+// C = op(A) * op(B) is the row major C' = op(B)' * op(A)', the same call
+// with the operands and their sizes swapped.
+//
+// In row major the operands are copied block by block into row major
+// buffers, transposing on the way where asked, and Alpha is folded into the
+// copy of A. The blocked kernel then always sees plain row major blocks that
+// fit its cache blocking, and no transposed matrix is ever built in full.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CGemmKernel<T>::Gemm(EMatrixLayout eLayout, ETranspose eTransA, ETranspose eTransB,
+                          unsigned int uM, unsigned int uN, unsigned int uK, T Alpha,
+                          const T * pA, unsigned int uLda,
+                          const T * pB, unsigned int uLdb,
+                          T Beta, T * pC, unsigned int uLdc)
+{
+    if (eLayout == LayoutColumnMajor)
+    {
+        Gemm(LayoutRowMajor, eTransB, eTransA, uN, uM, uK, Alpha, pB, uLdb, pA, uLda, Beta, pC, uLdc);
+        return;
+    }
+
+    if (Beta != T(1))
+    {
+        for (unsigned int uRow = 0; uRow < uM; uRow++)
+        {
+            T * pCRow = &pC[(size_t)uRow * uLdc];
+
+            for (unsigned int uCol = 0; uCol < uN; uCol++)
+            {
+                pCRow[uCol] = (Beta == T()) ? T() : Beta * pCRow[uCol];
+            }
+        }
+    }
+
+    if (Alpha == T() || uK == 0)
+    {
+        return;
+    }
+
+    const CKernelParameters & Params = CKernelTuning::Parameters<T>();
+    const unsigned int uBlockM = Params.uBlockM;
+    const unsigned int uBlockN = Params.uBlockN;
+    const unsigned int uBlockK = Params.uBlockK;
+
+    std::vector<T> PackedA((size_t)uBlockM * uBlockK);
+    std::vector<T> PackedB((size_t)uBlockK * uBlockN);
+
+    for (unsigned int uCol0 = 0; uCol0 < uN; uCol0 += uBlockN)
+    {
+        unsigned int uCols = (uCol0 + uBlockN < uN) ? uBlockN : uN - uCol0;
+
+        for (unsigned int uDot0 = 0; uDot0 < uK; uDot0 += uBlockK)
+        {
+            unsigned int uDots = (uDot0 + uBlockK < uK) ? uBlockK : uK - uDot0;
+
+            PackB(eTransB, pB, uLdb, uDot0, uCol0, uDots, uCols, PackedB.data());
+
+            for (unsigned int uRow0 = 0; uRow0 < uM; uRow0 += uBlockM)
+            {
+                unsigned int uRows = (uRow0 + uBlockM < uM) ? uBlockM : uM - uRow0;
+
+                PackA(eTransA, pA, uLda, uRow0, uDot0, uRows, uDots, Alpha, PackedA.data());
+                MultiplyAdd(uRows, uCols, uDots, PackedA.data(), uDots, PackedB.data(), uCols,
+                            &pC[(size_t)uRow0 * uLdc + uCol0], uLdc, Params);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// The transposing copies walk the source along its rows and write the
+// block with a stride, since the source is the larger of the two.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CGemmKernel<T>::PackA(ETranspose eTrans, const T * pA, unsigned int uLda, unsigned int uRow0, unsigned int uDot0,
+                           unsigned int uRows, unsigned int uDots, T Alpha, T * pPacked)
+{
+    if (eTrans == TransposeNo)
+    {
+        for (unsigned int uRow = 0; uRow < uRows; uRow++)
+        {
+            const T * pSource = &pA[(size_t)(uRow0 + uRow) * uLda + uDot0];
+
+            for (unsigned int uDot = 0; uDot < uDots; uDot++)
+            {
+                pPacked[(size_t)uRow * uDots + uDot] = Alpha * pSource[uDot];
+            }
+        }
+    }
+    else
+    {
+        for (unsigned int uDot = 0; uDot < uDots; uDot++)
+        {
+            const T * pSource = &pA[(size_t)(uDot0 + uDot) * uLda + uRow0];
+
+            for (unsigned int uRow = 0; uRow < uRows; uRow++)
+            {
+                pPacked[(size_t)uRow * uDots + uDot] = Alpha * pSource[uRow];
+            }
+        }
+    }
+}
+
+template <class T>
+void CGemmKernel<T>::PackB(ETranspose eTrans, const T * pB, unsigned int uLdb, unsigned int uDot0, unsigned int uCol0,
+                           unsigned int uDots, unsigned int uCols, T * pPacked)
+{
+    if (eTrans == TransposeNo)
+    {
+        for (unsigned int uDot = 0; uDot < uDots; uDot++)
+        {
+            const T * pSource = &pB[(size_t)(uDot0 + uDot) * uLdb + uCol0];
+
+            std::copy(pSource, pSource + uCols, &pPacked[(size_t)uDot * uCols]);
+        }
+    }
+    else
+    {
+        for (unsigned int uCol = 0; uCol < uCols; uCol++)
+        {
+            const T * pSource = &pB[(size_t)(uCol0 + uCol) * uLdb + uDot0];
+
+            for (unsigned int uDot = 0; uDot < uDots; uDot++)
+            {
+                pPacked[(size_t)uDot * uCols + uCol] = pSource[uDot];
+            }
+        }
+    }
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include "CGemmKernel.h"
+#include "CKernelTuning.h"
+#include "CMatrix.h"
+#include "CStopwatch.h"
+#include "CThreadPool.h"
+#include <stdio.h>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Measures the kernel parameters of element type T on this host.
+//
+// The search is one parameter at a time: the multiply kernel variant, then
+// the K, N and M block sizes, each time keeping the fastest value found so
+// far. The transpose tile is chosen the same way. The parallel thresholds
+// are the smallest amounts of work for which the pool beat the calling
+// thread on its own.
+//
+// Tuning takes a few seconds per type and changes the parameters in
+// CKernelTuning as it goes, so nothing else may use matrices of type T
+// while it runs. It only runs when asked to; save the result with
+// CKernelTuning::Save so later runs start with it.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CKernelTuner
+{
+public:
+    // ---------------------------------------------------------------------------
+    // Makes the fastest parameters found the current ones for T and returns
+    // them. Progress is written to pLog unless it is NULL.
+
+    static CKernelParameters Tune(FILE * pLog = NULL);
+
+    // ---------------------------------------------------------------------------
+    // The parallel threshold of a kernel probed at the increasing amounts of
+    // work in Work. PoolWins(uProbe) times probe uProbe and tells whether the
+    // pool beat the calling thread. The threshold is the first amount where
+    // it did, or just past the largest amount when it never did. pszKernel
+    // names the kernel in the log.
+
+    template <class F>
+    static unsigned long long Threshold(const std::vector<unsigned long long> & Work, F PoolWins, const char * pszKernel, FILE * pLog);
+
+private:
+    // The multiply is measured on an M * K by K * N product, large enough
+    // for the largest block candidates to matter.
+
+    enum { GEMM_M = 192, GEMM_N = 1024, GEMM_K = 512, TRANSPOSE_SIZE = 2048 };
+
+    template <class F>
+    static double BestSeconds(F Run);
+
+    static void TuneGemm(CKernelParameters & Params, FILE * pLog);
+    static void TuneTranspose(CKernelParameters & Params, FILE * pLog);
+    static void TuneThresholds(CKernelParameters & Params, FILE * pLog);
+    static CMatrix<T> MakeMatrix(unsigned int uRows, unsigned int uCols);
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CKernelParameters CKernelTuner<T>::Tune(FILE * pLog)
+{
+    CKernelParameters & Params = CKernelTuning::Parameters<T>();
+
+    Params = CKernelParameters::Defaults();
+
+    TuneGemm(Params, pLog);
+    TuneTranspose(Params, pLog);
+    TuneThresholds(Params, pLog);
+
+    return(Params);
+}
+
+// ---------------------------------------------------------------------------
+// The best of a few runs after a warm up run, which filters out most of the
+// noise from other processes.
+// ---------------------------------------------------------------------------
+
+template <class T>
+template <class F>
+double CKernelTuner<T>::BestSeconds(F Run)
+{
+    CStopwatch stopWatch;
+    double dBest = 0.0;
+    double dTotal = 0.0;
+
+    Run();
+
+    for (int nRun = 0; nRun < 5 && dTotal < 0.25; nRun++)
+    {
+        stopWatch.Start();
+        Run();
+
+        double dSeconds = stopWatch.Stop();
+
+        dBest = (nRun == 0 || dSeconds < dBest) ? dSeconds : dBest;
+        dTotal += dSeconds;
+    }
+
+    return(dBest);
+}
+
+template <class T>
+CMatrix<T> CKernelTuner<T>::MakeMatrix(unsigned int uRows, unsigned int uCols)
+{
+    std::vector<T> Data((size_t)uRows * uCols);
+
+    for (size_t uIdx = 0; uIdx < Data.size(); uIdx++)
+    {
+        Data[uIdx] = (T)(uIdx % 7) - (T)3;
+    }
+
+    return(CMatrix<T>(uRows, uCols, Data.data()));
+}
+
+// ---------------------------------------------------------------------------
+// The multiply kernel is timed on its own, on one thread, as the block sizes
+// are about the caches of a single core.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CKernelTuner<T>::TuneGemm(CKernelParameters & Params, FILE * pLog)
+{
+    std::vector<T> A((size_t)GEMM_M * GEMM_K, (T)1);
+    std::vector<T> B((size_t)GEMM_K * GEMM_N, (T)1);
+    std::vector<T> C((size_t)GEMM_M * GEMM_N, (T)0);
+
+    const unsigned int Variants[] = { GemmSingleRow, GemmFourRows };
+    const unsigned int BlocksK[] = { 64, 128, 256, 512 };
+    const unsigned int BlocksN[] = { 128, 256, 512, 1024 };
+    const unsigned int BlocksM[] = { 16, 32, 64, 128 };
+
+    struct CSearch
+    {
+        const char * pszName;
+        const unsigned int * pCandidates;
+        unsigned int uNumCandidates;
+    };
+
+    const CSearch Searches[] =
+    {
+        { "gemm variant", Variants, sizeof(Variants) / sizeof(Variants[0]) },
+        { "block k", BlocksK, sizeof(BlocksK) / sizeof(BlocksK[0]) },
+        { "block n", BlocksN, sizeof(BlocksN) / sizeof(BlocksN[0]) },
+        { "block m", BlocksM, sizeof(BlocksM) / sizeof(BlocksM[0]) },
+    };
+
+    for (unsigned int uSearch = 0; uSearch < sizeof(Searches) / sizeof(Searches[0]); uSearch++)
+    {
+        const CSearch & Search = Searches[uSearch];
+        CKernelParameters Best = Params;
+        double dBestSeconds = 0.0;
+
+        for (unsigned int uIdx = 0; uIdx < Search.uNumCandidates; uIdx++)
+        {
+            CKernelParameters Candidate = Params;
+            unsigned int uValue = Search.pCandidates[uIdx];
+
+            switch (uSearch)
+            {
+            case 0: Candidate.eGemmVariant = (EGemmVariant)uValue; break;
+            case 1: Candidate.uBlockK = uValue; break;
+            case 2: Candidate.uBlockN = uValue; break;
+            default: Candidate.uBlockM = uValue; break;
+            }
+
+            double dSeconds = BestSeconds([&]()
+            {
+                CGemmKernel<T>::MultiplyAdd(GEMM_M, GEMM_N, GEMM_K, A.data(), GEMM_K, B.data(), GEMM_N, C.data(), GEMM_N, Candidate);
+            });
+
+            if (pLog)
+            {
+                fprintf(pLog, "  %-14s %6u %10.2f GOP/s\n", Search.pszName, uValue, 2.0 * GEMM_M * GEMM_N * GEMM_K / dSeconds / 1e9);
+            }
+
+            if (uIdx == 0 || dSeconds < dBestSeconds)
+            {
+                Best = Candidate;
+                dBestSeconds = dSeconds;
+            }
+        }
+
+        Params = Best;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CKernelTuner<T>::TuneTranspose(CKernelParameters & Params, FILE * pLog)
+{
+    const unsigned int Tiles[] = { 8, 16, 32, 64, 128 };
+    CMatrix<T> m = MakeMatrix(TRANSPOSE_SIZE, TRANSPOSE_SIZE);
+    unsigned int uBestTile = Params.uTransposeTile;
+    double dBestSeconds = 0.0;
+
+    for (unsigned int uIdx = 0; uIdx < sizeof(Tiles) / sizeof(Tiles[0]); uIdx++)
+    {
+        Params.uTransposeTile = Tiles[uIdx];
+
+        double dSeconds = BestSeconds([&]() { CMatrix<T> Transposed = m.Transpose(); });
+
+        if (pLog)
+        {
+            fprintf(pLog, "  %-14s %6u %10.2f GB/s\n", "transpose tile", Tiles[uIdx],
+                    2.0 * TRANSPOSE_SIZE * TRANSPOSE_SIZE * sizeof(T) / dSeconds / 1e9);
+        }
+
+        if (uIdx == 0 || dSeconds < dBestSeconds)
+        {
+            uBestTile = Tiles[uIdx];
+            dBestSeconds = dSeconds;
+        }
+    }
+
+    Params.uTransposeTile = uBestTile;
+}
+
+// ---------------------------------------------------------------------------
+// No crossover within the probed sizes more likely means a busy or noisy
+// run than a host where threads never pay off. The threshold is saved with
+// the profile, so rather than turning the parallel kernels off for good it
+// is set just past the largest amount that was probed: that one stays on
+// the calling thread, anything larger goes to the pool.
+// ---------------------------------------------------------------------------
+
+template <class T>
+template <class F>
+unsigned long long CKernelTuner<T>::Threshold(const std::vector<unsigned long long> & Work, F PoolWins, const char * pszKernel, FILE * pLog)
+{
+    for (size_t uProbe = 0; uProbe < Work.size(); uProbe++)
+    {
+        if (PoolWins(uProbe))
+        {
+            return(Work[uProbe]);
+        }
+    }
+
+    if (pLog)
+    {
+        fprintf(pLog, "  no crossover found for %s, using the largest probed size\n", pszKernel);
+    }
+
+    return(Work.empty() ? ~0ULL : Work.back() + 1);
+}
+
+// ---------------------------------------------------------------------------
+// Each size is timed once forced onto the calling thread and once forced
+// onto the pool, see Threshold. With a single worker there is nothing to
+// measure.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CKernelTuner<T>::TuneThresholds(CKernelParameters & Params, FILE * pLog)
+{
+    const unsigned long long ullSerial = ~0ULL;
+    const double dMargin = 0.9;
+
+    if (CThreadPool::Instance().NumWorkers() <= 1)
+    {
+        if (pLog)
+        {
+            fprintf(pLog, "  single worker, parallel thresholds left at their defaults\n");
+        }
+
+        return;
+    }
+
+    // Element wise kernels on 256 column matrices of 16 up to 16K rows
+
+    std::vector<unsigned long long> Elements;
+
+    for (unsigned int uRows = 16; uRows <= 16 * 1024; uRows *= 2)
+    {
+        Elements.push_back((unsigned long long)uRows * 256);
+    }
+
+    unsigned long long ullElements = Threshold(Elements, [&](size_t uProbe)
+    {
+        const unsigned int uRows = (unsigned int)(Elements[uProbe] / 256);
+        CMatrix<T> A = MakeMatrix(uRows, 256);
+        CMatrix<T> B = MakeMatrix(uRows, 256);
+
+        Params.ullParallelElements = ullSerial;
+        double dSerial = BestSeconds([&]() { CMatrix<T> Sum = A + B; });
+
+        Params.ullParallelElements = 0;
+        double dParallel = BestSeconds([&]() { CMatrix<T> Sum = A + B; });
+
+        return(dParallel < dMargin * dSerial);
+    }, "element wise kernels", pLog);
+
+    // Square products growing by half each time, up to 512
+
+    std::vector<unsigned int> Sizes;
+    std::vector<unsigned long long> MultiplyAdds;
+
+    for (unsigned int uSize = 16; uSize <= 512; uSize += uSize / 2)
+    {
+        Sizes.push_back(uSize);
+        MultiplyAdds.push_back((unsigned long long)uSize * uSize * uSize);
+    }
+
+    unsigned long long ullMultiplyAdds = Threshold(MultiplyAdds, [&](size_t uProbe)
+    {
+        CMatrix<T> A = MakeMatrix(Sizes[uProbe], Sizes[uProbe]);
+        CMatrix<T> B = MakeMatrix(Sizes[uProbe], Sizes[uProbe]);
+
+        Params.ullParallelMultiplyAdds = ullSerial;
+        double dSerial = BestSeconds([&]() { CMatrix<T> Product = A * B; });
+
+        Params.ullParallelMultiplyAdds = 0;
+        double dParallel = BestSeconds([&]() { CMatrix<T> Product = A * B; });
+
+        return(dParallel < dMargin * dSerial);
+    }, "the product", pLog);
+
+    Params.ullParallelElements = ullElements;
+    Params.ullParallelMultiplyAdds = ullMultiplyAdds;
+
+    if (pLog)
+    {
+        fprintf(pLog, "  parallel from %llu elements, %llu multiply-adds\n", ullElements, ullMultiplyAdds);
+    }
+}
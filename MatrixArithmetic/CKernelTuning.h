@@ -0,0 +1,464 @@
+#pragma once
+
+#include "CAppException.h"
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// The inner loops CGemmKernel can use for a block of rows of C.
+// ---------------------------------------------------------------------------
+
+enum EGemmVariant
+{
+    GemmSingleRow,      // One row of C at a time
+    GemmFourRows        // Four rows of C share every row of B that is loaded
+};
+
+// ---------------------------------------------------------------------------
+// Block sizes, kernel variants and parallel thresholds for one element type.
+// ---------------------------------------------------------------------------
+
+struct CKernelParameters
+{
+    // CGemmKernel cache blocking and inner loop
+
+    unsigned int uBlockM;
+    unsigned int uBlockN;
+    unsigned int uBlockK;
+    EGemmVariant eGemmVariant;
+
+    // Side of the square tiles CMatrix::Transpose copies
+
+    unsigned int uTransposeTile;
+
+    // Below these amounts of work the kernels run on the calling thread:
+    // elements for element-wise kernels, multiply-adds for the product.
+
+    unsigned long long ullParallelElements;
+    unsigned long long ullParallelMultiplyAdds;
+
+    static CKernelParameters Defaults();
+};
+
+inline CKernelParameters CKernelParameters::Defaults()
+{
+    CKernelParameters Params;
+
+    Params.uBlockM = 64;
+    Params.uBlockN = 256;
+    Params.uBlockK = 128;
+    Params.eGemmVariant = GemmSingleRow;
+    Params.uTransposeTile = 32;
+    Params.ullParallelElements = 64 * 1024;
+    Params.ullParallelMultiplyAdds = 256 * 1024;
+
+    return(Params);
+}
+
+// ---------------------------------------------------------------------------
+// The kernel parameters in use, per element type.
+//
+// Every host starts out with the defaults. CKernelTuner can measure better
+// values for the host, which are saved in a profile file with one section
+// per CPU model:
+//
+//     [Intel(R) Xeon(R) Gold 6230 CPU @ 2.10GHz]
+//     double.block_m = 64
+//     double.gemm_variant = 1
+//     ...
+//
+// The profile is loaded the first time any kernel runs, from the file named
+// by the MATRIX_TUNING_FILE environment variable or else MatrixTuning.cfg in
+// the working directory. Only the section of the current CPU model is used.
+// Nothing is tuned automatically, so a host without a profile simply runs
+// with the defaults.
+//
+// Only the element types with a name in KernelTypeName are kept in the
+// profile. Other types always use the defaults.
+// ---------------------------------------------------------------------------
+
+template <class T> inline const char * KernelTypeName() { return(NULL); }
+template <> inline const char * KernelTypeName<int>() { return("int"); }
+template <> inline const char * KernelTypeName<long long>() { return("long long"); }
+template <> inline const char * KernelTypeName<float>() { return("float"); }
+template <> inline const char * KernelTypeName<double>() { return("double"); }
+
+class CKernelTuning
+{
+public:
+    // ---------------------------------------------------------------------------
+    // The parameters the kernels for element type T use. Changing them while
+    // kernels of that type are running is not safe.
+
+    template <class T>
+    static CKernelParameters & Parameters();
+
+    // ---------------------------------------------------------------------------
+    // Makes the section of the current CPU in strPath the profile and applies
+    // it. Returns false if the file has no such section, in which case
+    // nothing changes.
+
+    static bool Load(const std::string & strPath);
+
+    // ---------------------------------------------------------------------------
+    // Writes the current parameters of every named element type to the
+    // section of the current CPU in strPath. The sections of other CPU
+    // models in the file are kept.
+
+    static void Save(const std::string & strPath);
+
+    static std::string DefaultPath();
+    static std::string CpuModel();
+
+private:
+    struct CState
+    {
+        CState() : bLoaded(false) {}
+
+        std::mutex Lock;
+        bool bLoaded;
+        std::map<std::string, std::string> Profile;
+        std::map<std::string, CKernelParameters *> Types;
+    };
+
+    static CState & State();
+    static void LoadDefault(CState & State);
+    static bool ReadProfile(const std::string & strPath, std::map<std::string, std::string> & Profile);
+    static void Apply(const std::map<std::string, std::string> & Profile, const std::string & strType, CKernelParameters & Params);
+    static std::vector<std::string> ReadLines(const std::string & strPath);
+    static std::string Trim(const std::string & strText);
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CKernelTuning::CState & CKernelTuning::State()
+{
+    static CState Values;
+    return(Values);
+}
+
+// ---------------------------------------------------------------------------
+// The parameters of a type are looked up once, then the kernels read them
+// directly. A later Load updates them through the list of known types.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CKernelParameters & CKernelTuning::Parameters()
+{
+    struct CTypeParameters
+    {
+        CKernelParameters Params;
+
+        CTypeParameters()
+        {
+            Params = CKernelParameters::Defaults();
+
+            if (KernelTypeName<T>() == NULL)
+            {
+                return;
+            }
+
+            CState & Values = State();
+            std::lock_guard<std::mutex> Guard(Values.Lock);
+
+            LoadDefault(Values);
+            Apply(Values.Profile, KernelTypeName<T>(), Params);
+            Values.Types[KernelTypeName<T>()] = &Params;
+        }
+    };
+
+    static CTypeParameters Type;
+    return(Type.Params);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline std::string CKernelTuning::DefaultPath()
+{
+    std::string strPath = "MatrixTuning.cfg";
+
+#ifdef _MSC_VER
+    char * pszValue = NULL;
+    size_t cbValue = 0;
+
+    if (_dupenv_s(&pszValue, &cbValue, "MATRIX_TUNING_FILE") == 0 && pszValue != NULL)
+    {
+        strPath = pszValue;
+        free(pszValue);
+    }
+#else
+    const char * pszValue = getenv("MATRIX_TUNING_FILE");
+
+    if (pszValue != NULL)
+    {
+        strPath = pszValue;
+    }
+#endif
+
+    return(strPath);
+}
+
+// ---------------------------------------------------------------------------
+// The processor brand string on x86, which names the exact model. Elsewhere
+// the model name from /proc/cpuinfo when there is one.
+// ---------------------------------------------------------------------------
+
+inline std::string CKernelTuning::CpuModel()
+{
+    unsigned int Registers[12] = { 0 };
+    bool bHaveBrand = false;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int Info[4];
+    __cpuid(Info, 0x80000000);
+
+    if ((unsigned int)Info[0] >= 0x80000004)
+    {
+        for (int nLeaf = 0; nLeaf < 3; nLeaf++)
+        {
+            __cpuid(reinterpret_cast<int *>(&Registers[nLeaf * 4]), 0x80000002 + nLeaf);
+        }
+
+        bHaveBrand = true;
+    }
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004)
+    {
+        for (unsigned int uLeaf = 0; uLeaf < 3; uLeaf++)
+        {
+            __get_cpuid(0x80000002 + uLeaf, &Registers[uLeaf * 4], &Registers[uLeaf * 4 + 1],
+                        &Registers[uLeaf * 4 + 2], &Registers[uLeaf * 4 + 3]);
+        }
+
+        bHaveBrand = true;
+    }
+#endif
+
+    if (bHaveBrand)
+    {
+        std::string strBrand(reinterpret_cast<const char *>(Registers), sizeof(Registers));
+        return(Trim(strBrand.substr(0, strBrand.find('\0'))));
+    }
+
+#ifndef _WIN32
+    std::vector<std::string> Lines = ReadLines("/proc/cpuinfo");
+
+    for (size_t uIdx = 0; uIdx < Lines.size(); uIdx++)
+    {
+        if (Lines[uIdx].compare(0, 10, "model name") == 0 && Lines[uIdx].find(':') != std::string::npos)
+        {
+            return(Trim(Lines[uIdx].substr(Lines[uIdx].find(':') + 1)));
+        }
+    }
+#endif
+
+    return("Unknown CPU");
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline std::vector<std::string> CKernelTuning::ReadLines(const std::string & strPath)
+{
+    std::vector<std::string> Lines;
+    std::ifstream File(strPath.c_str());
+    std::string strLine;
+
+    while (std::getline(File, strLine))
+    {
+        Lines.push_back(strLine);
+    }
+
+    return(Lines);
+}
+
+inline std::string CKernelTuning::Trim(const std::string & strText)
+{
+    size_t uBegin = strText.find_first_not_of(" \t\r\n");
+    size_t uEnd = strText.find_last_not_of(" \t\r\n");
+
+    return((uBegin == std::string::npos) ? std::string() : strText.substr(uBegin, uEnd - uBegin + 1));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CKernelTuning::LoadDefault(CState & Values)
+{
+    if (!Values.bLoaded)
+    {
+        ReadProfile(DefaultPath(), Values.Profile);
+        Values.bLoaded = true;
+    }
+}
+
+inline bool CKernelTuning::Load(const std::string & strPath)
+{
+    CState & Values = State();
+    std::lock_guard<std::mutex> Guard(Values.Lock);
+    std::map<std::string, std::string> Profile;
+
+    if (!ReadProfile(strPath, Profile))
+    {
+        return(false);
+    }
+
+    Values.Profile.swap(Profile);
+    Values.bLoaded = true;
+
+    for (std::map<std::string, CKernelParameters *>::iterator It = Values.Types.begin(); It != Values.Types.end(); ++It)
+    {
+        *It->second = CKernelParameters::Defaults();
+        Apply(Values.Profile, It->first, *It->second);
+    }
+
+    return(true);
+}
+
+// ---------------------------------------------------------------------------
+// Collects the "name = value" lines of the current CPU's section. Returns
+// false if there is no such section.
+// ---------------------------------------------------------------------------
+
+inline bool CKernelTuning::ReadProfile(const std::string & strPath, std::map<std::string, std::string> & Profile)
+{
+    std::vector<std::string> Lines = ReadLines(strPath);
+    std::string strCpu = CpuModel();
+    bool bInSection = false;
+    bool bFound = false;
+
+    for (size_t uIdx = 0; uIdx < Lines.size(); uIdx++)
+    {
+        std::string strLine = Trim(Lines[uIdx]);
+        size_t uEquals = strLine.find('=');
+
+        if (!strLine.empty() && strLine[0] == '[' && strLine[strLine.size() - 1] == ']')
+        {
+            bInSection = (Trim(strLine.substr(1, strLine.size() - 2)) == strCpu);
+            bFound = bFound || bInSection;
+        }
+        else if (bInSection && uEquals != std::string::npos)
+        {
+            Profile[Trim(strLine.substr(0, uEquals))] = Trim(strLine.substr(uEquals + 1));
+        }
+    }
+
+    return(bFound);
+}
+
+// ---------------------------------------------------------------------------
+// Values that are missing or out of range keep their default.
+// ---------------------------------------------------------------------------
+
+inline void CKernelTuning::Apply(const std::map<std::string, std::string> & Profile, const std::string & strType, CKernelParameters & Params)
+{
+    unsigned long long Values[] =
+    {
+        Params.uBlockM, Params.uBlockN, Params.uBlockK, (unsigned long long)Params.eGemmVariant,
+        Params.uTransposeTile, Params.ullParallelElements, Params.ullParallelMultiplyAdds
+    };
+
+    const char * Names[] =
+    {
+        "block_m", "block_n", "block_k", "gemm_variant",
+        "transpose_tile", "parallel_elements", "parallel_multiply_adds"
+    };
+
+    const unsigned long long Limits[] = { 4096, 4096, 4096, GemmFourRows, 1024, ~0ULL, ~0ULL };
+
+    for (size_t uIdx = 0; uIdx < sizeof(Names) / sizeof(Names[0]); uIdx++)
+    {
+        std::map<std::string, std::string>::const_iterator It = Profile.find(strType + "." + Names[uIdx]);
+
+        if (It != Profile.end())
+        {
+            char * pEnd = NULL;
+            unsigned long long ullValue = strtoull(It->second.c_str(), &pEnd, 10);
+            bool bMinimum = (ullValue >= 1 || uIdx == 3);
+
+            if (pEnd != It->second.c_str() && *pEnd == '\0' && bMinimum && ullValue <= Limits[uIdx])
+            {
+                Values[uIdx] = ullValue;
+            }
+        }
+    }
+
+    Params.uBlockM = (unsigned int)Values[0];
+    Params.uBlockN = (unsigned int)Values[1];
+    Params.uBlockK = (unsigned int)Values[2];
+    Params.eGemmVariant = (EGemmVariant)Values[3];
+    Params.uTransposeTile = (unsigned int)Values[4];
+    Params.ullParallelElements = Values[5];
+    Params.ullParallelMultiplyAdds = Values[6];
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CKernelTuning::Save(const std::string & strPath)
+{
+    CState & Values = State();
+    std::lock_guard<std::mutex> Guard(Values.Lock);
+
+    std::vector<std::string> Lines = ReadLines(strPath);
+    std::string strCpu = CpuModel();
+    std::ofstream File(strPath.c_str(), std::ios::out | std::ios::trunc);
+    bool bInSection = false;
+
+    // Copy everything except the old section of this CPU
+
+    for (size_t uIdx = 0; uIdx < Lines.size(); uIdx++)
+    {
+        std::string strLine = Trim(Lines[uIdx]);
+
+        if (!strLine.empty() && strLine[0] == '[' && strLine[strLine.size() - 1] == ']')
+        {
+            bInSection = (Trim(strLine.substr(1, strLine.size() - 2)) == strCpu);
+        }
+
+        if (!bInSection && !strLine.empty())
+        {
+            File << Lines[uIdx] << "\n";
+        }
+    }
+
+    // Types used in this run replace their entries, the entries of the
+    // other types stay as they were loaded
+
+    for (std::map<std::string, CKernelParameters *>::iterator It = Values.Types.begin(); It != Values.Types.end(); ++It)
+    {
+        const CKernelParameters & Params = *It->second;
+
+        Values.Profile[It->first + ".block_m"] = std::to_string(Params.uBlockM);
+        Values.Profile[It->first + ".block_n"] = std::to_string(Params.uBlockN);
+        Values.Profile[It->first + ".block_k"] = std::to_string(Params.uBlockK);
+        Values.Profile[It->first + ".gemm_variant"] = std::to_string((int)Params.eGemmVariant);
+        Values.Profile[It->first + ".transpose_tile"] = std::to_string(Params.uTransposeTile);
+        Values.Profile[It->first + ".parallel_elements"] = std::to_string(Params.ullParallelElements);
+        Values.Profile[It->first + ".parallel_multiply_adds"] = std::to_string(Params.ullParallelMultiplyAdds);
+    }
+
+    File << "[" << strCpu << "]\n";
+
+    for (std::map<std::string, std::string>::iterator It = Values.Profile.begin(); It != Values.Profile.end(); ++It)
+    {
+        File << It->first << " = " << It->second << "\n";
+    }
+
+    if (!File)
+    {
+        throw CAppException("Cannot write " + strPath);
+    }
+}
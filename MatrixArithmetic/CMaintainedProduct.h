@@ -0,0 +1,296 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CGemmKernel.h"
+#include "CMatrix.h"
+#include <algorithm>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Keeps C = A * B up to date while A and B change, at a cost that follows
+// the size of the change instead of a full product.
+//
+// Changed elements of A mark their row of C as stale, changed elements of
+// B their column. Product() recomputes only the stale rows and columns,
+// each one a vector-matrix product. Low rank updates A += U * V' and
+// B += U * V' are applied to C straight away as another low rank update:
+//
+//     (A + U * V') * B = C + U * (V' * B)
+//     A * (B + U * V') = C + (A * U) * V'
+//
+// which takes O(r * n * (m + k)) for a rank r instead of O(m * n * k).
+// With floating point elements rounding errors of the updates add up over
+// time, Recompute() starts over from a full product.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CMaintainedProduct
+{
+public:
+    CMaintainedProduct(const CMatrix<T> & A, const CMatrix<T> & B);
+
+    inline const CMatrix<T> & MatrixA() const { return(m_A); }
+    inline const CMatrix<T> & MatrixB() const { return(m_B); }
+
+    // ---------------------------------------------------------------------------
+    // A * B, after bringing the stale rows and columns up to date.
+
+    const CMatrix<T> & Product();
+
+    inline unsigned int NumStaleRows() const { return((unsigned int)m_StaleRows.size()); }
+    inline unsigned int NumStaleColumns() const { return((unsigned int)m_StaleColumns.size()); }
+
+    // ---------------------------------------------------------------------------
+    // Element and row changes of A, element and column changes of B. pRow
+    // has A.NumColumns() elements, pColumn has B.NumRows().
+
+    void SetAtA(unsigned int uRow, unsigned int uCol, T Element);
+    void SetRowA(unsigned int uRow, const T * pRow);
+    void SetAtB(unsigned int uRow, unsigned int uCol, T Element);
+    void SetColumnB(unsigned int uCol, const T * pColumn);
+
+    // ---------------------------------------------------------------------------
+    // A += U * V' with U of A.NumRows() * r and V of A.NumColumns() * r, and
+    // B += U * V' with U of B.NumRows() * r and V of B.NumColumns() * r.
+
+    void RankUpdateA(const CMatrix<T> & U, const CMatrix<T> & V);
+    void RankUpdateB(const CMatrix<T> & U, const CMatrix<T> & V);
+
+    // ---------------------------------------------------------------------------
+    // Recomputes the whole product.
+
+    void Recompute();
+
+private:
+    void MarkRow(unsigned int uRow);
+    void MarkColumn(unsigned int uCol);
+    void RefreshRows();
+    void RefreshColumns();
+
+    CMatrix<T> m_A;
+    CMatrix<T> m_B;
+    CMatrix<T> m_C;
+
+    // Stale rows and columns of C, as a list and as a flag per row and
+    // column so that each one is listed once.
+
+    std::vector<unsigned int> m_StaleRows;
+    std::vector<unsigned int> m_StaleColumns;
+    std::vector<unsigned char> m_RowStale;
+    std::vector<unsigned char> m_ColumnStale;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMaintainedProduct<T>::CMaintainedProduct(const CMatrix<T> & A, const CMatrix<T> & B)
+    : m_A(A), m_B(B), m_C(A * B)
+{
+    m_RowStale.assign(A.NumRows(), 0);
+    m_ColumnStale.assign(B.NumColumns(), 0);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMaintainedProduct<T>::MarkRow(unsigned int uRow)
+{
+    if (!m_RowStale[uRow])
+    {
+        m_RowStale[uRow] = 1;
+        m_StaleRows.push_back(uRow);
+    }
+}
+
+template <class T>
+void CMaintainedProduct<T>::MarkColumn(unsigned int uCol)
+{
+    if (!m_ColumnStale[uCol])
+    {
+        m_ColumnStale[uCol] = 1;
+        m_StaleColumns.push_back(uCol);
+    }
+}
+
+template <class T>
+void CMaintainedProduct<T>::SetAtA(unsigned int uRow, unsigned int uCol, T Element)
+{
+    if (uRow >= m_A.m_uRows || uCol >= m_A.m_uColumns)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    m_A.m_pMatrix[(size_t)uRow * m_A.m_uColumns + uCol] = Element;
+    MarkRow(uRow);
+}
+
+template <class T>
+void CMaintainedProduct<T>::SetRowA(unsigned int uRow, const T * pRow)
+{
+    if (uRow >= m_A.m_uRows)
+    {
+        throw CAppException("Row index out of range");
+    }
+
+    std::copy(pRow, pRow + m_A.m_uColumns, m_A.row_ptr(uRow));
+    MarkRow(uRow);
+}
+
+template <class T>
+void CMaintainedProduct<T>::SetAtB(unsigned int uRow, unsigned int uCol, T Element)
+{
+    if (uRow >= m_B.m_uRows || uCol >= m_B.m_uColumns)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    m_B.m_pMatrix[(size_t)uRow * m_B.m_uColumns + uCol] = Element;
+    MarkColumn(uCol);
+}
+
+template <class T>
+void CMaintainedProduct<T>::SetColumnB(unsigned int uCol, const T * pColumn)
+{
+    if (uCol >= m_B.m_uColumns)
+    {
+        throw CAppException("Column index out of range");
+    }
+
+    std::copy(pColumn, pColumn + m_B.m_uRows, m_B.column_begin(uCol));
+    MarkColumn(uCol);
+}
+
+// ---------------------------------------------------------------------------
+// Stale rows of C are left stale by the updates below. They are recomputed
+// from the updated A and B later, so what the update adds to them does not
+// matter, and the rows that are not stale stay exact.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMaintainedProduct<T>::RankUpdateA(const CMatrix<T> & U, const CMatrix<T> & V)
+{
+    m_A.RankUpdate(U, V);
+
+    // W = V' * B, r * n
+
+    const unsigned int uRank = U.m_uColumns;
+    const unsigned int uCols = m_C.m_uColumns;
+    CMatrix<T> W = V.Transpose() * m_B;
+
+    CMatrix<T>::ForEachRowChunk(m_C.m_uRows, (unsigned long long)m_C.m_uRows * uCols * uRank, CMatrix<T>::ParallelMultiplyAdds(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        CGemmKernel<T>::RankUpdate(uEnd - uBegin, uCols, uRank,
+                                   &U.m_pMatrix[(size_t)uBegin * uRank], uRank,
+                                   W.m_pMatrix, uCols,
+                                   &m_C.m_pMatrix[(size_t)uBegin * uCols], uCols);
+    });
+}
+
+template <class T>
+void CMaintainedProduct<T>::RankUpdateB(const CMatrix<T> & U, const CMatrix<T> & V)
+{
+    m_B.RankUpdate(U, V);
+    m_C.RankUpdate(m_A * U, V);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMaintainedProduct<T>::Recompute()
+{
+    CMatrix<T>::MultiplyInto(m_A, m_B, m_C);
+
+    m_StaleRows.clear();
+    m_StaleColumns.clear();
+    m_RowStale.assign(m_RowStale.size(), 0);
+    m_ColumnStale.assign(m_ColumnStale.size(), 0);
+}
+
+// ---------------------------------------------------------------------------
+// Once half the rows or columns are stale recomputing them one by one
+// costs as much as the full product, which has the better kernel.
+// ---------------------------------------------------------------------------
+
+template <class T>
+const CMatrix<T> & CMaintainedProduct<T>::Product()
+{
+    if (m_StaleRows.size() * 2 > m_C.m_uRows || m_StaleColumns.size() * 2 > m_C.m_uColumns)
+    {
+        Recompute();
+    }
+    else
+    {
+        RefreshRows();
+        RefreshColumns();
+    }
+
+    return(m_C);
+}
+
+// ---------------------------------------------------------------------------
+// Each stale row of C is row i of A times B, spread over the workers.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMaintainedProduct<T>::RefreshRows()
+{
+    const unsigned int uK = m_A.m_uColumns;
+    const unsigned int uN = m_B.m_uColumns;
+    const unsigned int uCount = (unsigned int)m_StaleRows.size();
+
+    CMatrix<T>::ForEachRowChunk(uCount, (unsigned long long)uCount * uK * uN, CMatrix<T>::ParallelMultiplyAdds(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uIdx = uBegin; uIdx < uEnd; uIdx++)
+        {
+            T * pRow = m_C.row_ptr(m_StaleRows[uIdx]);
+
+            std::fill(pRow, pRow + uN, T());
+            CGemmKernel<T>::MultiplyAdd(1, uN, uK, m_A.row_ptr(m_StaleRows[uIdx]), uK, m_B.m_pMatrix, uN, pRow, uN);
+        }
+    });
+
+    for (unsigned int uRow : m_StaleRows)
+    {
+        m_RowStale[uRow] = 0;
+    }
+
+    m_StaleRows.clear();
+}
+
+// ---------------------------------------------------------------------------
+// The stale columns of B are gathered into one narrow matrix so that A
+// times all of them is a single product, which is then scattered into C.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMaintainedProduct<T>::RefreshColumns()
+{
+    const unsigned int uCount = (unsigned int)m_StaleColumns.size();
+
+    if (uCount == 0)
+    {
+        return;
+    }
+
+    CMatrix<T> Columns(m_B.m_uRows, uCount, typename CMatrix<T>::CUninitialized());
+
+    for (unsigned int uIdx = 0; uIdx < uCount; uIdx++)
+    {
+        std::copy(m_B.column_begin(m_StaleColumns[uIdx]), m_B.column_end(m_StaleColumns[uIdx]), Columns.column_begin(uIdx));
+    }
+
+    CMatrix<T> Product = m_A * Columns;
+
+    for (unsigned int uIdx = 0; uIdx < uCount; uIdx++)
+    {
+        std::copy(Product.column_begin(uIdx), Product.column_end(uIdx), m_C.column_begin(m_StaleColumns[uIdx]));
+        m_ColumnStale[m_StaleColumns[uIdx]] = 0;
+    }
+
+    m_StaleColumns.clear();
+}
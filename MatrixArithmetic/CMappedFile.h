@@ -0,0 +1,159 @@
+#pragma once
+
+#include "CAppException.h"
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// A whole file mapped read-only into memory. The contents are paged in by
+// the OS as they are read, so several threads can work on different parts
+// of a large file without it being copied into a buffer first. An empty
+// file has a NULL Data().
+// ---------------------------------------------------------------------------
+
+class CMappedFile
+{
+public:
+    CMappedFile(const char * pszPath);
+    ~CMappedFile();
+
+    inline const char * Data() const { return(m_pData); }
+    inline size_t Size() const { return(m_cbSize); }
+
+private:
+    CMappedFile(const CMappedFile &);
+    CMappedFile & operator=(const CMappedFile &);
+
+    const char * m_pData;
+    size_t m_cbSize;
+
+#ifdef _WIN32
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+#endif
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+inline CMappedFile::CMappedFile(const char * pszPath)
+{
+    m_pData = NULL;
+    m_cbSize = 0;
+    m_hMapping = NULL;
+
+    m_hFile = CreateFileA(pszPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        throw CAppException(string("Cannot open ") + pszPath);
+    }
+
+    LARGE_INTEGER Size;
+
+    if (!GetFileSizeEx(m_hFile, &Size))
+    {
+        CloseHandle(m_hFile);
+        throw CAppException(string("Cannot get the size of ") + pszPath);
+    }
+
+    m_cbSize = (size_t)Size.QuadPart;
+
+    if (m_cbSize == 0)
+    {
+        return;
+    }
+
+    m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    m_pData = m_hMapping ? static_cast<const char *>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0)) : NULL;
+
+    if (m_pData == NULL)
+    {
+        if (m_hMapping)
+        {
+            CloseHandle(m_hMapping);
+        }
+
+        CloseHandle(m_hFile);
+        throw CAppException(string("Cannot map ") + pszPath);
+    }
+}
+
+inline CMappedFile::~CMappedFile()
+{
+    if (m_pData)
+    {
+        UnmapViewOfFile(m_pData);
+        CloseHandle(m_hMapping);
+    }
+
+    CloseHandle(m_hFile);
+}
+
+#else
+
+inline CMappedFile::CMappedFile(const char * pszPath)
+{
+    m_pData = NULL;
+    m_cbSize = 0;
+
+    int nFile = open(pszPath, O_RDONLY);
+
+    if (nFile < 0)
+    {
+        throw CAppException(string("Cannot open ") + pszPath);
+    }
+
+    struct stat Status;
+
+    if (fstat(nFile, &Status) != 0)
+    {
+        close(nFile);
+        throw CAppException(string("Cannot get the size of ") + pszPath);
+    }
+
+    m_cbSize = (size_t)Status.st_size;
+
+    if (m_cbSize > 0)
+    {
+        void * pData = mmap(NULL, m_cbSize, PROT_READ, MAP_PRIVATE, nFile, 0);
+
+        if (pData == MAP_FAILED)
+        {
+            close(nFile);
+            throw CAppException(string("Cannot map ") + pszPath);
+        }
+
+        // The parser reads the file front to back, once
+
+        madvise(pData, m_cbSize, MADV_SEQUENTIAL);
+        m_pData = static_cast<const char *>(pData);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+
+    close(nFile);
+}
+
+inline CMappedFile::~CMappedFile()
+{
+    if (m_pData)
+    {
+        munmap(const_cast<char *>(m_pData), m_cbSize);
+    }
+}
+
+#endif
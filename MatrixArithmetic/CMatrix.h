@@ -1,7 +1,49 @@
 #pragma once
 
 #include "CAppException.h"
+#include "CGemmKernel.h"
+#include "CKernelTuning.h"
+#include "CMatrixMemory.h"
+#include "CReduceKernel.h"
+#include "CStrideIterator.h"
+#include "CThreadPool.h"
+#include <algorithm>
 #include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// memcpy_s is only provided by the Microsoft CRT. Other platforms get a
+// minimal version with the same contract so the library can be built and
+// tested on a Linux host as well.
+// ---------------------------------------------------------------------------
+
+#ifndef _MSC_VER
+typedef size_t rsize_t;
+
+inline int memcpy_s(void * pDest, rsize_t DestSize, const void * pSrc, rsize_t Count)
+{
+    if (pDest == NULL || pSrc == NULL || Count > DestSize)
+    {
+        return(-1);
+    }
+
+    memcpy(pDest, pSrc, Count);
+    return(0);
+}
+#endif
+
+template <class T> class CMatrixCsv;
+template <class T> class CDiagonalMatrix;
+template <class T> class CTriangularMatrix;
+template <class T> class CSymmetricMatrix;
+template <class T> class CBandedMatrix;
+template <class T> class CMaintainedProduct;
+class CModularMatrix;
+class CBitMatrix;
 
 // ---------------------------------------------------------------------------
 // ---------------------------------------------------------------------------
@@ -27,8 +69,49 @@ public:
     // ---------------------------------------------------------------------------
     // Retrieve the matrix's width and height
 
-    inline unsigned int NumRows() { return(m_uRows); }
-    inline unsigned int NumColumns() { return(m_uColumns); }
+    inline unsigned int NumRows() const { return(m_uRows); }
+    inline unsigned int NumColumns() const { return(m_uColumns); }
+
+    // ---------------------------------------------------------------------------
+    // Direct access to the storage, row after row with no padding, for the
+    // standard algorithms and hand written kernels. Element (r, c) is at
+    // data()[r * NumColumns() + c]. The pointers stay valid until the matrix
+    // is destroyed or assigned a matrix of another size. The names follow the
+    // standard library so that a CMatrix can be used like a container.
+
+    typedef T value_type;
+    typedef T * iterator;
+    typedef const T * const_iterator;
+    typedef CStrideIterator<T> column_iterator;
+    typedef CStrideIterator<const T> const_column_iterator;
+
+    inline T * data() { return(m_pMatrix); }
+    inline const T * data() const { return(m_pMatrix); }
+    inline size_t size() const { return((size_t)m_uRows * m_uColumns); }
+
+    T * row_ptr(unsigned int uRow);
+    const T * row_ptr(unsigned int uRow) const;
+
+    // ---------------------------------------------------------------------------
+    // All elements in storage order, the elements of one row, and the
+    // elements of one column from the top down.
+
+    inline iterator begin() { return(m_pMatrix); }
+    inline iterator end() { return(m_pMatrix + size()); }
+    inline const_iterator begin() const { return(m_pMatrix); }
+    inline const_iterator end() const { return(m_pMatrix + size()); }
+    inline const_iterator cbegin() const { return(m_pMatrix); }
+    inline const_iterator cend() const { return(m_pMatrix + size()); }
+
+    inline iterator row_begin(unsigned int uRow) { return(row_ptr(uRow)); }
+    inline iterator row_end(unsigned int uRow) { return(row_ptr(uRow) + m_uColumns); }
+    inline const_iterator row_begin(unsigned int uRow) const { return(row_ptr(uRow)); }
+    inline const_iterator row_end(unsigned int uRow) const { return(row_ptr(uRow) + m_uColumns); }
+
+    column_iterator column_begin(unsigned int uCol);
+    column_iterator column_end(unsigned int uCol);
+    const_column_iterator column_begin(unsigned int uCol) const;
+    const_column_iterator column_end(unsigned int uCol) const;
 
     // ---------------------------------------------------------------------------
     // The matrix data is stored as a contiguous memory that can be indexed. This
@@ -69,36 +152,189 @@ public:
     // ---------------------------------------------------------------------------
     // To "transpose" a matrix, swap the rows and columns.
 
-    CMatrix<T> Transpose();
+    CMatrix<T> Transpose() const;
+
+    // ---------------------------------------------------------------------------
+    // Returns a copy of the uNumRows * uNumCols block whose top left corner is
+    // at uRow, uCol.
+
+    CMatrix<T> SubMatrix(unsigned int uRow, unsigned int uCol, unsigned int uNumRows, unsigned int uNumCols) const;
+
+    // ---------------------------------------------------------------------------
+    // Copies the content of Block into this matrix with its top left corner
+    // placed at uRow, uCol.
+
+    void SetSubMatrix(unsigned int uRow, unsigned int uCol, const CMatrix<T> & Block);
+
+    // ---------------------------------------------------------------------------
+    // Adds the product of A * B to this matrix in place. This matrix must be
+    // A.NumRows() * B.NumColumns() in size. No temporary matrices are created.
+
+    void MultiplyAccumulate(const CMatrix<T> & A, const CMatrix<T> & B);
+
+    // ---------------------------------------------------------------------------
+    // this += U * transpose(V) where U is NumRows() * k and V is
+    // NumColumns() * k, for a small k. With single column U and V this is
+    // the rank one update this += u * v'. Takes k multiply-adds per element.
+
+    void RankUpdate(const CMatrix<T> & U, const CMatrix<T> & V);
+
+    // ---------------------------------------------------------------------------
+    // this += A * transpose(A) for a square matrix with as many rows as A.
+    // Half the multiply-adds of the general product since the result is
+    // symmetric.
+
+    void SymmetricRankUpdate(const CMatrix<T> & A);
+
+    // ---------------------------------------------------------------------------
+    // this = Alpha * op(A) * op(B) + Beta * this, where op(X) is X or its
+    // transpose as eTransA and eTransB say. A' * B or A * B' are computed
+    // without calling Transpose() on either operand. Neither A nor B may be
+    // this matrix.
+
+    void Gemm(ETranspose eTransA, const CMatrix<T> & A, ETranspose eTransB, const CMatrix<T> & B, T Alpha, T Beta);
 
     // ---------------------------------------------------------------------------
     // Scalar multiplier. Multiplies each cell with the provided value. Note that
     // this can also be used to create a negative matrix by multiplying with -1
 
-    CMatrix<T> operator*(const int nVal);
+    CMatrix<T> operator*(const int nVal) const;
 
     // ---------------------------------------------------------------------------
     // Matrix to matrix multiplication. The row count of matrix one must be the
-    // same as the column count of matrix two.
-    CMatrix<T> operator*(const CMatrix<T> & Matrix);
+    // same as the column count of matrix two. A second matrix with a single
+    // column is multiplied as a matrix-vector product.
+    CMatrix<T> operator*(const CMatrix<T> & Matrix) const;
 
     // ---------------------------------------------------------------------------
     // Matrix to matrix addition. The two matrices must be the same size, i.e. the
     // rows must match in size, and the columns must match in size
 
-    CMatrix<T> operator+(const CMatrix<T> & Matrix);
+    CMatrix<T> operator+(const CMatrix<T> & Matrix) const;
 
     // ---------------------------------------------------------------------------
     // Matrix to matrix subtraction. The two matrices must be the same size, i.e. the
     // rows must match in size, and the columns must match in size
 
-    CMatrix<T> operator-(const CMatrix<T> & Matrix);
+    CMatrix<T> operator-(const CMatrix<T> & Matrix) const;
 
     // ---------------------------------------------------------------------------
     // Assignment operator is needed for deep copies
     CMatrix<T> & operator=(const CMatrix<T> & Matrix);
 
+    // ---------------------------------------------------------------------------
+    // this ^ uExponent of a square matrix by repeated squaring, which takes
+    // about 2 * log2(uExponent) products instead of uExponent - 1. The power
+    // of 0 is the identity matrix.
+
+    CMatrix<T> Power(unsigned int uExponent) const;
+
+    // ---------------------------------------------------------------------------
+    // The matrix exponential e ^ this of a square matrix, by scaling and
+    // squaring with a [6/6] Pade approximant. Floating point elements only.
+
+    CMatrix<T> Exp() const;
+
+    // ---------------------------------------------------------------------------
+    // Sum of all elements. eMethod selects how floating point elements are
+    // accumulated, see ESummation.
+
+    T Sum(ESummation eMethod = SumPairwise) const;
+
+    // ---------------------------------------------------------------------------
+    // Smallest and largest element. If puRow and puCol are provided they
+    // receive the position of the first such element in row order.
+
+    T Min(unsigned int * puRow = NULL, unsigned int * puCol = NULL) const;
+    T Max(unsigned int * puRow = NULL, unsigned int * puCol = NULL) const;
+
+    // ---------------------------------------------------------------------------
+    // Frobenius norm: the square root of the sum of the squares.
+    // 1 norm: the largest sum of absolute values in a column.
+    // Infinity norm: the largest sum of absolute values in a row.
+
+    double FrobeniusNorm() const;
+    double OneNorm() const;
+    double InfinityNorm() const;
+
+    // ---------------------------------------------------------------------------
+    // Sums and means of each row, returned as a NumRows() * 1 matrix, and of
+    // each column, returned as a 1 * NumColumns() matrix.
+
+    CMatrix<T> RowSums(ESummation eMethod = SumPairwise) const;
+    CMatrix<T> ColumnSums(ESummation eMethod = SumPairwise) const;
+    CMatrix<double> RowMeans(ESummation eMethod = SumPairwise) const;
+    CMatrix<double> ColumnMeans(ESummation eMethod = SumPairwise) const;
+
+    // ---------------------------------------------------------------------------
+    // Apply replaces every element with Function(element). Map leaves this
+    // matrix alone and returns the results in a new matrix whose element
+    // type is whatever Function returns. Function is called concurrently
+    // from several threads for large matrices.
+
+    template <class F>
+    CMatrix<T> & Apply(F Function);
+
+    template <class F>
+    CMatrix<typename std::decay<decltype(std::declval<F>()(std::declval<T>()))>::type> Map(F Function) const;
+
 private:
+    template <class U> friend class CMatrix;
+    friend class CMatrixCsv<T>;
+    friend class CDiagonalMatrix<T>;
+    friend class CTriangularMatrix<T>;
+    friend class CSymmetricMatrix<T>;
+    friend class CBandedMatrix<T>;
+    friend class CMaintainedProduct<T>;
+    friend class CModularMatrix;
+    friend class CBitMatrix;
+
+    // ---------------------------------------------------------------------------
+    // Work smaller than this runs on the calling thread. Element counts for
+    // element wise operations, multiply-adds for products. Both are tunable,
+    // see CKernelTuning.
+
+    static unsigned long long ParallelElements() { return(CKernelTuning::Parameters<T>().ullParallelElements); }
+    static unsigned long long ParallelMultiplyAdds() { return(CKernelTuning::Parameters<T>().ullParallelMultiplyAdds); }
+
+    // ---------------------------------------------------------------------------
+    // Creates a matrix whose elements are left uninitialized, for results that
+    // the kernels overwrite completely. The kernels write the rows in the same
+    // worker chunks that first touch placement uses.
+
+    struct CUninitialized {};
+    CMatrix(unsigned int uRow, unsigned int uCol, CUninitialized);
+
+    // ---------------------------------------------------------------------------
+    // Calls Body(uBegin, uEnd) over the rows of the matrix. Large amounts of
+    // work are split over the thread pool, one row chunk per worker.
+
+    template <class F>
+    static void ForEachRowChunk(unsigned int uRows, unsigned long long ullWork, unsigned long long ullThreshold, F Body);
+
+    // ---------------------------------------------------------------------------
+    // Reduces the matrix one row chunk at a time with Body(uBegin, uEnd) and
+    // folds the chunk results together with Combine, in row order.
+
+    template <class R, class F, class C>
+    R ReduceRowChunks(R Identity, F Body, C Combine) const;
+
+    void ColumnSumRange(unsigned int uBegin, unsigned int uEnd, ESummation eMethod, T * pSum) const;
+
+    // ---------------------------------------------------------------------------
+    // Product = A * B into an existing matrix of the right size, so products
+    // in a loop can reuse the same storage. Product must not be A or B.
+
+    static void MultiplyInto(const CMatrix<T> & A, const CMatrix<T> & B, CMatrix<T> & Product);
+
+    // ---------------------------------------------------------------------------
+    // Solves A * X = B by Gaussian elimination with partial pivoting. Both
+    // matrices are overwritten, B with X.
+
+    static void SolveInPlace(CMatrix<T> & A, CMatrix<T> & B);
+
+    void SetIdentity();
+
     unsigned int m_uRows;
     unsigned int m_uColumns;
     T * m_pMatrix;
@@ -115,22 +351,22 @@ CMatrix<T>::CMatrix(unsigned int uRow, unsigned int uCol, T * pData)
     m_uRows = uRow;
     m_uColumns = uCol;
 
-    // I treat the 2D matrix as one large block of memory
-    m_pMatrix = new T[uNumElements];
+    // I treat the 2D matrix as one large block of memory. Where its pages are
+    // placed on a NUMA host is up to CMatrixMemory.
+    m_pMatrix = CMatrixMemory::Allocate<T>(uNumElements);
 
-    if (pData && uNumElements)
-    {
-        rsize_t Size = uNumElements * sizeof(T);
+    CMatrixMemory::Initialize(m_pMatrix, (pData && uNumElements) ? pData : NULL, uRow, uCol);
+}
 
-        if (memcpy_s(m_pMatrix, Size, pData, uNumElements * sizeof(T)))
-        {
-            throw CAppException("Source data is incorrectly sized");
-        }
-    }
-    else
-    {
-        memset(m_pMatrix, 0, uNumElements * sizeof(T));
-    }
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T>::CMatrix(unsigned int uRow, unsigned int uCol, CUninitialized)
+{
+    m_uRows = uRow;
+    m_uColumns = uCol;
+    m_pMatrix = CMatrixMemory::Allocate<T>((size_t)uRow * uCol);
 }
 
 // ---------------------------------------------------------------------------
@@ -141,24 +377,91 @@ CMatrix<T>::CMatrix(const CMatrix<T> & src)
 {
     m_uRows = src.m_uRows;
     m_uColumns = src.m_uColumns;
-    m_pMatrix = new T[m_uRows * m_uColumns];
+    m_pMatrix = CMatrixMemory::Allocate<T>((size_t)m_uRows * m_uColumns);
+
+    CMatrixMemory::Initialize(m_pMatrix, src.m_pMatrix, m_uRows, m_uColumns);
+}
 
-    rsize_t Size = m_uRows * m_uColumns * sizeof(T);
 
-    if (memcpy_s(m_pMatrix, Size, src.m_pMatrix, Size))
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T>::~CMatrix()
+{
+    CMatrixMemory::Free(m_pMatrix, (size_t)m_uRows * m_uColumns);
+}
+
+// ---------------------------------------------------------------------------
+// Static row partitioning: every call hands the same rows to the same worker,
+// which keeps each worker on the memory it first touched.
+// ---------------------------------------------------------------------------
+
+template <class T>
+template <class F>
+void CMatrix<T>::ForEachRowChunk(unsigned int uRows, unsigned long long ullWork, unsigned long long ullThreshold, F Body)
+{
+    if (ullWork < ullThreshold)
+    {
+        Body(0, uRows);
+    }
+    else
     {
-        throw CAppException("Source data is incorrectly sized");
+        CThreadPool::Instance().ParallelFor(uRows, Body);
     }
 }
 
-
 // ---------------------------------------------------------------------------
+// Like GetAt the row and column accessors are only checked in debug builds,
+// they are meant for loops that have already checked their bounds.
 // ---------------------------------------------------------------------------
 
 template <class T>
-CMatrix<T>::~CMatrix()
+T * CMatrix<T>::row_ptr(unsigned int uRow)
+{
+    assert(uRow < m_uRows);
+
+    return(&m_pMatrix[(size_t)uRow * m_uColumns]);
+}
+
+template <class T>
+const T * CMatrix<T>::row_ptr(unsigned int uRow) const
+{
+    assert(uRow < m_uRows);
+
+    return(&m_pMatrix[(size_t)uRow * m_uColumns]);
+}
+
+template <class T>
+typename CMatrix<T>::column_iterator CMatrix<T>::column_begin(unsigned int uCol)
+{
+    assert(uCol < m_uColumns);
+
+    return(column_iterator(m_pMatrix + uCol, m_uColumns));
+}
+
+template <class T>
+typename CMatrix<T>::column_iterator CMatrix<T>::column_end(unsigned int uCol)
+{
+    assert(uCol < m_uColumns);
+
+    return(column_iterator(m_pMatrix + uCol, m_uColumns, m_uRows));
+}
+
+template <class T>
+typename CMatrix<T>::const_column_iterator CMatrix<T>::column_begin(unsigned int uCol) const
+{
+    assert(uCol < m_uColumns);
+
+    return(const_column_iterator(m_pMatrix + uCol, m_uColumns));
+}
+
+template <class T>
+typename CMatrix<T>::const_column_iterator CMatrix<T>::column_end(unsigned int uCol) const
 {
-    delete[] m_pMatrix;
+    assert(uCol < m_uColumns);
+
+    return(const_column_iterator(m_pMatrix + uCol, m_uColumns, m_uRows));
 }
 
 // ---------------------------------------------------------------------------
@@ -214,19 +517,20 @@ void CMatrix<T>::SetAt(unsigned int uRow, unsigned int uCol, T Element)
 template <class T>
 void CMatrix<T>::GetAllData(unsigned int * puNumElements, T * pBuffer) const
 {
-    unsigned int uSizeNeeded = m_uRows * m_uColumns * sizeof(T);
+    unsigned int uElementsNeeded = m_uRows * m_uColumns;
 
     if (*puNumElements == 0 && pBuffer == NULL)
     {
-        *puNumElements = m_uRows * m_uColumns;
+        *puNumElements = uElementsNeeded;
     }
-    else if (*puNumElements < uSizeNeeded)
+    else if (*puNumElements < uElementsNeeded)
     {
         throw CAppException("Buffer size too small.");
     }
     else
     {
-        memcpy_s(pBuffer, *puNumElements * sizeof(T), m_pMatrix, uSizeNeeded)
+        memcpy_s(pBuffer, *puNumElements * sizeof(T), m_pMatrix, uElementsNeeded * sizeof(T));
+        *puNumElements = uElementsNeeded;
     }
 }
 
@@ -295,180 +599,981 @@ void CMatrix<T>::GetRowData(unsigned int uRowIndex, unsigned int * puNumElements
 // To "transpose" a matrix, swap the rows and columns.
 
 template <class T>
-CMatrix<T> CMatrix<T>::Transpose()
+CMatrix<T> CMatrix<T>::Transpose() const
 {
-    CMatrix<T> result(m_uColumns, m_uRows);
+    const unsigned int uTile = CKernelTuning::Parameters<T>().uTransposeTile;
+    CMatrix<T> result(m_uColumns, m_uRows, CUninitialized());
 
-    for (unsigned int uRowIndex = 0; uRowIndex < m_uRows; uRowIndex++)
+    // Each worker fills a band of rows of the result. Within the band the
+    // copy is done in square tiles so that both the reads and the writes
+    // stay within a few cache lines at a time.
+
+    ForEachRowChunk(m_uColumns, (unsigned long long)m_uRows * m_uColumns, ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
     {
-        for (unsigned int uColIndex = 0; uColIndex < m_uColumns; uColIndex++)
+        for (unsigned int uRow0 = uBegin; uRow0 < uEnd; uRow0 += uTile)
         {
-            T val = GetAt(uRowIndex, uColIndex);
-            result.SetAt(uColIndex, uRowIndex, val);
+            unsigned int uRowEnd = (uRow0 + uTile < uEnd) ? uRow0 + uTile : uEnd;
+
+            for (unsigned int uCol0 = 0; uCol0 < m_uRows; uCol0 += uTile)
+            {
+                unsigned int uColEnd = (uCol0 + uTile < m_uRows) ? uCol0 + uTile : m_uRows;
+
+                for (unsigned int uRow = uRow0; uRow < uRowEnd; uRow++)
+                {
+                    for (unsigned int uCol = uCol0; uCol < uColEnd; uCol++)
+                    {
+                        result.m_pMatrix[(size_t)uRow * m_uRows + uCol] = m_pMatrix[(size_t)uCol * m_uColumns + uRow];
+                    }
+                }
+            }
         }
-    }
+    });
 
     return(result);
 }
 
 // ---------------------------------------------------------------------------
-// Scalar matrix multiplication. This is the simplest where we multiply each
-// matrix element with the provided number.
+// Block copies work one row at a time as each row of the block is a
+// contiguous run of elements in both matrices.
 // ---------------------------------------------------------------------------
 
 template <class T>
-CMatrix<T> CMatrix<T>::operator*(const int nVal)
+CMatrix<T> CMatrix<T>::SubMatrix(unsigned int uRow, unsigned int uCol, unsigned int uNumRows, unsigned int uNumCols) const
 {
-    T * pMatrix = new T[m_uRows * m_uColumns];
-    
-    unsigned int uNumElements = m_uRows * m_uColumns;
+    if (uRow + uNumRows > m_uRows || uCol + uNumCols > m_uColumns)
+    {
+        throw CAppException("Sub matrix out of range");
+    }
+
+    CMatrix<T> Block(uNumRows, uNumCols);
 
-    for (unsigned int uIdx = 0; uIdx < uNumElements; uIdx++)
+    for (unsigned int uRowIndex = 0; uRowIndex < uNumRows; uRowIndex++)
     {
-        pMatrix[uIdx] = m_pMatrix[uIdx] * nVal;
+        memcpy(&Block.m_pMatrix[uRowIndex * uNumCols],
+               &m_pMatrix[(uRow + uRowIndex) * m_uColumns + uCol],
+               uNumCols * sizeof(T));
     }
 
-    return(CMatrix<T>(m_uRows, m_uColumns, pMatrix));
+    return(Block);
 }
 
 // ---------------------------------------------------------------------------
-// Multiply one matrix with another matrix is more complex.
-// The main condition of matrix multiplication is that the number of columns
-// of the 1st matrix must equal to the number of rows of the 2nd one.
-// As a result of multiplication you will get a new matrix that has the same
-// quantity of rows as the 1st one has and the same quantity of columns as
-// the 2nd one.
 // ---------------------------------------------------------------------------
 
 template <class T>
-CMatrix<T> CMatrix<T>::operator*(const CMatrix<T> & Matrix)
+void CMatrix<T>::SetSubMatrix(unsigned int uRow, unsigned int uCol, const CMatrix<T> & Block)
 {
-    // Check for matrix conditions to be valid
+    if (uRow + Block.m_uRows > m_uRows || uCol + Block.m_uColumns > m_uColumns)
+    {
+        throw CAppException("Sub matrix out of range");
+    }
 
-    if (m_uColumns != Matrix.m_uRows)
+    for (unsigned int uRowIndex = 0; uRowIndex < Block.m_uRows; uRowIndex++)
     {
-        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+        memcpy(&m_pMatrix[(uRow + uRowIndex) * m_uColumns + uCol],
+               &Block.m_pMatrix[uRowIndex * Block.m_uColumns],
+               Block.m_uColumns * sizeof(T));
     }
+}
 
-    T * pMatrix1Data = NULL;
-    T * pMatrix2Data = NULL;
-    CMatrix<T> Product(m_uRows, Matrix.m_uColumns);
+// ---------------------------------------------------------------------------
+// this += A * B using the cache blocked kernel. This is the building block of
+// the distributed multiply where every process keeps adding the product of
+// the panels it receives to its own tile of the result.
+// ---------------------------------------------------------------------------
 
-    try
+template <class T>
+void CMatrix<T>::MultiplyAccumulate(const CMatrix<T> & A, const CMatrix<T> & B)
+{
+    if (A.m_uColumns != B.m_uRows)
     {
-        unsigned int uNumElementsMatrix1 = m_uColumns;
-        unsigned int uNumElementsMatrix2 = m_uColumns;
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
 
-        pMatrix1Data = new T[m_uColumns];
-        pMatrix2Data = new T[m_uColumns];
+    if (m_uRows != A.m_uRows || m_uColumns != B.m_uColumns)
+    {
+        throw CAppException("Result matrix is incorrectly sized.");
+    }
 
-        // ---------------------------------------------------------------
-        // And now the matrix multiplication starts.
+    CGemmKernel<T>::MultiplyAdd(A.m_uRows, B.m_uColumns, A.m_uColumns,
+                                A.m_pMatrix, A.m_uColumns,
+                                B.m_pMatrix, B.m_uColumns,
+                                m_pMatrix, m_uColumns);
+}
 
-        for (unsigned int uRowIndex = 0; uRowIndex < m_uRows; uRowIndex++)
-        {
-            GetRowData(uRowIndex, &uNumElementsMatrix1, pMatrix1Data);
-            assert(uNumElementsMatrix1 = m_uColumns);
+// ---------------------------------------------------------------------------
+// V is transposed first so that the update reads both operands along rows.
+// It has only k rows, so the copy is small next to the update itself.
+// ---------------------------------------------------------------------------
 
-            for (unsigned int uMatrix2ColIndex = 0; uMatrix2ColIndex < Matrix.m_uColumns; uMatrix2ColIndex++)
-            {
-                Matrix.GetColumnData(uMatrix2ColIndex, &uNumElementsMatrix2, pMatrix2Data);
-                assert(uNumElementsMatrix1 == uNumElementsMatrix2);
+template <class T>
+void CMatrix<T>::RankUpdate(const CMatrix<T> & U, const CMatrix<T> & V)
+{
+    if (U.m_uRows != m_uRows || V.m_uRows != m_uColumns || U.m_uColumns != V.m_uColumns)
+    {
+        throw CAppException("Update vectors must match the matrix size and each other.");
+    }
 
-                // Now we can start doing the 'Dot Product' with each cell
+    const unsigned int uRank = U.m_uColumns;
+    CMatrix<T> VTransposed = V.Transpose();
 
-                T val = Product.GetAt(uRowIndex, uMatrix2ColIndex);
+    ForEachRowChunk(m_uRows, (unsigned long long)m_uRows * m_uColumns * uRank, ParallelMultiplyAdds(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        CGemmKernel<T>::RankUpdate(uEnd - uBegin, m_uColumns, uRank,
+                                   &U.m_pMatrix[(size_t)uBegin * uRank], uRank,
+                                   VTransposed.m_pMatrix, m_uColumns,
+                                   &m_pMatrix[(size_t)uBegin * m_uColumns], m_uColumns);
+    });
+}
 
-                for (unsigned int uDotIndex = 0; uDotIndex < uNumElementsMatrix1; uDotIndex++)
-                {
-                    val += (pMatrix1Data[uDotIndex] * pMatrix2Data[uDotIndex]);
-                }
+// ---------------------------------------------------------------------------
+// Row i holds i + 1 dot products of the lower triangle, so equal row counts
+// would give the last worker most of the work. The split points are placed
+// at equal shares of the triangle's area instead.
+// ---------------------------------------------------------------------------
 
-                Product.SetAt(uRowIndex, uMatrix2ColIndex, val);
-            }
-        }
+template <class T>
+void CMatrix<T>::SymmetricRankUpdate(const CMatrix<T> & A)
+{
+    if (m_uRows != m_uColumns || A.m_uRows != m_uRows)
+    {
+        throw CAppException("A symmetric rank update needs a square matrix with as many rows as the update.");
     }
-    catch (...)
+
+    const unsigned int uSize = m_uRows;
+    const unsigned int uK = A.m_uColumns;
+    unsigned long long ullWork = (unsigned long long)uSize * (uSize + 1) / 2 * uK;
+
+    if (ullWork < ParallelMultiplyAdds())
     {
-        delete[] pMatrix1Data;
-        delete[] pMatrix2Data;
-        throw;
+        CGemmKernel<T>::SymmetricRankUpdate(uK, A.m_pMatrix, uK, m_pMatrix, uSize, 0, uSize);
+        return;
     }
 
-    delete[] pMatrix1Data;
-    delete[] pMatrix2Data;
+    const unsigned int uNumChunks = CThreadPool::Instance().NumWorkers();
 
-    return(Product);
+    CThreadPool::Instance().ParallelFor(uNumChunks, [&](unsigned int uFirst, unsigned int uLast)
+    {
+        for (unsigned int uChunk = uFirst; uChunk < uLast; uChunk++)
+        {
+            unsigned int uBegin = (unsigned int)(uSize * sqrt((double)uChunk / uNumChunks));
+            unsigned int uEnd = (uChunk + 1 == uNumChunks) ? uSize : (unsigned int)(uSize * sqrt((double)(uChunk + 1) / uNumChunks));
+
+            CGemmKernel<T>::SymmetricRankUpdate(uK, A.m_pMatrix, uK, m_pMatrix, uSize, uBegin, uEnd);
+        }
+    });
 }
 
 // ---------------------------------------------------------------------------
-// Matrix to matrix addition. The two matrices must be the same size, i.e. the
-// rows must match in size, and the columns must match in size
+// The workers each take a band of rows of this matrix. Row i of op(A) is row
+// i of A, or column i when it is transposed, so a band of op(A) starts at
+// row uBegin or at column uBegin of A. Every worker packs its own copy of
+// the blocks of op(B) it needs.
+// ---------------------------------------------------------------------------
 
 template <class T>
-CMatrix<T> CMatrix<T>::operator+(const CMatrix<T> & Matrix)
+void CMatrix<T>::Gemm(ETranspose eTransA, const CMatrix<T> & A, ETranspose eTransB, const CMatrix<T> & B, T Alpha, T Beta)
 {
-    if (m_uRows != Matrix.m_uRows || m_uColumns != Matrix.m_uColumns)
+    const unsigned int uM = (eTransA == TransposeNo) ? A.m_uRows : A.m_uColumns;
+    const unsigned int uK = (eTransA == TransposeNo) ? A.m_uColumns : A.m_uRows;
+    const unsigned int uKB = (eTransB == TransposeNo) ? B.m_uRows : B.m_uColumns;
+    const unsigned int uN = (eTransB == TransposeNo) ? B.m_uColumns : B.m_uRows;
+
+    if (uK != uKB)
     {
-        throw CAppException("Matrixes must be the same size to add them.");
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
     }
 
-    unsigned int uElementCount = m_uRows * m_uColumns;
-    T * pSum = new T[uElementCount];
+    if (m_uRows != uM || m_uColumns != uN)
+    {
+        throw CAppException("Result matrix is incorrectly sized.");
+    }
 
-    for (unsigned int uIndex = 0; uIndex < uElementCount; uIndex++)
+    if (&A == this || &B == this)
     {
-        pSum[uIndex] = m_pMatrix[uIndex] + Matrix.m_pMatrix[uIndex];
+        throw CAppException("The result matrix cannot be one of the operands.");
     }
 
-    CMatrix<T> p(m_uRows, m_uColumns, pSum);
-    delete[] pSum;
+    ForEachRowChunk(uM, (unsigned long long)uM * uN * uK, ParallelMultiplyAdds(), [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        const T * pA = (eTransA == TransposeNo) ? &A.m_pMatrix[(size_t)uBegin * A.m_uColumns] : &A.m_pMatrix[uBegin];
 
-    return(p);
+        CGemmKernel<T>::Gemm(LayoutRowMajor, eTransA, eTransB, uEnd - uBegin, uN, uK, Alpha,
+                             pA, A.m_uColumns, B.m_pMatrix, B.m_uColumns,
+                             Beta, &m_pMatrix[(size_t)uBegin * m_uColumns], m_uColumns);
+    });
 }
 
 // ---------------------------------------------------------------------------
-// Matrix to matrix subtraction. The two matrices must be the same size, i.e. the
-// rows must match in size, and the columns must match in size
+// Scalar matrix multiplication. This is the simplest where we multiply each
+// matrix element with the provided number.
+// ---------------------------------------------------------------------------
 
 template <class T>
-CMatrix<T> CMatrix<T>::operator-(const CMatrix<T> & Matrix)
+CMatrix<T> CMatrix<T>::operator*(const int nVal) const
 {
-    if (m_uRows != Matrix.m_uRows || m_uColumns != Matrix.m_uColumns)
+    CMatrix<T> Product(m_uRows, m_uColumns, CUninitialized());
+    const unsigned int uCols = m_uColumns;
+
+    ForEachRowChunk(m_uRows, (unsigned long long)m_uRows * m_uColumns, ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
     {
-        throw CAppException("Matrixes must be the same size to add them.");
+        for (size_t uIdx = (size_t)uBegin * uCols; uIdx < (size_t)uEnd * uCols; uIdx++)
+        {
+            Product.m_pMatrix[uIdx] = m_pMatrix[uIdx] * nVal;
+        }
+    });
+
+    return(Product);
+}
+
+// ---------------------------------------------------------------------------
+// Multiply one matrix with another matrix is more complex.
+// The main condition of matrix multiplication is that the number of columns
+// of the 1st matrix must equal to the number of rows of the 2nd one.
+// As a result of multiplication you will get a new matrix that has the same
+// quantity of rows as the 1st one has and the same quantity of columns as
+// the 2nd one.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CMatrix<T>::operator*(const CMatrix<T> & Matrix) const
+{
+    // Check for matrix conditions to be valid
+
+    if (m_uColumns != Matrix.m_uRows)
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
     }
 
-    unsigned int uElementCount = m_uRows * m_uColumns;
-    T * pSum = new T[uElementCount];
+    const unsigned int uK = m_uColumns;
+    const unsigned int uN = Matrix.m_uColumns;
+    unsigned long long ullWork = (unsigned long long)m_uRows * uN * uK;
+
+    // ---------------------------------------------------------------
+    // A single column is a matrix-vector product. It is limited by how fast
+    // the rows of this matrix stream in, so every worker takes the rows that
+    // live on its own NUMA node.
 
-    for (unsigned int uIndex = 0; uIndex < uElementCount; uIndex++)
+    if (uN == 1)
     {
-        pSum[uIndex] = m_pMatrix[uIndex] - Matrix.m_pMatrix[uIndex];
+        CMatrix<T> Product(m_uRows, 1, CUninitialized());
+
+        ForEachRowChunk(m_uRows, ullWork, ParallelElements(), [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            CGemmKernel<T>::MultiplyVector(uEnd - uBegin, uK, &m_pMatrix[(size_t)uBegin * uK], uK,
+                                           Matrix.m_pMatrix, &Product.m_pMatrix[uBegin]);
+        });
+
+        return(Product);
     }
 
-    CMatrix<T> p(m_uRows, m_uColumns, pSum);
-    delete[] pSum;
+    CMatrix<T> Product(m_uRows, uN, CUninitialized());
 
-    return(p);
+    MultiplyInto(*this, Matrix, Product);
+
+    return(Product);
 }
 
+// ---------------------------------------------------------------------------
+// Every worker clears and then computes a band of rows of the product with
+// the blocked kernel. All of them read the whole of the 2nd matrix.
 // ---------------------------------------------------------------------------
 
 template <class T>
-CMatrix<T> & CMatrix<T>::operator=(const CMatrix<T> & Matrix)
+void CMatrix<T>::MultiplyInto(const CMatrix<T> & A, const CMatrix<T> & B, CMatrix<T> & Product)
 {
-    m_uRows = Matrix.m_uRows;
-    m_uColumns = Matrix.m_uColumns;
-    m_pMatrix = new T[m_uRows * m_uColumns];
+    const unsigned int uK = A.m_uColumns;
+    const unsigned int uN = B.m_uColumns;
+    unsigned long long ullWork = (unsigned long long)A.m_uRows * uN * uK;
 
-    rsize_t Size = m_uRows * m_uColumns * sizeof(T);
-
-    if (memcpy_s(m_pMatrix, Size, Matrix.m_pMatrix, Size))
+    ForEachRowChunk(A.m_uRows, ullWork, ParallelMultiplyAdds(), [&](unsigned int uBegin, unsigned int uEnd)
     {
-        throw CAppException("Source data is incorrectly sized");
-    }
+        std::fill(&Product.m_pMatrix[(size_t)uBegin * uN], &Product.m_pMatrix[(size_t)uEnd * uN], T());
+
+        CGemmKernel<T>::MultiplyAdd(uEnd - uBegin, uN, uK,
+                                    &A.m_pMatrix[(size_t)uBegin * uK], uK,
+                                    B.m_pMatrix, uN,
+                                    &Product.m_pMatrix[(size_t)uBegin * uN], uN);
+    });
+}
+
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMatrix<T>::SetIdentity()
+{
+    std::fill(m_pMatrix, m_pMatrix + (size_t)m_uRows * m_uColumns, T());
+
+    for (unsigned int uIdx = 0; uIdx < m_uRows && uIdx < m_uColumns; uIdx++)
+    {
+        m_pMatrix[(size_t)uIdx * m_uColumns + uIdx] = T(1);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Binary powering walks the bits of the exponent from the lowest: the base
+// is squared once per bit and multiplied into the result for every set bit.
+// The base, the result and one scratch matrix are allocated up front. Each
+// product goes into the scratch matrix, which then swaps storage with the
+// operand it replaces, so the loop itself never allocates.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CMatrix<T>::Power(unsigned int uExponent) const
+{
+    if (m_uRows != m_uColumns)
+    {
+        throw CAppException("Only a square matrix can be raised to a power.");
+    }
+
+    CMatrix<T> Result(m_uRows, m_uColumns, CUninitialized());
+
+    if (uExponent == 0)
+    {
+        Result.SetIdentity();
+        return(Result);
+    }
+
+    CMatrix<T> Base(*this);
+    CMatrix<T> Scratch(m_uRows, m_uColumns, CUninitialized());
+    bool bResultSet = false;
+
+    while (true)
+    {
+        if (uExponent & 1)
+        {
+            if (bResultSet)
+            {
+                MultiplyInto(Result, Base, Scratch);
+                std::swap(Result.m_pMatrix, Scratch.m_pMatrix);
+            }
+            else
+            {
+                CMatrixMemory::Initialize(Result.m_pMatrix, Base.m_pMatrix, m_uRows, m_uColumns);
+                bResultSet = true;
+            }
+        }
+
+        uExponent >>= 1;
+
+        if (uExponent == 0)
+        {
+            break;
+        }
+
+        MultiplyInto(Base, Base, Scratch);
+        std::swap(Base.m_pMatrix, Scratch.m_pMatrix);
+    }
+
+    return(Result);
+}
+
+// ---------------------------------------------------------------------------
+// Scaling and squaring (Moler and Van Loan, "Nineteen Dubious Ways to
+// Compute the Exponential of a Matrix"): A is divided by 2 ^ s so that its
+// infinity norm is at most 1/2, where the [6/6] Pade approximant
+// D(A) ^ -1 * N(A) is within double rounding of e ^ A. The result is then
+// squared s times, e ^ A = (e ^ (A / 2 ^ s)) ^ (2 ^ s).
+//
+// N and D share the powers of A and only differ in the signs of the odd
+// terms, so both are built together from one product per degree.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CMatrix<T>::Exp() const
+{
+    static_assert(std::is_floating_point<T>::value, "The matrix exponential needs a floating point element type.");
+
+    if (m_uRows != m_uColumns)
+    {
+        throw CAppException("The exponential is only defined for a square matrix.");
+    }
+
+    const int nDegree = 6;
+    const size_t uCount = (size_t)m_uRows * m_uColumns;
+
+    if (uCount == 0)
+    {
+        return(*this);
+    }
+
+    int nExponent = 0;
+    frexp(InfinityNorm(), &nExponent);
+
+    const int nSquarings = (nExponent + 1 > 0) ? nExponent + 1 : 0;
+    const T Scale = (T)ldexp(1.0, -nSquarings);
+
+    CMatrix<T> A(*this);
+    CMatrix<T> Term(*this);
+    CMatrix<T> Numerator(m_uRows, m_uColumns, CUninitialized());
+    CMatrix<T> Denominator(m_uRows, m_uColumns, CUninitialized());
+    CMatrix<T> Scratch(m_uRows, m_uColumns, CUninitialized());
+
+    for (size_t uIdx = 0; uIdx < uCount; uIdx++)
+    {
+        A.m_pMatrix[uIdx] *= Scale;
+        Term.m_pMatrix[uIdx] = A.m_pMatrix[uIdx];
+    }
+
+    // N = I + A / 2 + ..., D = I - A / 2 + ...
+
+    double dCoefficient = 0.5;
+
+    Numerator.SetIdentity();
+    Denominator.SetIdentity();
+
+    for (size_t uIdx = 0; uIdx < uCount; uIdx++)
+    {
+        Numerator.m_pMatrix[uIdx] += (T)dCoefficient * A.m_pMatrix[uIdx];
+        Denominator.m_pMatrix[uIdx] -= (T)dCoefficient * A.m_pMatrix[uIdx];
+    }
+
+    for (int nTerm = 2; nTerm <= nDegree; nTerm++)
+    {
+        dCoefficient *= (double)(nDegree - nTerm + 1) / (double)(nTerm * (2 * nDegree - nTerm + 1));
+
+        MultiplyInto(A, Term, Scratch);
+        std::swap(Term.m_pMatrix, Scratch.m_pMatrix);
+
+        const T c = (T)dCoefficient;
+        const T d = (nTerm & 1) ? -c : c;
+
+        for (size_t uIdx = 0; uIdx < uCount; uIdx++)
+        {
+            Numerator.m_pMatrix[uIdx] += c * Term.m_pMatrix[uIdx];
+            Denominator.m_pMatrix[uIdx] += d * Term.m_pMatrix[uIdx];
+        }
+    }
+
+    SolveInPlace(Denominator, Numerator);
+
+    for (int nSquare = 0; nSquare < nSquarings; nSquare++)
+    {
+        MultiplyInto(Numerator, Numerator, Scratch);
+        std::swap(Numerator.m_pMatrix, Scratch.m_pMatrix);
+    }
+
+    return(Numerator);
+}
+
+// ---------------------------------------------------------------------------
+// The elimination below each pivot is a row update per remaining row, which
+// is split over the workers. Back substitution then runs a row at a time.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMatrix<T>::SolveInPlace(CMatrix<T> & A, CMatrix<T> & B)
+{
+    const unsigned int uSize = A.m_uRows;
+    const unsigned int uCols = B.m_uColumns;
+
+    for (unsigned int uPivot = 0; uPivot < uSize; uPivot++)
+    {
+        unsigned int uBest = uPivot;
+
+        for (unsigned int uRow = uPivot + 1; uRow < uSize; uRow++)
+        {
+            if (fabs((double)A.m_pMatrix[(size_t)uRow * uSize + uPivot]) > fabs((double)A.m_pMatrix[(size_t)uBest * uSize + uPivot]))
+            {
+                uBest = uRow;
+            }
+        }
+
+        if (A.m_pMatrix[(size_t)uBest * uSize + uPivot] == T())
+        {
+            throw CAppException("Matrix is singular");
+        }
+
+        if (uBest != uPivot)
+        {
+            std::swap_ranges(&A.m_pMatrix[(size_t)uBest * uSize], &A.m_pMatrix[(size_t)(uBest + 1) * uSize], &A.m_pMatrix[(size_t)uPivot * uSize]);
+            std::swap_ranges(&B.m_pMatrix[(size_t)uBest * uCols], &B.m_pMatrix[(size_t)(uBest + 1) * uCols], &B.m_pMatrix[(size_t)uPivot * uCols]);
+        }
+
+        const T * pPivotA = &A.m_pMatrix[(size_t)uPivot * uSize];
+        const T * pPivotB = &B.m_pMatrix[(size_t)uPivot * uCols];
+        const unsigned int uBelow = uSize - uPivot - 1;
+        unsigned long long ullWork = (unsigned long long)uBelow * (uSize - uPivot + uCols);
+
+        ForEachRowChunk(uBelow, ullWork, ParallelMultiplyAdds(), [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            for (unsigned int uRow = uPivot + 1 + uBegin; uRow < uPivot + 1 + uEnd; uRow++)
+            {
+                T * pRowA = &A.m_pMatrix[(size_t)uRow * uSize];
+                const T Factor = pRowA[uPivot] / pPivotA[uPivot];
+
+                CGemmKernel<T>::MultiplyAddRow(uSize - uPivot, -Factor, pPivotA + uPivot, pRowA + uPivot);
+                CGemmKernel<T>::MultiplyAddRow(uCols, -Factor, pPivotB, &B.m_pMatrix[(size_t)uRow * uCols]);
+            }
+        });
+    }
+
+    for (unsigned int uRow = uSize; uRow-- > 0; )
+    {
+        const T * pRowA = &A.m_pMatrix[(size_t)uRow * uSize];
+        T * pRowB = &B.m_pMatrix[(size_t)uRow * uCols];
+
+        for (unsigned int uDot = uRow + 1; uDot < uSize; uDot++)
+        {
+            CGemmKernel<T>::MultiplyAddRow(uCols, -pRowA[uDot], &B.m_pMatrix[(size_t)uDot * uCols], pRowB);
+        }
+
+        for (unsigned int uCol = 0; uCol < uCols; uCol++)
+        {
+            pRowB[uCol] /= pRowA[uRow];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Matrix to matrix addition. The two matrices must be the same size, i.e. the
+// rows must match in size, and the columns must match in size
+
+template <class T>
+CMatrix<T> CMatrix<T>::operator+(const CMatrix<T> & Matrix) const
+{
+    if (m_uRows != Matrix.m_uRows || m_uColumns != Matrix.m_uColumns)
+    {
+        throw CAppException("Matrixes must be the same size to add them.");
+    }
+
+    CMatrix<T> p(m_uRows, m_uColumns, CUninitialized());
+    const unsigned int uCols = m_uColumns;
+
+    ForEachRowChunk(m_uRows, (unsigned long long)m_uRows * m_uColumns, ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIndex = (size_t)uBegin * uCols; uIndex < (size_t)uEnd * uCols; uIndex++)
+        {
+            p.m_pMatrix[uIndex] = m_pMatrix[uIndex] + Matrix.m_pMatrix[uIndex];
+        }
+    });
+
+    return(p);
+}
+
+// ---------------------------------------------------------------------------
+// Matrix to matrix subtraction. The two matrices must be the same size, i.e. the
+// rows must match in size, and the columns must match in size
+
+template <class T>
+CMatrix<T> CMatrix<T>::operator-(const CMatrix<T> & Matrix) const
+{
+    if (m_uRows != Matrix.m_uRows || m_uColumns != Matrix.m_uColumns)
+    {
+        throw CAppException("Matrixes must be the same size to add them.");
+    }
+
+    CMatrix<T> p(m_uRows, m_uColumns, CUninitialized());
+    const unsigned int uCols = m_uColumns;
+
+    ForEachRowChunk(m_uRows, (unsigned long long)m_uRows * m_uColumns, ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIndex = (size_t)uBegin * uCols; uIndex < (size_t)uEnd * uCols; uIndex++)
+        {
+            p.m_pMatrix[uIndex] = m_pMatrix[uIndex] - Matrix.m_pMatrix[uIndex];
+        }
+    });
+
+    return(p);
+}
+
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> & CMatrix<T>::operator=(const CMatrix<T> & Matrix)
+{
+    if (this == &Matrix)
+    {
+        return (*this);
+    }
+
+    // The existing storage is reused when it has the right number of elements
+
+    if ((size_t)m_uRows * m_uColumns != (size_t)Matrix.m_uRows * Matrix.m_uColumns)
+    {
+        T * pMatrix = CMatrixMemory::Allocate<T>((size_t)Matrix.m_uRows * Matrix.m_uColumns);
+
+        CMatrixMemory::Free(m_pMatrix, (size_t)m_uRows * m_uColumns);
+        m_pMatrix = pMatrix;
+    }
+
+    m_uRows = Matrix.m_uRows;
+    m_uColumns = Matrix.m_uColumns;
+
+    CMatrixMemory::Initialize(m_pMatrix, Matrix.m_pMatrix, m_uRows, m_uColumns);
 
     return (*this);
 }
 
+// ---------------------------------------------------------------------------
+// Small matrices are reduced on the calling thread. Large ones are split
+// into the same row chunks the other kernels use, one per worker.
+// ---------------------------------------------------------------------------
+
+template <class T>
+template <class R, class F, class C>
+R CMatrix<T>::ReduceRowChunks(R Identity, F Body, C Combine) const
+{
+    CThreadPool & Pool = CThreadPool::Instance();
+    unsigned int uNumChunks = Pool.NumWorkers();
+
+    if ((unsigned long long)m_uRows * m_uColumns < ParallelElements() || uNumChunks <= 1 || CThreadPool::InWorker())
+    {
+        return(Combine(Identity, Body(0, m_uRows)));
+    }
+
+    std::vector<R> Partials(uNumChunks, Identity);
+    std::vector<char> Used(uNumChunks, 0);
+
+    Pool.RunOnWorkers([&](unsigned int uWorker)
+    {
+        unsigned int uBegin = 0;
+        unsigned int uEnd = 0;
+
+        CThreadPool::ChunkRange(m_uRows, uWorker, uNumChunks, &uBegin, &uEnd);
+
+        if (uBegin < uEnd)
+        {
+            Partials[uWorker] = Body(uBegin, uEnd);
+            Used[uWorker] = 1;
+        }
+    });
+
+    R Result = Identity;
+
+    for (unsigned int uChunk = 0; uChunk < uNumChunks; uChunk++)
+    {
+        if (Used[uChunk])
+        {
+            Result = Combine(Result, Partials[uChunk]);
+        }
+    }
+
+    return(Result);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CMatrix<T>::Sum(ESummation eMethod) const
+{
+    const unsigned int uCols = m_uColumns;
+    T Compensation = T();
+
+    return(ReduceRowChunks(T(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            return(CReduceKernel<T>::Sum(&m_pMatrix[(size_t)uBegin * uCols], (size_t)(uEnd - uBegin) * uCols, eMethod));
+        },
+        [&](T Sum, T Partial)
+        {
+            return(eMethod == SumKahan ? CReduceKernel<T>::KahanAdd(Sum, Partial, &Compensation) : Sum + Partial);
+        }));
+}
+
+// ---------------------------------------------------------------------------
+// Each chunk reports the element index of its best element. Chunks are
+// combined in row order and only a strictly better element replaces the
+// current one, so the first of several equal elements is reported.
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CMatrix<T>::Min(unsigned int * puRow, unsigned int * puCol) const
+{
+    if (m_uRows == 0 || m_uColumns == 0)
+    {
+        throw CAppException("Matrix is empty");
+    }
+
+    const unsigned int uCols = m_uColumns;
+
+    size_t uIndex = ReduceRowChunks((size_t)-1,
+        [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            return((size_t)uBegin * uCols + CReduceKernel<T>::MinIndex(&m_pMatrix[(size_t)uBegin * uCols], (size_t)(uEnd - uBegin) * uCols));
+        },
+        [&](size_t uBest, size_t uCandidate)
+        {
+            return((uBest == (size_t)-1 || m_pMatrix[uCandidate] < m_pMatrix[uBest]) ? uCandidate : uBest);
+        });
+
+    if (puRow && puCol)
+    {
+        *puRow = (unsigned int)(uIndex / uCols);
+        *puCol = (unsigned int)(uIndex % uCols);
+    }
+
+    return(m_pMatrix[uIndex]);
+}
+
+template <class T>
+T CMatrix<T>::Max(unsigned int * puRow, unsigned int * puCol) const
+{
+    if (m_uRows == 0 || m_uColumns == 0)
+    {
+        throw CAppException("Matrix is empty");
+    }
+
+    const unsigned int uCols = m_uColumns;
+
+    size_t uIndex = ReduceRowChunks((size_t)-1,
+        [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            return((size_t)uBegin * uCols + CReduceKernel<T>::MaxIndex(&m_pMatrix[(size_t)uBegin * uCols], (size_t)(uEnd - uBegin) * uCols));
+        },
+        [&](size_t uBest, size_t uCandidate)
+        {
+            return((uBest == (size_t)-1 || m_pMatrix[uBest] < m_pMatrix[uCandidate]) ? uCandidate : uBest);
+        });
+
+    if (puRow && puCol)
+    {
+        *puRow = (unsigned int)(uIndex / uCols);
+        *puCol = (unsigned int)(uIndex % uCols);
+    }
+
+    return(m_pMatrix[uIndex]);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+double CMatrix<T>::FrobeniusNorm() const
+{
+    const unsigned int uCols = m_uColumns;
+
+    double dSumSquares = ReduceRowChunks(0.0,
+        [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            return(CReduceKernel<T>::SumSquares(&m_pMatrix[(size_t)uBegin * uCols], (size_t)(uEnd - uBegin) * uCols));
+        },
+        [](double dSum, double dPartial) { return(dSum + dPartial); });
+
+    return(sqrt(dSumSquares));
+}
+
+// ---------------------------------------------------------------------------
+// The column sums are built row by row so the matrix is still read in
+// storage order. Each chunk adds its rows into its own vector of sums.
+// ---------------------------------------------------------------------------
+
+template <class T>
+double CMatrix<T>::OneNorm() const
+{
+    const unsigned int uCols = m_uColumns;
+
+    std::vector<double> ColumnSums = ReduceRowChunks(std::vector<double>(uCols, 0.0),
+        [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            std::vector<double> Sums(uCols, 0.0);
+
+            for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+            {
+                CReduceKernel<T>::AddAbsRow(Sums.data(), &m_pMatrix[(size_t)uRow * uCols], uCols);
+            }
+
+            return(Sums);
+        },
+        [&](std::vector<double> Sums, const std::vector<double> & Partial)
+        {
+            for (unsigned int uCol = 0; uCol < uCols; uCol++)
+            {
+                Sums[uCol] += Partial[uCol];
+            }
+
+            return(Sums);
+        });
+
+    double dNorm = 0.0;
+
+    for (unsigned int uCol = 0; uCol < uCols; uCol++)
+    {
+        dNorm = (ColumnSums[uCol] > dNorm) ? ColumnSums[uCol] : dNorm;
+    }
+
+    return(dNorm);
+}
+
+template <class T>
+double CMatrix<T>::InfinityNorm() const
+{
+    const unsigned int uCols = m_uColumns;
+
+    return(ReduceRowChunks(0.0,
+        [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            double dNorm = 0.0;
+
+            for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+            {
+                double dRowSum = CReduceKernel<T>::SumAbs(&m_pMatrix[(size_t)uRow * uCols], uCols);
+                dNorm = (dRowSum > dNorm) ? dRowSum : dNorm;
+            }
+
+            return(dNorm);
+        },
+        [](double dNorm, double dPartial) { return((dPartial > dNorm) ? dPartial : dNorm); }));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CMatrix<T>::RowSums(ESummation eMethod) const
+{
+    CMatrix<T> Sums(m_uRows, 1, CUninitialized());
+    const unsigned int uCols = m_uColumns;
+
+    ForEachRowChunk(m_uRows, (unsigned long long)m_uRows * m_uColumns, ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            Sums.m_pMatrix[uRow] = CReduceKernel<T>::Sum(&m_pMatrix[(size_t)uRow * uCols], uCols, eMethod);
+        }
+    });
+
+    return(Sums);
+}
+
+// ---------------------------------------------------------------------------
+// Adds up rows uBegin to uEnd into pSum, which must start out zeroed. The
+// pairwise variant splits the rows in halves until a block is small enough
+// to be added up directly.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMatrix<T>::ColumnSumRange(unsigned int uBegin, unsigned int uEnd, ESummation eMethod, T * pSum) const
+{
+    const unsigned int uPairwiseRows = 128;
+
+    if (eMethod == SumKahan)
+    {
+        std::vector<T> Compensation(m_uColumns, T());
+
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            CReduceKernel<T>::AddRow(pSum, &m_pMatrix[(size_t)uRow * m_uColumns], m_uColumns, Compensation.data());
+        }
+    }
+    else if (eMethod == SumNaive || uEnd - uBegin <= uPairwiseRows)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            CReduceKernel<T>::AddRow(pSum, &m_pMatrix[(size_t)uRow * m_uColumns], m_uColumns, NULL);
+        }
+    }
+    else
+    {
+        unsigned int uMiddle = uBegin + (((uEnd - uBegin) / uPairwiseRows + 1) / 2) * uPairwiseRows;
+        std::vector<T> SecondHalf(m_uColumns, T());
+
+        ColumnSumRange(uBegin, uMiddle, eMethod, pSum);
+        ColumnSumRange(uMiddle, uEnd, eMethod, SecondHalf.data());
+        CReduceKernel<T>::AddRow(pSum, SecondHalf.data(), m_uColumns, NULL);
+    }
+}
+
+template <class T>
+CMatrix<T> CMatrix<T>::ColumnSums(ESummation eMethod) const
+{
+    const unsigned int uCols = m_uColumns;
+    std::vector<T> Compensation(uCols, T());
+
+    std::vector<T> Totals = ReduceRowChunks(std::vector<T>(uCols, T()),
+        [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            std::vector<T> Sums(uCols, T());
+            ColumnSumRange(uBegin, uEnd, eMethod, Sums.data());
+            return(Sums);
+        },
+        [&](std::vector<T> Sums, const std::vector<T> & Partial)
+        {
+            CReduceKernel<T>::AddRow(Sums.data(), Partial.data(), uCols, eMethod == SumKahan ? Compensation.data() : NULL);
+            return(Sums);
+        });
+
+    return(CMatrix<T>(1, uCols, Totals.empty() ? NULL : Totals.data()));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<double> CMatrix<T>::RowMeans(ESummation eMethod) const
+{
+    CMatrix<T> Sums = RowSums(eMethod);
+    CMatrix<double> Means(m_uRows, 1, CMatrix<double>::CUninitialized());
+
+    for (unsigned int uRow = 0; uRow < m_uRows; uRow++)
+    {
+        Means.m_pMatrix[uRow] = (double)Sums.m_pMatrix[uRow] / m_uColumns;
+    }
+
+    return(Means);
+}
+
+template <class T>
+CMatrix<double> CMatrix<T>::ColumnMeans(ESummation eMethod) const
+{
+    CMatrix<T> Sums = ColumnSums(eMethod);
+    CMatrix<double> Means(1, m_uColumns, CMatrix<double>::CUninitialized());
+
+    for (unsigned int uCol = 0; uCol < m_uColumns; uCol++)
+    {
+        Means.m_pMatrix[uCol] = (double)Sums.m_pMatrix[uCol] / m_uRows;
+    }
+
+    return(Means);
+}
+
+// ---------------------------------------------------------------------------
+// Function is a template parameter rather than a std::function so that it
+// can be inlined into the loop and the loop vectorized.
+// ---------------------------------------------------------------------------
+
+template <class T>
+template <class F>
+CMatrix<T> & CMatrix<T>::Apply(F Function)
+{
+    const unsigned int uCols = m_uColumns;
+
+    ForEachRowChunk(m_uRows, (unsigned long long)m_uRows * m_uColumns, ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIdx = (size_t)uBegin * uCols; uIdx < (size_t)uEnd * uCols; uIdx++)
+        {
+            m_pMatrix[uIdx] = Function(m_pMatrix[uIdx]);
+        }
+    });
+
+    return(*this);
+}
+
+template <class T>
+template <class F>
+CMatrix<typename std::decay<decltype(std::declval<F>()(std::declval<T>()))>::type> CMatrix<T>::Map(F Function) const
+{
+    typedef typename std::decay<decltype(std::declval<F>()(std::declval<T>()))>::type U;
+
+    CMatrix<U> Result(m_uRows, m_uColumns, typename CMatrix<U>::CUninitialized());
+    const unsigned int uCols = m_uColumns;
+
+    ForEachRowChunk(m_uRows, (unsigned long long)m_uRows * m_uColumns, ParallelElements(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIdx = (size_t)uBegin * uCols; uIdx < (size_t)uEnd * uCols; uIdx++)
+        {
+            Result.m_pMatrix[uIdx] = Function(m_pMatrix[uIdx]);
+        }
+    });
+
+    return(Result);
+}
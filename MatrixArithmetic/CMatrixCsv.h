@@ -0,0 +1,575 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CMappedFile.h"
+#include "CMatrix.h"
+#include "CThreadPool.h"
+#include <charconv>
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Floating point from_chars and to_chars came later than the integer ones.
+// Without them floats are parsed with strtod and written with snprintf.
+// ---------------------------------------------------------------------------
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define MATRIX_CSV_FLOAT_CHARCONV
+#endif
+
+// ---------------------------------------------------------------------------
+// fopen_s is only provided by the Microsoft CRT, see memcpy_s in CMatrix.h.
+// ---------------------------------------------------------------------------
+
+#ifndef _MSC_VER
+inline int fopen_s(FILE ** ppFile, const char * pszPath, const char * pszMode)
+{
+    *ppFile = fopen(pszPath, pszMode);
+    return((*ppFile == NULL) ? -1 : 0);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Reads and writes matrices as CSV or TSV text: one line per row, fields
+// separated by cSeparator. A cSeparator of zero when reading means a tab if
+// the first line has one, a comma otherwise.
+//
+// Reading works on the whole input at once, usually a mapped file. The text
+// is cut into one chunk per worker on line boundaries. A first parallel pass
+// counts the rows of each chunk, which tells every chunk where its rows go,
+// and a second pass parses the chunks straight into the matrix.
+//
+// Writing formats row chunks in parallel into large buffers that are
+// written out in order with a single call each.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CMatrixCsv
+{
+public:
+    // ---------------------------------------------------------------------------
+    // Every line that is not blank is a row and all rows must have the same
+    // number of fields. Spaces around a field are ignored, a '\r' before the
+    // end of a line as well. Throws a CAppException naming the line of the
+    // first error.
+
+    static CMatrix<T> Parse(const char * pText, size_t cbSize, char cSeparator = 0);
+    static CMatrix<T> Read(const char * pszPath, char cSeparator = 0);
+
+    // ---------------------------------------------------------------------------
+    // A negative nPrecision writes floating point elements with the fewest
+    // digits that read back to the same value. Otherwise it is the number of
+    // significant digits. Integers are always written in full.
+
+    static std::string Format(const CMatrix<T> & Matrix, char cSeparator = ',', int nPrecision = -1);
+    static void Write(const CMatrix<T> & Matrix, const char * pszPath, char cSeparator = ',', int nPrecision = -1);
+
+private:
+    // Inputs smaller than PARALLEL_BYTES are parsed on the calling thread.
+    // Output is formatted WRITE_BATCH_ELEMENTS per worker at a time.
+
+    enum { PARALLEL_BYTES = 1024 * 1024, WRITE_BATCH_ELEMENTS = 256 * 1024 };
+    enum { MAX_FIELD_CHARS = 64, MAX_PRECISION = 40 };
+
+    struct CChunk
+    {
+        const char * pBegin;
+        const char * pEnd;
+        unsigned int uNumLines;
+        unsigned int uNumRows;
+        unsigned int uFirstLine;
+        unsigned int uFirstRow;
+    };
+
+    static const char * NextLine(const char * pText, const char * pEnd);
+    static const char * TrimLine(const char * pLine, const char * pLineEnd);
+    static const char * SkipSpaces(const char * pText, const char * pEnd, char cSeparator);
+    static bool IsBlank(const char * pLine, const char * pLineEnd) { return(SkipSpaces(pLine, pLineEnd, 0) == pLineEnd); }
+    static unsigned int CountFields(const char * pLine, const char * pLineEnd, char cSeparator);
+
+    static void ParseChunk(const CChunk & Chunk, char cSeparator, unsigned int uCols, T * pData);
+    static void ParseLine(const char * pLine, const char * pLineEnd, char cSeparator, unsigned int uCols, unsigned int uLine, T * pRow);
+    static const char * ParseValue(const char * pText, const char * pEnd, T * pValue, std::true_type);
+    static const char * ParseValue(const char * pText, const char * pEnd, T * pValue, std::false_type);
+
+    static void FormatRows(const CMatrix<T> & Matrix, unsigned int uBegin, unsigned int uEnd, char cSeparator, int nPrecision, std::string & strText);
+    static char * FormatValue(char * pText, T Value, int nPrecision, std::true_type);
+    static char * FormatValue(char * pText, T Value, int nPrecision, std::false_type);
+    static void FormatBatch(const CMatrix<T> & Matrix, unsigned int uBegin, unsigned int uEnd, char cSeparator, int nPrecision, std::vector<std::string> & Parts);
+
+    static std::string LineError(unsigned int uLine, const char * pszMessage);
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CMatrixCsv<T>::Read(const char * pszPath, char cSeparator)
+{
+    CMappedFile File(pszPath);
+    return(Parse(File.Data(), File.Size(), cSeparator));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CMatrixCsv<T>::Parse(const char * pText, size_t cbSize, char cSeparator)
+{
+    const char * pEnd = pText + cbSize;
+
+    // Skip a UTF-8 byte order mark
+
+    if (cbSize >= 3 && memcmp(pText, "\xEF\xBB\xBF", 3) == 0)
+    {
+        pText += 3;
+    }
+
+    // The first row decides the separator and the number of columns
+
+    const char * pFirst = pText;
+    const char * pFirstEnd = NextLine(pFirst, pEnd);
+
+    while (pFirst < pEnd && IsBlank(pFirst, TrimLine(pFirst, pFirstEnd)))
+    {
+        pFirst = pFirstEnd;
+        pFirstEnd = NextLine(pFirst, pEnd);
+    }
+
+    if (pFirst == pEnd)
+    {
+        return(CMatrix<T>(0, 0));
+    }
+
+    if (cSeparator == 0)
+    {
+        cSeparator = memchr(pFirst, '\t', pFirstEnd - pFirst) ? '\t' : ',';
+    }
+
+    unsigned int uCols = CountFields(pFirst, TrimLine(pFirst, pFirstEnd), cSeparator);
+
+    // Cut the text into chunks that start at the beginning of a line
+
+    CThreadPool & Pool = CThreadPool::Instance();
+    unsigned int uNumChunks = ((size_t)(pEnd - pText) >= PARALLEL_BYTES) ? Pool.NumWorkers() : 1;
+    std::vector<CChunk> Chunks(uNumChunks);
+
+    for (unsigned int uChunk = 0; uChunk < uNumChunks; uChunk++)
+    {
+        Chunks[uChunk].pBegin = (uChunk == 0) ? pText : Chunks[uChunk - 1].pEnd;
+        Chunks[uChunk].pEnd = pEnd;
+
+        if (uChunk + 1 < uNumChunks)
+        {
+            const char * pSplit = pText + (size_t)(pEnd - pText) * (uChunk + 1) / uNumChunks;
+
+            if (pSplit > Chunks[uChunk].pBegin)
+            {
+                Chunks[uChunk].pEnd = NextLine(pSplit - 1, pEnd);
+            }
+            else
+            {
+                Chunks[uChunk].pEnd = Chunks[uChunk].pBegin;
+            }
+        }
+    }
+
+    // Count the lines and rows of every chunk
+
+    Pool.ParallelFor(uNumChunks, [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uChunk = uBegin; uChunk < uEnd; uChunk++)
+        {
+            CChunk & Chunk = Chunks[uChunk];
+
+            Chunk.uNumLines = 0;
+            Chunk.uNumRows = 0;
+
+            for (const char * pLine = Chunk.pBegin; pLine < Chunk.pEnd; )
+            {
+                const char * pLineEnd = NextLine(pLine, Chunk.pEnd);
+
+                Chunk.uNumLines++;
+
+                if (!IsBlank(pLine, TrimLine(pLine, pLineEnd)))
+                {
+                    Chunk.uNumRows++;
+                }
+
+                pLine = pLineEnd;
+            }
+        }
+    });
+
+    unsigned int uRows = 0;
+    unsigned int uLines = 1;
+
+    for (unsigned int uChunk = 0; uChunk < uNumChunks; uChunk++)
+    {
+        Chunks[uChunk].uFirstRow = uRows;
+        Chunks[uChunk].uFirstLine = uLines;
+
+        uRows += Chunks[uChunk].uNumRows;
+        uLines += Chunks[uChunk].uNumLines;
+    }
+
+    CMatrix<T> Result(uRows, uCols, typename CMatrix<T>::CUninitialized());
+
+    Pool.ParallelFor(uNumChunks, [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uChunk = uBegin; uChunk < uEnd; uChunk++)
+        {
+            ParseChunk(Chunks[uChunk], cSeparator, uCols, Result.m_pMatrix);
+        }
+    });
+
+    return(Result);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMatrixCsv<T>::ParseChunk(const CChunk & Chunk, char cSeparator, unsigned int uCols, T * pData)
+{
+    unsigned int uLine = Chunk.uFirstLine;
+    T * pRow = &pData[(size_t)Chunk.uFirstRow * uCols];
+
+    for (const char * pLine = Chunk.pBegin; pLine < Chunk.pEnd; uLine++)
+    {
+        const char * pLineEnd = NextLine(pLine, Chunk.pEnd);
+        const char * pContentEnd = TrimLine(pLine, pLineEnd);
+
+        if (!IsBlank(pLine, pContentEnd))
+        {
+            ParseLine(pLine, pContentEnd, cSeparator, uCols, uLine, pRow);
+            pRow += uCols;
+        }
+
+        pLine = pLineEnd;
+    }
+}
+
+template <class T>
+void CMatrixCsv<T>::ParseLine(const char * pLine, const char * pLineEnd, char cSeparator, unsigned int uCols, unsigned int uLine, T * pRow)
+{
+    const char * pText = pLine;
+
+    for (unsigned int uCol = 0; uCol < uCols; uCol++)
+    {
+        pText = SkipSpaces(pText, pLineEnd, cSeparator);
+
+        const char * pValueEnd = ParseValue(pText, pLineEnd, &pRow[uCol], std::is_floating_point<T>());
+
+        if (pValueEnd == NULL)
+        {
+            throw CAppException(LineError(uLine, "not a number"));
+        }
+
+        pText = SkipSpaces(pValueEnd, pLineEnd, cSeparator);
+
+        if (uCol + 1 < uCols)
+        {
+            if (pText == pLineEnd || *pText != cSeparator)
+            {
+                throw CAppException(LineError(uLine, (pText == pLineEnd) ? "too few fields" : "not a number"));
+            }
+
+            pText++;
+        }
+    }
+
+    if (pText != pLineEnd)
+    {
+        throw CAppException(LineError(uLine, (*pText == cSeparator) ? "too many fields" : "not a number"));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Both return the end of the number, or NULL if there is none. from_chars
+// does not accept a leading '+', so it is skipped here.
+// ---------------------------------------------------------------------------
+
+template <class T>
+const char * CMatrixCsv<T>::ParseValue(const char * pText, const char * pEnd, T * pValue, std::false_type)
+{
+    if (pText < pEnd && *pText == '+')
+    {
+        pText++;
+    }
+
+    std::from_chars_result Result = std::from_chars(pText, pEnd, *pValue);
+    return((Result.ec == std::errc()) ? Result.ptr : NULL);
+}
+
+template <class T>
+const char * CMatrixCsv<T>::ParseValue(const char * pText, const char * pEnd, T * pValue, std::true_type)
+{
+    if (pText < pEnd && *pText == '+')
+    {
+        pText++;
+    }
+
+#ifdef MATRIX_CSV_FLOAT_CHARCONV
+    std::from_chars_result Result = std::from_chars(pText, pEnd, *pValue);
+    return((Result.ec == std::errc()) ? Result.ptr : NULL);
+#else
+    // strtod needs a terminated string, the mapped text is not
+
+    char szField[MAX_FIELD_CHARS];
+    size_t cbField = 0;
+
+    while (pText + cbField < pEnd && cbField + 1 < sizeof(szField) && strchr("0123456789.eE+-infatyINFATY", pText[cbField]))
+    {
+        szField[cbField] = pText[cbField];
+        cbField++;
+    }
+
+    szField[cbField] = '\0';
+
+    char * pFieldEnd = NULL;
+    *pValue = (T)strtod(szField, &pFieldEnd);
+
+    return((pFieldEnd == szField) ? NULL : pText + (pFieldEnd - szField));
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+std::string CMatrixCsv<T>::Format(const CMatrix<T> & Matrix, char cSeparator, int nPrecision)
+{
+    std::vector<std::string> Parts;
+    std::string strText;
+
+    FormatBatch(Matrix, 0, Matrix.NumRows(), cSeparator, nPrecision, Parts);
+
+    size_t cbSize = 0;
+
+    for (size_t uPart = 0; uPart < Parts.size(); uPart++)
+    {
+        cbSize += Parts[uPart].size();
+    }
+
+    strText.reserve(cbSize);
+
+    for (size_t uPart = 0; uPart < Parts.size(); uPart++)
+    {
+        strText += Parts[uPart];
+    }
+
+    return(strText);
+}
+
+template <class T>
+void CMatrixCsv<T>::Write(const CMatrix<T> & Matrix, const char * pszPath, char cSeparator, int nPrecision)
+{
+    FILE * pFile = NULL;
+
+    if (fopen_s(&pFile, pszPath, "wb") != 0)
+    {
+        throw CAppException(string("Cannot create ") + pszPath);
+    }
+
+    // Bounded batches of rows keep the memory for the text small
+
+    unsigned int uCols = (Matrix.NumColumns() > 0) ? Matrix.NumColumns() : 1;
+    unsigned int uBatchRows = (unsigned int)((unsigned long long)WRITE_BATCH_ELEMENTS * CThreadPool::Instance().NumWorkers() / uCols);
+    std::vector<std::string> Parts;
+    bool bWritten = true;
+
+    uBatchRows = (uBatchRows > 0) ? uBatchRows : 1;
+
+    for (unsigned int uRow = 0; uRow < Matrix.NumRows() && bWritten; uRow += uBatchRows)
+    {
+        unsigned int uEnd = (uRow + uBatchRows < Matrix.NumRows()) ? uRow + uBatchRows : Matrix.NumRows();
+
+        FormatBatch(Matrix, uRow, uEnd, cSeparator, nPrecision, Parts);
+
+        for (size_t uPart = 0; uPart < Parts.size() && bWritten; uPart++)
+        {
+            bWritten = (fwrite(Parts[uPart].data(), 1, Parts[uPart].size(), pFile) == Parts[uPart].size());
+        }
+    }
+
+    if (fclose(pFile) != 0 || !bWritten)
+    {
+        throw CAppException(string("Cannot write ") + pszPath);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Formats rows uBegin to uEnd into one part per chunk of rows.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMatrixCsv<T>::FormatBatch(const CMatrix<T> & Matrix, unsigned int uBegin, unsigned int uEnd, char cSeparator, int nPrecision, std::vector<std::string> & Parts)
+{
+    CThreadPool & Pool = CThreadPool::Instance();
+    unsigned long long ullElements = (unsigned long long)(uEnd - uBegin) * Matrix.NumColumns();
+    unsigned int uNumChunks = (ullElements >= WRITE_BATCH_ELEMENTS) ? Pool.NumWorkers() : 1;
+
+    Parts.resize(uNumChunks);
+
+    Pool.ParallelFor(uNumChunks, [&](unsigned int uFirstChunk, unsigned int uLastChunk)
+    {
+        for (unsigned int uChunk = uFirstChunk; uChunk < uLastChunk; uChunk++)
+        {
+            unsigned int uChunkBegin = 0;
+            unsigned int uChunkEnd = 0;
+
+            CThreadPool::ChunkRange(uEnd - uBegin, uChunk, uNumChunks, &uChunkBegin, &uChunkEnd);
+            FormatRows(Matrix, uBegin + uChunkBegin, uBegin + uChunkEnd, cSeparator, nPrecision, Parts[uChunk]);
+        }
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Each row is formatted into a buffer large enough for any row and then
+// appended to the text in one go.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMatrixCsv<T>::FormatRows(const CMatrix<T> & Matrix, unsigned int uBegin, unsigned int uEnd, char cSeparator, int nPrecision, std::string & strText)
+{
+    unsigned int uCols = Matrix.NumColumns();
+    std::vector<char> Row((size_t)uCols * (MAX_FIELD_CHARS + 1) + 1);
+
+    nPrecision = (nPrecision > MAX_PRECISION) ? MAX_PRECISION : nPrecision;
+
+    strText.clear();
+    strText.reserve((size_t)(uEnd - uBegin) * uCols * 8);
+
+    for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+    {
+        const T * pRow = &Matrix.m_pMatrix[(size_t)uRow * uCols];
+        char * pText = Row.data();
+
+        for (unsigned int uCol = 0; uCol < uCols; uCol++)
+        {
+            pText = FormatValue(pText, pRow[uCol], nPrecision, std::is_floating_point<T>());
+            *pText++ = cSeparator;
+        }
+
+        // The last separator becomes the end of the line
+
+        if (uCols > 0)
+        {
+            pText--;
+        }
+
+        *pText++ = '\n';
+        strText.append(Row.data(), pText - Row.data());
+    }
+}
+
+template <class T>
+char * CMatrixCsv<T>::FormatValue(char * pText, T Value, int nPrecision, std::false_type)
+{
+    (void)nPrecision;
+    return(std::to_chars(pText, pText + MAX_FIELD_CHARS, Value).ptr);
+}
+
+template <class T>
+char * CMatrixCsv<T>::FormatValue(char * pText, T Value, int nPrecision, std::true_type)
+{
+#ifdef MATRIX_CSV_FLOAT_CHARCONV
+    if (nPrecision < 0)
+    {
+        return(std::to_chars(pText, pText + MAX_FIELD_CHARS, Value).ptr);
+    }
+
+    return(std::to_chars(pText, pText + MAX_FIELD_CHARS, Value, std::chars_format::general, nPrecision).ptr);
+#else
+    if (nPrecision >= 0)
+    {
+        return(pText + snprintf(pText, MAX_FIELD_CHARS, "%.*g", nPrecision, (double)Value));
+    }
+
+    // Try more and more digits until the text reads back to the same value
+
+    int nLength = 0;
+
+    for (int nDigits = std::numeric_limits<T>::digits10; nDigits <= std::numeric_limits<T>::max_digits10; nDigits++)
+    {
+        nLength = snprintf(pText, MAX_FIELD_CHARS, "%.*g", nDigits, (double)Value);
+
+        if ((T)strtod(pText, NULL) == Value)
+        {
+            break;
+        }
+    }
+
+    return(pText + nLength);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+const char * CMatrixCsv<T>::NextLine(const char * pText, const char * pEnd)
+{
+    const char * pNewLine = static_cast<const char *>(memchr(pText, '\n', pEnd - pText));
+    return(pNewLine ? pNewLine + 1 : pEnd);
+}
+
+// ---------------------------------------------------------------------------
+// The end of the line without its "\n" or "\r\n".
+// ---------------------------------------------------------------------------
+
+template <class T>
+const char * CMatrixCsv<T>::TrimLine(const char * pLine, const char * pLineEnd)
+{
+    if (pLineEnd > pLine && pLineEnd[-1] == '\n')
+    {
+        pLineEnd--;
+    }
+
+    if (pLineEnd > pLine && pLineEnd[-1] == '\r')
+    {
+        pLineEnd--;
+    }
+
+    return(pLineEnd);
+}
+
+// ---------------------------------------------------------------------------
+// Skips spaces and tabs, except for the separator itself.
+// ---------------------------------------------------------------------------
+
+template <class T>
+const char * CMatrixCsv<T>::SkipSpaces(const char * pText, const char * pEnd, char cSeparator)
+{
+    while (pText < pEnd && (*pText == ' ' || *pText == '\t') && *pText != cSeparator)
+    {
+        pText++;
+    }
+
+    return(pText);
+}
+
+template <class T>
+unsigned int CMatrixCsv<T>::CountFields(const char * pLine, const char * pLineEnd, char cSeparator)
+{
+    unsigned int uFields = 1;
+
+    for (const char * pText = pLine; pText < pLineEnd; pText++)
+    {
+        uFields += (*pText == cSeparator) ? 1 : 0;
+    }
+
+    return(uFields);
+}
+
+template <class T>
+std::string CMatrixCsv<T>::LineError(unsigned int uLine, const char * pszMessage)
+{
+    return("CSV line " + std::to_string(uLine) + ": " + pszMessage);
+}
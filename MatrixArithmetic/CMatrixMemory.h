@@ -0,0 +1,335 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CThreadPool.h"
+#include <atomic>
+#include <new>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Where the pages of large matrices are placed on a NUMA host.
+// ---------------------------------------------------------------------------
+
+enum ENumaPolicy
+{
+    NumaLocal,          // Everything on the node of the allocating thread (default)
+    NumaFirstTouch,     // Each worker initializes, and so owns, its own rows
+    NumaInterleave,     // Pages are spread round robin over all nodes
+    NumaBind            // Everything on one chosen node
+};
+
+// ---------------------------------------------------------------------------
+// Allocates and initializes matrix element storage according to the NUMA
+// policy. Small matrices are allocated from the heap as before. Large ones
+// get whole pages straight from the OS, which are not backed by physical
+// memory until they are first written. The policy decides who writes them
+// first, or tells the OS where to put them.
+//
+// NumaFirstTouch relies on the rows being initialized with the same worker
+// to row mapping that the kernels use (CThreadPool::ParallelFor over the
+// rows). It gives the best placement when the pool's workers are pinned.
+// The price is that every large allocation becomes a parallel call on the
+// shared pool, and those run one at a time, so unrelated threads that
+// allocate large matrices wait for each other and for any running kernel.
+// It is therefore opt-in; the default NumaLocal never uses the pool.
+// ---------------------------------------------------------------------------
+
+class CMatrixMemory
+{
+public:
+    // ---------------------------------------------------------------------------
+    // The policy applies to matrices allocated after the call. nNode is the
+    // topology node index used by NumaBind.
+
+    static void SetPolicy(ENumaPolicy ePolicy, unsigned int uNode = 0);
+    static ENumaPolicy Policy();
+    static unsigned int BindNode();
+
+    // ---------------------------------------------------------------------------
+    // Allocations of at least this many bytes are placed by the policy.
+
+    enum { PAGE_ALLOCATION_BYTES = 256 * 1024 };
+
+    // ---------------------------------------------------------------------------
+    // Returns uninitialized storage for uCount elements. Free must be given
+    // the same count.
+
+    template <class T> static T * Allocate(size_t uCount);
+    template <class T> static void Free(T * pData, size_t uCount);
+
+    // ---------------------------------------------------------------------------
+    // Fills a uRows * uCols matrix with a copy of pSource, or with zeros when
+    // pSource is NULL. Under NumaFirstTouch the rows are written by the
+    // workers that process them in the parallel kernels.
+
+    template <class T> static void Initialize(T * pDest, const T * pSource, unsigned int uRows, unsigned int uCols);
+
+private:
+    struct CSettings
+    {
+        std::atomic<int> nPolicy;
+        std::atomic<unsigned int> uNode;
+    };
+
+    static CSettings & Settings();
+    static void * AllocatePages(size_t cbSize);
+    static void FreePages(void * pData, size_t cbSize);
+    static void TouchPages(void * pData, size_t cbSize, bool bInterleave, unsigned int uNode);
+    static bool IsPaged(size_t cbSize) { return(cbSize >= PAGE_ALLOCATION_BYTES); }
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CMatrixMemory::CSettings & CMatrixMemory::Settings()
+{
+    static CSettings Values = { { NumaLocal }, { 0 } };
+    return(Values);
+}
+
+inline void CMatrixMemory::SetPolicy(ENumaPolicy ePolicy, unsigned int uNode)
+{
+    if (ePolicy == NumaBind && uNode >= CThreadPool::Instance().Topology().NumNodes())
+    {
+        throw CAppException("NUMA node out of range");
+    }
+
+    Settings().uNode = uNode;
+    Settings().nPolicy = ePolicy;
+}
+
+inline ENumaPolicy CMatrixMemory::Policy()
+{
+    return((ENumaPolicy)Settings().nPolicy.load());
+}
+
+inline unsigned int CMatrixMemory::BindNode()
+{
+    return(Settings().uNode);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+T * CMatrixMemory::Allocate(size_t uCount)
+{
+    size_t cbSize = uCount * sizeof(T);
+
+    if (!IsPaged(cbSize))
+    {
+        return(static_cast<T *>(::operator new(cbSize ? cbSize : 1)));
+    }
+
+    return(static_cast<T *>(AllocatePages(cbSize)));
+}
+
+template <class T>
+void CMatrixMemory::Free(T * pData, size_t uCount)
+{
+    if (pData == NULL)
+    {
+        return;
+    }
+
+    size_t cbSize = uCount * sizeof(T);
+
+    if (!IsPaged(cbSize))
+    {
+        ::operator delete(pData);
+    }
+    else
+    {
+        FreePages(pData, cbSize);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CMatrixMemory::Initialize(T * pDest, const T * pSource, unsigned int uRows, unsigned int uCols)
+{
+    size_t cbRow = (size_t)uCols * sizeof(T);
+
+    if (!IsPaged(cbRow * uRows) || Policy() != NumaFirstTouch)
+    {
+        if (pSource)
+        {
+            memcpy(pDest, pSource, cbRow * uRows);
+        }
+        else
+        {
+            memset(pDest, 0, cbRow * uRows);
+        }
+
+        return;
+    }
+
+    CThreadPool::Instance().ParallelFor(uRows, [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        char * pStart = reinterpret_cast<char *>(pDest) + cbRow * uBegin;
+
+        if (pSource)
+        {
+            memcpy(pStart, reinterpret_cast<const char *>(pSource) + cbRow * uBegin, cbRow * (uEnd - uBegin));
+        }
+        else
+        {
+            memset(pStart, 0, cbRow * (uEnd - uBegin));
+        }
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Interleave and bind are handed to the OS where it supports them. When it
+// does not, the pages are touched by workers running on the right nodes,
+// which has the same effect as long as the workers are pinned.
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+inline void * CMatrixMemory::AllocatePages(size_t cbSize)
+{
+    void * pData = NULL;
+    ENumaPolicy ePolicy = Policy();
+
+    if (ePolicy == NumaBind)
+    {
+        int nNode = CThreadPool::Instance().Topology().NodeNumber(BindNode());
+        pData = VirtualAllocExNuma(GetCurrentProcess(), NULL, cbSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, (DWORD)nNode);
+    }
+
+    if (pData == NULL)
+    {
+        pData = VirtualAlloc(NULL, cbSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+        if (pData == NULL)
+        {
+            throw std::bad_alloc();
+        }
+
+        if (ePolicy == NumaInterleave || ePolicy == NumaBind)
+        {
+            TouchPages(pData, cbSize, ePolicy == NumaInterleave, BindNode());
+        }
+    }
+
+    return(pData);
+}
+
+inline void CMatrixMemory::FreePages(void * pData, size_t cbSize)
+{
+    (void)cbSize;
+    VirtualFree(pData, 0, MEM_RELEASE);
+}
+
+#else
+
+inline void * CMatrixMemory::AllocatePages(size_t cbSize)
+{
+    void * pData = mmap(NULL, cbSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (pData == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+
+    ENumaPolicy ePolicy = Policy();
+
+    if (ePolicy == NumaInterleave || ePolicy == NumaBind)
+    {
+        bool bPlaced = false;
+
+#ifdef SYS_mbind
+        // mbind is called directly so there is no dependency on libnuma.
+        // The mode values are MPOL_BIND (2) and MPOL_INTERLEAVE (3).
+
+        const CNumaTopology & Topology = CThreadPool::Instance().Topology();
+        unsigned long NodeMask[16];
+        memset(NodeMask, 0, sizeof(NodeMask));
+
+        for (unsigned int uNode = 0; uNode < Topology.NumNodes(); uNode++)
+        {
+            unsigned int uOsNode = (unsigned int)Topology.NodeNumber(uNode);
+
+            if ((ePolicy == NumaInterleave || uNode == BindNode()) && uOsNode < sizeof(NodeMask) * 8)
+            {
+                NodeMask[uOsNode / (sizeof(unsigned long) * 8)] |= 1UL << (uOsNode % (sizeof(unsigned long) * 8));
+            }
+        }
+
+        int nMode = (ePolicy == NumaInterleave) ? 3 : 2;
+        bPlaced = (syscall(SYS_mbind, pData, cbSize, nMode, NodeMask, sizeof(NodeMask) * 8 + 1, 0) == 0);
+#endif
+
+        if (!bPlaced)
+        {
+            TouchPages(pData, cbSize, ePolicy == NumaInterleave, BindNode());
+        }
+    }
+
+    return(pData);
+}
+
+inline void CMatrixMemory::FreePages(void * pData, size_t cbSize)
+{
+    munmap(pData, cbSize);
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Page n goes to node n % nodes when interleaving, otherwise every page goes
+// to uNode. The workers of a node share its pages between them.
+// ---------------------------------------------------------------------------
+
+inline void CMatrixMemory::TouchPages(void * pData, size_t cbSize, bool bInterleave, unsigned int uNode)
+{
+    const size_t cbPage = 4096;
+    CThreadPool & Pool = CThreadPool::Instance();
+    unsigned int uNumNodes = Pool.Topology().NumNodes();
+    size_t uNumPages = (cbSize + cbPage - 1) / cbPage;
+
+    if (CThreadPool::InWorker())
+    {
+        memset(pData, 0, cbSize);
+        return;
+    }
+
+    Pool.RunOnWorkers([&](unsigned int uWorker)
+    {
+        unsigned int uWorkerNode = Pool.WorkerNode(uWorker);
+
+        if (!bInterleave && uWorkerNode != uNode)
+        {
+            return;
+        }
+
+        size_t uStride = Pool.NodeWorkerCount(uWorkerNode);
+        size_t uFirst = uWorker - Pool.NodeFirstWorker(uWorkerNode);
+
+        for (size_t uPage = uFirst; ; uPage += uStride)
+        {
+            size_t uIndex = bInterleave ? uPage * uNumNodes + uWorkerNode : uPage;
+
+            if (uIndex >= uNumPages)
+            {
+                break;
+            }
+
+            static_cast<char *>(pData)[uIndex * cbPage] = 0;
+        }
+    });
+}
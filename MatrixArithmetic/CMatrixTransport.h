@@ -0,0 +1,183 @@
+#pragma once
+
+#include "CAppException.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+// A transport moves raw byte messages between the processes (ranks) taking
+// part in a distributed computation. Messages between any two ranks are
+// delivered in the order they were sent. Send may return before the message
+// is received, but both calls block until their buffer can be reused.
+//
+// The distributed matrix code only talks to this interface, so a new
+// transport (sockets, shared memory, MPI, ...) is added by deriving from it.
+// ---------------------------------------------------------------------------
+
+class CMatrixTransport
+{
+public:
+    virtual ~CMatrixTransport() {}
+
+    // ---------------------------------------------------------------------------
+    // This process's rank and the number of ranks taking part.
+
+    virtual int Rank() const = 0;
+    virtual int Size() const = 0;
+
+    // ---------------------------------------------------------------------------
+    // Sends cbSize bytes to rank nDest.
+
+    virtual void Send(int nDest, const void * pData, size_t cbSize) = 0;
+
+    // ---------------------------------------------------------------------------
+    // Receives the next message sent by rank nSource. The message must be
+    // exactly cbSize bytes long.
+
+    virtual void Receive(int nSource, void * pData, size_t cbSize) = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Transport between threads of the same process. Every rank runs on its own
+// thread and owns one CLocalTransport endpoint. This is the transport used by
+// the unit tests and it works on every platform.
+// ---------------------------------------------------------------------------
+
+class CLocalTransport : public CMatrixTransport
+{
+public:
+    // ---------------------------------------------------------------------------
+    // Runs Worker on nSize threads, each with its own endpoint, and waits for
+    // all of them to complete. The first exception thrown by a worker is
+    // rethrown on the calling thread.
+
+    static void Run(int nSize, const std::function<void(CMatrixTransport &)> & Worker);
+
+    inline virtual int Rank() const { return(m_nRank); }
+    inline virtual int Size() const { return(m_pHub->nSize); }
+
+    virtual void Send(int nDest, const void * pData, size_t cbSize);
+    virtual void Receive(int nSource, void * pData, size_t cbSize);
+
+private:
+    // One queue of pending messages for every source/destination pair.
+
+    struct CHub
+    {
+        int nSize;
+        std::mutex Lock;
+        std::condition_variable Arrived;
+        std::vector< std::deque< std::vector<char> > > Queues;
+    };
+
+    inline CLocalTransport(const std::shared_ptr<CHub> & pHub, int nRank) : m_pHub(pHub), m_nRank(nRank) {}
+
+    std::shared_ptr<CHub> m_pHub;
+    int m_nRank;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CLocalTransport::Run(int nSize, const std::function<void(CMatrixTransport &)> & Worker)
+{
+    if (nSize <= 0)
+    {
+        throw CAppException("At least one rank is needed.");
+    }
+
+    std::shared_ptr<CHub> pHub(new CHub);
+    pHub->nSize = nSize;
+    pHub->Queues.resize(nSize * nSize);
+
+    std::vector<std::thread> Threads;
+    std::vector<std::exception_ptr> Errors(nSize);
+
+    for (int nRank = 0; nRank < nSize; nRank++)
+    {
+        Threads.push_back(std::thread([&, nRank]()
+        {
+            try
+            {
+                CLocalTransport Endpoint(pHub, nRank);
+                Worker(Endpoint);
+            }
+            catch (...)
+            {
+                Errors[nRank] = std::current_exception();
+            }
+        }));
+    }
+
+    for (size_t uIdx = 0; uIdx < Threads.size(); uIdx++)
+    {
+        Threads[uIdx].join();
+    }
+
+    for (int nRank = 0; nRank < nSize; nRank++)
+    {
+        if (Errors[nRank])
+        {
+            std::rethrow_exception(Errors[nRank]);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CLocalTransport::Send(int nDest, const void * pData, size_t cbSize)
+{
+    if (nDest < 0 || nDest >= m_pHub->nSize)
+    {
+        throw CAppException("Destination rank out of range");
+    }
+
+    const char * pBytes = static_cast<const char *>(pData);
+    std::vector<char> Message(pBytes, pBytes + cbSize);
+
+    {
+        std::lock_guard<std::mutex> Guard(m_pHub->Lock);
+        m_pHub->Queues[m_nRank * m_pHub->nSize + nDest].push_back(std::move(Message));
+    }
+
+    m_pHub->Arrived.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CLocalTransport::Receive(int nSource, void * pData, size_t cbSize)
+{
+    if (nSource < 0 || nSource >= m_pHub->nSize)
+    {
+        throw CAppException("Source rank out of range");
+    }
+
+    std::deque< std::vector<char> > & Queue = m_pHub->Queues[nSource * m_pHub->nSize + m_nRank];
+    std::vector<char> Message;
+
+    {
+        std::unique_lock<std::mutex> Guard(m_pHub->Lock);
+        m_pHub->Arrived.wait(Guard, [&Queue]() { return(!Queue.empty()); });
+
+        Message.swap(Queue.front());
+        Queue.pop_front();
+    }
+
+    if (Message.size() != cbSize)
+    {
+        throw CAppException("Received message has an unexpected size.");
+    }
+
+    if (cbSize)
+    {
+        memcpy(pData, Message.data(), cbSize);
+    }
+}
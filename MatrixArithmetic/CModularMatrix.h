@@ -0,0 +1,500 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CKernelTuning.h"
+#include "CMatrix.h"
+#include <algorithm>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Arithmetic modulo p for 2 <= p < 2^31, so that the product of two reduced
+// numbers fits in 64 bits with room to spare.
+//
+// Reduce() is Barrett's reduction: x mod p = x - floor(x / p) * p where the
+// division is replaced by a multiply with a precomputed 2^64 / p, taking the
+// high 64 bits of the 128 bit product. The estimate of the quotient is off
+// by at most two, which a couple of subtractions put right.
+//
+// Fold() is a cheaper partial reduction for sums that are still growing:
+// with x = h * 2^32 + l it returns h * (2^32 mod p) + l, which is congruent
+// to x and below 2^63 + 2^32. It needs only a 32 * 32 bit multiply, which
+// unlike the 64 bit high multiply exists in SIMD instruction sets.
+// ---------------------------------------------------------------------------
+
+class CModulus
+{
+public:
+    explicit CModulus(unsigned int uModulus);
+
+    inline unsigned int Value() const { return(m_uModulus); }
+
+    unsigned int Reduce(unsigned long long ullValue) const;
+    inline unsigned long long Fold(unsigned long long ullValue) const { return((ullValue >> 32) * m_ullFoldFactor + (ullValue & 0xFFFFFFFFULL)); }
+
+    inline unsigned int Add(unsigned int a, unsigned int b) const { unsigned int s = a + b; return((s >= m_uModulus) ? s - m_uModulus : s); }
+    inline unsigned int Subtract(unsigned int a, unsigned int b) const { return((a >= b) ? a - b : a + m_uModulus - b); }
+    inline unsigned int Multiply(unsigned int a, unsigned int b) const { return(Reduce((unsigned long long)a * b)); }
+
+    // ---------------------------------------------------------------------------
+    // b with a * b = 1 mod p, by the extended Euclidean algorithm. Throws if
+    // there is none, which for a prime p only happens for a = 0.
+
+    unsigned int Inverse(unsigned int a) const;
+
+    // ---------------------------------------------------------------------------
+    // How many products of two reduced numbers can be added to a folded sum
+    // before it could overflow 64 bits.
+
+    inline unsigned int LazyProducts() const { return(m_uLazyProducts); }
+
+    static unsigned long long MultiplyHigh(unsigned long long a, unsigned long long b);
+
+private:
+    unsigned int m_uModulus;
+    unsigned long long m_ullBarrett;
+    unsigned long long m_ullFoldFactor;
+    unsigned int m_uLazyProducts;
+};
+
+// ---------------------------------------------------------------------------
+// A matrix over the integers modulo p. The elements are kept reduced, in
+// [0, p), in a CMatrix<unsigned int>.
+//
+// The product accumulates in 64 bits and only reduces when the sums could
+// overflow. For a small p that is never before the end; for p near 2^31
+// the sums are folded every few products. The inner loops only use 32 * 32
+// to 64 bit multiplies, adds, shifts and masks, so they vectorize; the full
+// reduction of each result element is done once, at the end.
+// ---------------------------------------------------------------------------
+
+class CModularMatrix
+{
+public:
+    CModularMatrix(unsigned int uRows, unsigned int uCols, unsigned int uModulus);
+
+    // ---------------------------------------------------------------------------
+    // Takes every element of Matrix modulo p, negative ones included.
+
+    CModularMatrix(const CMatrix<int> & Matrix, unsigned int uModulus);
+
+    static CModularMatrix Identity(unsigned int uSize, unsigned int uModulus);
+
+    inline unsigned int NumRows() const { return(m_Elements.NumRows()); }
+    inline unsigned int NumColumns() const { return(m_Elements.NumColumns()); }
+    inline unsigned int Modulus() const { return(m_Modulus.Value()); }
+
+    inline unsigned int GetAt(unsigned int uRow, unsigned int uCol) const { return(m_Elements.GetAt(uRow, uCol)); }
+    inline void SetAt(unsigned int uRow, unsigned int uCol, unsigned long long ullValue) { m_Elements.SetAt(uRow, uCol, m_Modulus.Reduce(ullValue)); }
+
+    // ---------------------------------------------------------------------------
+    // The reduced elements, and the same converted to int, which they always
+    // fit in.
+
+    inline const CMatrix<unsigned int> & Elements() const { return(m_Elements); }
+    CMatrix<int> ToMatrix() const;
+
+    // ---------------------------------------------------------------------------
+    // Element wise sum and difference, product with a number and matrix
+    // product. The operands must have the same modulus.
+
+    CModularMatrix operator+(const CModularMatrix & Matrix) const;
+    CModularMatrix operator-(const CModularMatrix & Matrix) const;
+    CModularMatrix Scale(unsigned long long ullFactor) const;
+    CModularMatrix operator*(const CModularMatrix & Matrix) const;
+
+    // ---------------------------------------------------------------------------
+    // The inverse by Gauss-Jordan elimination over the integers modulo p.
+    // Throws if the matrix is singular modulo p. A pivot that has no inverse
+    // modulo a composite p throws as well.
+
+    CModularMatrix Inverse() const;
+
+private:
+    void CheckModulus(const CModularMatrix & Matrix) const;
+
+    // ---------------------------------------------------------------------------
+    // The kernels work on 64 bit sums, so they take their block size and
+    // parallel thresholds from the tuned long long parameters. unsigned int
+    // has no profile entry and would always run with the defaults.
+
+    static const CKernelParameters & KernelParameters() { return(CKernelTuning::Parameters<long long>()); }
+
+    CModulus m_Modulus;
+    CMatrix<unsigned int> m_Elements;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline unsigned long long CModulus::MultiplyHigh(unsigned long long a, unsigned long long b)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return(__umulh(a, b));
+#elif defined(__SIZEOF_INT128__)
+    return((unsigned long long)(((unsigned __int128)a * b) >> 64));
+#else
+    unsigned long long ullLowLow = (a & 0xFFFFFFFFULL) * (b & 0xFFFFFFFFULL);
+    unsigned long long ullHighLow = (a >> 32) * (b & 0xFFFFFFFFULL);
+    unsigned long long ullLowHigh = (a & 0xFFFFFFFFULL) * (b >> 32);
+    unsigned long long ullHighHigh = (a >> 32) * (b >> 32);
+    unsigned long long ullMiddle = (ullLowLow >> 32) + (ullHighLow & 0xFFFFFFFFULL) + (ullLowHigh & 0xFFFFFFFFULL);
+
+    return(ullHighHigh + (ullHighLow >> 32) + (ullLowHigh >> 32) + (ullMiddle >> 32));
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// A folded sum is at most (2^32 - 1) * (2^32 mod p) + 2^32 - 1, and each
+// product adds at most (p - 1)^2.
+// ---------------------------------------------------------------------------
+
+inline CModulus::CModulus(unsigned int uModulus)
+{
+    if (uModulus < 2 || uModulus >= 0x80000000U)
+    {
+        throw CAppException("The modulus must be at least 2 and below 2^31.");
+    }
+
+    m_uModulus = uModulus;
+    m_ullBarrett = ~0ULL / uModulus;
+    m_ullFoldFactor = (1ULL << 32) % uModulus;
+
+    unsigned long long ullFolded = 0xFFFFFFFFULL * m_ullFoldFactor + 0xFFFFFFFFULL;
+    unsigned long long ullProduct = (unsigned long long)(uModulus - 1) * (uModulus - 1);
+    unsigned long long ullLazy = (~0ULL - ullFolded) / ullProduct;
+
+    m_uLazyProducts = (ullLazy > 0xFFFFFFFFULL) ? 0xFFFFFFFFU : (unsigned int)ullLazy;
+}
+
+inline unsigned int CModulus::Reduce(unsigned long long ullValue) const
+{
+    unsigned long long ullRest = ullValue - MultiplyHigh(ullValue, m_ullBarrett) * m_uModulus;
+
+    while (ullRest >= m_uModulus)
+    {
+        ullRest -= m_uModulus;
+    }
+
+    return((unsigned int)ullRest);
+}
+
+inline unsigned int CModulus::Inverse(unsigned int a) const
+{
+    long long nOld = (long long)(a % m_uModulus);
+    long long nRest = (long long)m_uModulus;
+    long long nOldFactor = 1;
+    long long nFactor = 0;
+
+    while (nRest != 0)
+    {
+        long long nQuotient = nOld / nRest;
+        long long nTemp = nOld - nQuotient * nRest;
+
+        nOld = nRest;
+        nRest = nTemp;
+        nTemp = nOldFactor - nQuotient * nFactor;
+        nOldFactor = nFactor;
+        nFactor = nTemp;
+    }
+
+    if (nOld != 1)
+    {
+        throw CAppException("Element has no inverse modulo the modulus.");
+    }
+
+    return((unsigned int)((nOldFactor < 0) ? nOldFactor + m_uModulus : nOldFactor));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CModularMatrix::CModularMatrix(unsigned int uRows, unsigned int uCols, unsigned int uModulus)
+    : m_Modulus(uModulus), m_Elements(uRows, uCols)
+{
+}
+
+inline CModularMatrix::CModularMatrix(const CMatrix<int> & Matrix, unsigned int uModulus)
+    : m_Modulus(uModulus), m_Elements(Matrix.NumRows(), Matrix.NumColumns())
+{
+    const int * pSource = Matrix.data();
+    unsigned int * pDest = m_Elements.data();
+
+    for (size_t uIdx = 0; uIdx < Matrix.size(); uIdx++)
+    {
+        long long nRest = (long long)pSource[uIdx] % (long long)uModulus;
+
+        pDest[uIdx] = (unsigned int)((nRest < 0) ? nRest + uModulus : nRest);
+    }
+}
+
+inline CModularMatrix CModularMatrix::Identity(unsigned int uSize, unsigned int uModulus)
+{
+    CModularMatrix Result(uSize, uSize, uModulus);
+
+    for (unsigned int uIdx = 0; uIdx < uSize; uIdx++)
+    {
+        Result.m_Elements.SetAt(uIdx, uIdx, 1);
+    }
+
+    return(Result);
+}
+
+inline CMatrix<int> CModularMatrix::ToMatrix() const
+{
+    CMatrix<int> Result(NumRows(), NumColumns());
+
+    std::copy(m_Elements.begin(), m_Elements.end(), Result.begin());
+
+    return(Result);
+}
+
+inline void CModularMatrix::CheckModulus(const CModularMatrix & Matrix) const
+{
+    if (Matrix.Modulus() != Modulus())
+    {
+        throw CAppException("Matrices must have the same modulus.");
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CModularMatrix CModularMatrix::operator+(const CModularMatrix & Matrix) const
+{
+    CheckModulus(Matrix);
+
+    if (NumRows() != Matrix.NumRows() || NumColumns() != Matrix.NumColumns())
+    {
+        throw CAppException("Matrixes must be the same size to add them.");
+    }
+
+    CModularMatrix Result(NumRows(), NumColumns(), Modulus());
+    const unsigned int uCols = NumColumns();
+
+    CMatrix<unsigned int>::ForEachRowChunk(NumRows(), m_Elements.size(), KernelParameters().ullParallelElements,
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIdx = (size_t)uBegin * uCols; uIdx < (size_t)uEnd * uCols; uIdx++)
+        {
+            Result.m_Elements.m_pMatrix[uIdx] = m_Modulus.Add(m_Elements.m_pMatrix[uIdx], Matrix.m_Elements.m_pMatrix[uIdx]);
+        }
+    });
+
+    return(Result);
+}
+
+inline CModularMatrix CModularMatrix::operator-(const CModularMatrix & Matrix) const
+{
+    CheckModulus(Matrix);
+
+    if (NumRows() != Matrix.NumRows() || NumColumns() != Matrix.NumColumns())
+    {
+        throw CAppException("Matrixes must be the same size to subtract them.");
+    }
+
+    CModularMatrix Result(NumRows(), NumColumns(), Modulus());
+    const unsigned int uCols = NumColumns();
+
+    CMatrix<unsigned int>::ForEachRowChunk(NumRows(), m_Elements.size(), KernelParameters().ullParallelElements,
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIdx = (size_t)uBegin * uCols; uIdx < (size_t)uEnd * uCols; uIdx++)
+        {
+            Result.m_Elements.m_pMatrix[uIdx] = m_Modulus.Subtract(m_Elements.m_pMatrix[uIdx], Matrix.m_Elements.m_pMatrix[uIdx]);
+        }
+    });
+
+    return(Result);
+}
+
+inline CModularMatrix CModularMatrix::Scale(unsigned long long ullFactor) const
+{
+    const unsigned int uFactor = m_Modulus.Reduce(ullFactor);
+    const unsigned int uCols = NumColumns();
+    CModularMatrix Result(NumRows(), NumColumns(), Modulus());
+
+    CMatrix<unsigned int>::ForEachRowChunk(NumRows(), m_Elements.size(), KernelParameters().ullParallelElements,
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (size_t uIdx = (size_t)uBegin * uCols; uIdx < (size_t)uEnd * uCols; uIdx++)
+        {
+            Result.m_Elements.m_pMatrix[uIdx] = m_Modulus.Multiply(m_Elements.m_pMatrix[uIdx], uFactor);
+        }
+    });
+
+    return(Result);
+}
+
+// ---------------------------------------------------------------------------
+// Every worker takes a band of rows of the product. Each row is built one
+// block of columns at a time in 64 bit sums that stay in the L1 cache, with
+// the i-k-j order of CGemmKernel: every element of the row of A is
+// multiplied into a row of the block of B. After LazyProducts() of them the
+// sums are folded so that they cannot overflow, and the block is reduced
+// into the product at the end of the row.
+// ---------------------------------------------------------------------------
+
+inline CModularMatrix CModularMatrix::operator*(const CModularMatrix & Matrix) const
+{
+    CheckModulus(Matrix);
+
+    if (NumColumns() != Matrix.NumRows())
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const unsigned int uK = NumColumns();
+    const unsigned int uN = Matrix.NumColumns();
+    const unsigned int uBlockN = KernelParameters().uBlockN;
+    const unsigned int uLazy = m_Modulus.LazyProducts();
+
+    // A copy of the modulus on the stack, which the compiler knows is not
+    // changed by the stores to the product
+
+    const CModulus LocalModulus = m_Modulus;
+    unsigned long long ullWork = (unsigned long long)NumRows() * uN * uK;
+    CModularMatrix Result(NumRows(), uN, Modulus());
+
+    CMatrix<unsigned int>::ForEachRowChunk(NumRows(), ullWork, KernelParameters().ullParallelMultiplyAdds,
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        std::vector<unsigned long long> Sums(uBlockN);
+        unsigned long long * pSums = Sums.data();
+
+        for (unsigned int uCol0 = 0; uCol0 < uN; uCol0 += uBlockN)
+        {
+            const unsigned int uCols = (uCol0 + uBlockN < uN) ? uBlockN : uN - uCol0;
+
+            for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+            {
+                const unsigned int * pARow = m_Elements.row_ptr(uRow);
+                unsigned int uSinceFold = 0;
+
+                std::fill(pSums, pSums + uCols, 0ULL);
+
+                for (unsigned int uDot = 0; uDot < uK; uDot++)
+                {
+                    const unsigned long long a = pARow[uDot];
+                    const unsigned int * pBRow = &Matrix.m_Elements.m_pMatrix[(size_t)uDot * uN + uCol0];
+
+                    for (unsigned int uCol = 0; uCol < uCols; uCol++)
+                    {
+                        pSums[uCol] += a * pBRow[uCol];
+                    }
+
+                    if (++uSinceFold == uLazy)
+                    {
+                        for (unsigned int uCol = 0; uCol < uCols; uCol++)
+                        {
+                            pSums[uCol] = LocalModulus.Fold(pSums[uCol]);
+                        }
+
+                        uSinceFold = 0;
+                    }
+                }
+
+                unsigned int * pDest = &Result.m_Elements.m_pMatrix[(size_t)uRow * uN + uCol0];
+
+                for (unsigned int uCol = 0; uCol < uCols; uCol++)
+                {
+                    pDest[uCol] = LocalModulus.Reduce(pSums[uCol]);
+                }
+            }
+        }
+    });
+
+    return(Result);
+}
+
+// ---------------------------------------------------------------------------
+// Gauss-Jordan on [A | I]: for each column a row with a non-zero element is
+// swapped up, scaled so the pivot is one, and subtracted from every other
+// row to clear the column, which turns the right half into the inverse.
+// Over a field any non-zero pivot is as good as any other, so there is no
+// search for the largest one. The row updates for one pivot are
+// independent and split over the workers.
+// ---------------------------------------------------------------------------
+
+inline CModularMatrix CModularMatrix::Inverse() const
+{
+    const unsigned int uSize = NumRows();
+
+    if (uSize != NumColumns())
+    {
+        throw CAppException("Only a square matrix can be inverted.");
+    }
+
+    const unsigned int uWidth = 2 * uSize;
+    const unsigned int p = Modulus();
+    CMatrix<unsigned int> Work(uSize, uWidth);
+
+    for (unsigned int uRow = 0; uRow < uSize; uRow++)
+    {
+        std::copy(m_Elements.row_begin(uRow), m_Elements.row_end(uRow), Work.row_ptr(uRow));
+        Work.row_ptr(uRow)[uSize + uRow] = 1;
+    }
+
+    for (unsigned int uPivot = 0; uPivot < uSize; uPivot++)
+    {
+        unsigned int uFound = uPivot;
+
+        while (uFound < uSize && Work.row_ptr(uFound)[uPivot] == 0)
+        {
+            uFound++;
+        }
+
+        if (uFound == uSize)
+        {
+            throw CAppException("Matrix is singular");
+        }
+
+        if (uFound != uPivot)
+        {
+            std::swap_ranges(Work.row_begin(uFound), Work.row_end(uFound), Work.row_begin(uPivot));
+        }
+
+        unsigned int * pPivotRow = Work.row_ptr(uPivot);
+        const unsigned int uScale = m_Modulus.Inverse(pPivotRow[uPivot]);
+
+        for (unsigned int uCol = uPivot; uCol < uWidth; uCol++)
+        {
+            pPivotRow[uCol] = m_Modulus.Multiply(pPivotRow[uCol], uScale);
+        }
+
+        // row -= f * pivot row is row + (p - f) * pivot row, which stays
+        // below p + p^2 before the reduction
+
+        CMatrix<unsigned int>::ForEachRowChunk(uSize, (unsigned long long)uSize * (uWidth - uPivot), KernelParameters().ullParallelMultiplyAdds,
+            [&](unsigned int uBegin, unsigned int uEnd)
+        {
+            for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+            {
+                unsigned int * pRow = Work.row_ptr(uRow);
+                const unsigned long long ullFactor = p - pRow[uPivot];
+
+                if (uRow == uPivot || pRow[uPivot] == 0)
+                {
+                    continue;
+                }
+
+                for (unsigned int uCol = uPivot; uCol < uWidth; uCol++)
+                {
+                    pRow[uCol] = m_Modulus.Reduce(pRow[uCol] + ullFactor * pPivotRow[uCol]);
+                }
+            }
+        });
+    }
+
+    CModularMatrix Result(uSize, uSize, p);
+
+    for (unsigned int uRow = 0; uRow < uSize; uRow++)
+    {
+        std::copy(Work.row_ptr(uRow) + uSize, Work.row_ptr(uRow) + uWidth, Result.m_Elements.row_ptr(uRow));
+    }
+
+    return(Result);
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// The NUMA nodes of the host and the logical CPUs that belong to each of
+// them. Only CPUs the process is allowed to run on are listed. A host
+// without NUMA support is reported as a single node that holds every CPU.
+//
+// CPUs are numbered as processor group * 64 + number within the group so a
+// number means the same thing on Windows and Linux.
+// ---------------------------------------------------------------------------
+
+class CNumaTopology
+{
+public:
+    CNumaTopology();
+
+    inline unsigned int NumNodes() const { return((unsigned int)m_NodeCpus.size()); }
+    inline unsigned int NumCpus() const { return(m_uNumCpus); }
+
+    // ---------------------------------------------------------------------------
+    // The OS node number and the CPUs of the node at index uNode.
+
+    inline int NodeNumber(unsigned int uNode) const { return(m_NodeNumbers[uNode]); }
+    inline const std::vector<unsigned int> & NodeCpus(unsigned int uNode) const { return(m_NodeCpus[uNode]); }
+
+    // ---------------------------------------------------------------------------
+    // Restricts the calling thread to a single CPU, or to all the CPUs of the
+    // node at index uNode. Returns false if the OS refused the request.
+
+    static bool PinToCpu(unsigned int uCpu);
+    bool PinToNode(unsigned int uNode) const;
+
+private:
+    static bool PinToCpus(const std::vector<unsigned int> & Cpus);
+
+    unsigned int m_uNumCpus;
+    std::vector<int> m_NodeNumbers;
+    std::vector< std::vector<unsigned int> > m_NodeCpus;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+inline CNumaTopology::CNumaTopology()
+{
+    m_uNumCpus = 0;
+
+    ULONG ulHighestNode = 0;
+    DWORD_PTR ProcessMask = 0;
+    DWORD_PTR SystemMask = 0;
+
+    GetNumaHighestNodeNumber(&ulHighestNode);
+
+    // The process affinity mask only describes the group the process runs
+    // in. It is zero when the process spans several groups.
+
+    GROUP_AFFINITY ThreadAffinity;
+    memset(&ThreadAffinity, 0, sizeof(ThreadAffinity));
+
+    GetProcessAffinityMask(GetCurrentProcess(), &ProcessMask, &SystemMask);
+    GetThreadGroupAffinity(GetCurrentThread(), &ThreadAffinity);
+
+    for (ULONG ulNode = 0; ulNode <= ulHighestNode; ulNode++)
+    {
+        GROUP_AFFINITY Affinity;
+
+        if (!GetNumaNodeProcessorMaskEx((USHORT)ulNode, &Affinity))
+        {
+            continue;
+        }
+
+        KAFFINITY Mask = Affinity.Mask;
+
+        if (ProcessMask != 0 && Affinity.Group == ThreadAffinity.Group)
+        {
+            Mask &= ProcessMask;
+        }
+
+        std::vector<unsigned int> Cpus;
+
+        for (unsigned int uBit = 0; uBit < sizeof(KAFFINITY) * 8; uBit++)
+        {
+            if (Mask & ((KAFFINITY)1 << uBit))
+            {
+                Cpus.push_back(Affinity.Group * 64 + uBit);
+            }
+        }
+
+        if (!Cpus.empty())
+        {
+            m_uNumCpus += (unsigned int)Cpus.size();
+            m_NodeNumbers.push_back((int)ulNode);
+            m_NodeCpus.push_back(Cpus);
+        }
+    }
+
+    if (m_NodeCpus.empty())
+    {
+        unsigned int uNumCpus = std::thread::hardware_concurrency();
+        m_uNumCpus = uNumCpus ? uNumCpus : 1;
+        m_NodeNumbers.push_back(0);
+        m_NodeCpus.push_back(std::vector<unsigned int>());
+
+        for (unsigned int uCpu = 0; uCpu < m_uNumCpus; uCpu++)
+        {
+            m_NodeCpus[0].push_back(uCpu);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// A thread can only be bound to CPUs of one processor group. Every CPU of a
+// node is in the same group, so the group of the first CPU is used.
+// ---------------------------------------------------------------------------
+
+inline bool CNumaTopology::PinToCpus(const std::vector<unsigned int> & Cpus)
+{
+    if (Cpus.empty())
+    {
+        return(false);
+    }
+
+    GROUP_AFFINITY Affinity;
+    memset(&Affinity, 0, sizeof(Affinity));
+    Affinity.Group = (WORD)(Cpus[0] / 64);
+
+    for (size_t uIdx = 0; uIdx < Cpus.size(); uIdx++)
+    {
+        if (Cpus[uIdx] / 64 == Affinity.Group)
+        {
+            Affinity.Mask |= (KAFFINITY)1 << (Cpus[uIdx] % 64);
+        }
+    }
+
+    return(SetThreadGroupAffinity(GetCurrentThread(), &Affinity, NULL) != FALSE);
+}
+
+#else
+
+// ---------------------------------------------------------------------------
+// Linux describes the nodes in sysfs. Each node directory has a cpulist file
+// with ranges such as "0-7,16-23".
+// ---------------------------------------------------------------------------
+
+inline CNumaTopology::CNumaTopology()
+{
+    m_uNumCpus = 0;
+
+    cpu_set_t Allowed;
+    CPU_ZERO(&Allowed);
+
+    bool bHaveAllowed = (sched_getaffinity(0, sizeof(Allowed), &Allowed) == 0);
+
+    // Node numbers can have holes, so we only give up after a long gap
+
+    for (int nNode = 0, nMissing = 0; nMissing < 64; nNode++)
+    {
+        char szPath[64];
+        snprintf(szPath, sizeof(szPath), "/sys/devices/system/node/node%d/cpulist", nNode);
+
+        FILE * pFile = fopen(szPath, "r");
+
+        if (pFile == NULL)
+        {
+            nMissing++;
+            continue;
+        }
+
+        nMissing = 0;
+
+        std::vector<unsigned int> Cpus;
+        unsigned int uFirst = 0;
+        unsigned int uLast = 0;
+        int nFields = 0;
+
+        while ((nFields = fscanf(pFile, "%u-%u", &uFirst, &uLast)) >= 1)
+        {
+            if (nFields == 1)
+            {
+                uLast = uFirst;
+            }
+
+            for (unsigned int uCpu = uFirst; uCpu <= uLast; uCpu++)
+            {
+                if (!bHaveAllowed || (uCpu < CPU_SETSIZE && CPU_ISSET(uCpu, &Allowed)))
+                {
+                    Cpus.push_back(uCpu);
+                }
+            }
+
+            if (fgetc(pFile) != ',')
+            {
+                break;
+            }
+        }
+
+        fclose(pFile);
+
+        if (!Cpus.empty())
+        {
+            m_uNumCpus += (unsigned int)Cpus.size();
+            m_NodeNumbers.push_back(nNode);
+            m_NodeCpus.push_back(Cpus);
+        }
+    }
+
+    if (m_NodeCpus.empty())
+    {
+        m_NodeNumbers.push_back(0);
+        m_NodeCpus.push_back(std::vector<unsigned int>());
+
+        for (unsigned int uCpu = 0; uCpu < CPU_SETSIZE; uCpu++)
+        {
+            if (bHaveAllowed ? CPU_ISSET(uCpu, &Allowed) : uCpu < std::thread::hardware_concurrency())
+            {
+                m_NodeCpus[0].push_back(uCpu);
+            }
+        }
+
+        if (m_NodeCpus[0].empty())
+        {
+            m_NodeCpus[0].push_back(0);
+        }
+
+        m_uNumCpus = (unsigned int)m_NodeCpus[0].size();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline bool CNumaTopology::PinToCpus(const std::vector<unsigned int> & Cpus)
+{
+    cpu_set_t Set;
+    CPU_ZERO(&Set);
+
+    for (size_t uIdx = 0; uIdx < Cpus.size(); uIdx++)
+    {
+        if (Cpus[uIdx] < CPU_SETSIZE)
+        {
+            CPU_SET(Cpus[uIdx], &Set);
+        }
+    }
+
+    return(CPU_COUNT(&Set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(Set), &Set) == 0);
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline bool CNumaTopology::PinToCpu(unsigned int uCpu)
+{
+    return(PinToCpus(std::vector<unsigned int>(1, uCpu)));
+}
+
+inline bool CNumaTopology::PinToNode(unsigned int uNode) const
+{
+    return(uNode < m_NodeCpus.size() && PinToCpus(m_NodeCpus[uNode]));
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CMatrix.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// A matrix that one writer keeps replacing while any number of readers use
+// it, without locks and without copying on the readers' side.
+//
+// The holder keeps a small ring of buffers. One of them is published; the
+// writer fills one of the others with BeginUpdate() and makes it the
+// published one with Publish(). A reader calls Snapshot() and gets the
+// buffer that was published at that moment. It stays unchanged for as long
+// as the reader holds the snapshot, even across later publishes. A buffer
+// is only handed to the writer again once every snapshot of it is gone.
+//
+// Taking and dropping a snapshot is one atomic add each, so readers never
+// wait for the writer or for each other. The writer waits only if every
+// unpublished buffer is still held by a reader, which more buffers avoid.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CPublishedMatrix
+{
+private:
+    struct CBuffer
+    {
+        CBuffer(const CMatrix<T> & Initial) : Matrix(Initial), nPending(0), ullVersion(0) {}
+
+        CMatrix<T> Matrix;
+
+        // Snapshots still held, less the ones counted when it was retired.
+        // Zero once a retired buffer has no readers left.
+
+        std::atomic<long long> nPending;
+        unsigned long long ullVersion;
+    };
+
+public:
+    // ---------------------------------------------------------------------------
+    // A reader's view of one published matrix. Move only; the buffer is
+    // released when the snapshot is destroyed.
+
+    class CSnapshot
+    {
+    public:
+        CSnapshot(CSnapshot && Other) : m_pBuffer(Other.m_pBuffer) { Other.m_pBuffer = NULL; }
+        ~CSnapshot() { Release(); }
+
+        CSnapshot & operator=(CSnapshot && Other)
+        {
+            if (this != &Other)
+            {
+                Release();
+                m_pBuffer = Other.m_pBuffer;
+                Other.m_pBuffer = NULL;
+            }
+
+            return(*this);
+        }
+
+        inline const CMatrix<T> & operator*() const { return(m_pBuffer->Matrix); }
+        inline const CMatrix<T> * operator->() const { return(&m_pBuffer->Matrix); }
+
+        // ---------------------------------------------------------------------------
+        // The number of publishes before this one, 0 for the initial matrix.
+
+        inline unsigned long long Version() const { return(m_pBuffer->ullVersion); }
+
+    private:
+        friend class CPublishedMatrix<T>;
+
+        explicit CSnapshot(CBuffer * pBuffer) : m_pBuffer(pBuffer) {}
+        CSnapshot(const CSnapshot &);
+        CSnapshot & operator=(const CSnapshot &);
+
+        void Release()
+        {
+            if (m_pBuffer)
+            {
+                m_pBuffer->nPending.fetch_sub(1, std::memory_order_release);
+                m_pBuffer = NULL;
+            }
+        }
+
+        CBuffer * m_pBuffer;
+    };
+
+    // ---------------------------------------------------------------------------
+    // Publishes Initial and sets aside uNumBuffers - 1 more buffers of the
+    // same size for the writer. At least two buffers are needed.
+
+    CPublishedMatrix(const CMatrix<T> & Initial, unsigned int uNumBuffers = 3);
+
+    // ---------------------------------------------------------------------------
+    // The published matrix. Safe to call from any thread at any time.
+
+    CSnapshot Snapshot() const;
+
+    // ---------------------------------------------------------------------------
+    // Writer side, for one thread at a time. BeginUpdate returns a buffer no
+    // reader can see, holding a copy of the published matrix when bCopy is
+    // true and the stale content of an older publish otherwise. Publish then
+    // makes it the published matrix. The writer may change its size.
+
+    CMatrix<T> & BeginUpdate(bool bCopy = true);
+    void Publish();
+
+    inline unsigned long long Version() const { return(m_ullVersion); }
+
+private:
+    CPublishedMatrix(const CPublishedMatrix &);
+    CPublishedMatrix & operator=(const CPublishedMatrix &);
+
+    // The published state is one word: the buffer index in the top bits
+    // and the number of snapshots taken of it in the rest. A reader takes
+    // a snapshot and learns which buffer it got with a single fetch_add,
+    // and the writer swaps in the next buffer and learns how many readers
+    // the old one had with a single exchange. The counter allows 2^48
+    // snapshots per publish.
+
+    static const unsigned int INDEX_SHIFT = 48;
+    static const unsigned long long COUNT_MASK = (1ULL << INDEX_SHIFT) - 1;
+
+    std::vector<std::unique_ptr<CBuffer>> m_Buffers;
+    mutable std::atomic<unsigned long long> m_ullPublished;
+    unsigned int m_uBack;
+    unsigned long long m_ullVersion;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CPublishedMatrix<T>::CPublishedMatrix(const CMatrix<T> & Initial, unsigned int uNumBuffers)
+{
+    if (uNumBuffers < 2 || uNumBuffers > 0xFFFF)
+    {
+        throw CAppException("A published matrix needs between 2 and 65535 buffers.");
+    }
+
+    for (unsigned int uBuffer = 0; uBuffer < uNumBuffers; uBuffer++)
+    {
+        m_Buffers.emplace_back(new CBuffer(Initial));
+    }
+
+    m_ullPublished.store(0);
+    m_uBack = uNumBuffers;
+    m_ullVersion = 0;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+typename CPublishedMatrix<T>::CSnapshot CPublishedMatrix<T>::Snapshot() const
+{
+    unsigned long long ullPublished = m_ullPublished.fetch_add(1, std::memory_order_acquire);
+
+    return(CSnapshot(m_Buffers[(unsigned int)(ullPublished >> INDEX_SHIFT)].get()));
+}
+
+// ---------------------------------------------------------------------------
+// The published buffer is never picked. Any other one is free once its
+// pending count is back to zero; buffers that were never published start
+// at zero. A reader that still holds a snapshot of a retired buffer keeps
+// it out of use, so the writer moves on to the next one and only spins
+// when all of them are held.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> & CPublishedMatrix<T>::BeginUpdate(bool bCopy)
+{
+    const unsigned int uNumBuffers = (unsigned int)m_Buffers.size();
+    const unsigned int uFront = (unsigned int)(m_ullPublished.load(std::memory_order_relaxed) >> INDEX_SHIFT);
+
+    if (m_uBack == uNumBuffers)
+    {
+        for (unsigned int uTry = 1; ; uTry++)
+        {
+            unsigned int uBuffer = (uFront + uTry) % uNumBuffers;
+
+            if (uBuffer != uFront && m_Buffers[uBuffer]->nPending.load(std::memory_order_acquire) == 0)
+            {
+                m_uBack = uBuffer;
+                break;
+            }
+
+            if (uTry % uNumBuffers == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        if (bCopy)
+        {
+            m_Buffers[m_uBack]->Matrix = m_Buffers[uFront]->Matrix;
+        }
+    }
+
+    return(m_Buffers[m_uBack]->Matrix);
+}
+
+// ---------------------------------------------------------------------------
+// The exchange releases the new content to the readers. The count it
+// returns is how many snapshots of the old buffer were taken; each of them
+// subtracts one when released, so the pending count reaches zero exactly
+// when the last of them is gone, whichever side gets there first.
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CPublishedMatrix<T>::Publish()
+{
+    if (m_uBack == m_Buffers.size())
+    {
+        throw CAppException("Publish must follow BeginUpdate.");
+    }
+
+    m_Buffers[m_uBack]->ullVersion = ++m_ullVersion;
+
+    unsigned long long ullOld = m_ullPublished.exchange((unsigned long long)m_uBack << INDEX_SHIFT, std::memory_order_acq_rel);
+
+    m_Buffers[(unsigned int)(ullOld >> INDEX_SHIFT)]->nPending.fetch_add((long long)(ullOld & COUNT_MASK), std::memory_order_relaxed);
+    m_uBack = (unsigned int)m_Buffers.size();
+}
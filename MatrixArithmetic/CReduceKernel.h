@@ -0,0 +1,353 @@
+#pragma once
+
+#include <stddef.h>
+
+// ---------------------------------------------------------------------------
+// How floating point sums are accumulated. Integer sums are exact with any
+// of them.
+// ---------------------------------------------------------------------------
+
+enum ESummation
+{
+    SumNaive,           // One pass, fastest, error grows with the element count
+    SumPairwise,        // Blocks added up in a binary tree, error grows with log2 of the count
+    SumKahan            // Compensated, error does not depend on the count
+};
+
+// ---------------------------------------------------------------------------
+// Reductions over a contiguous run of elements.
+//
+// Every loop keeps LANES independent accumulators that are updated with the
+// same operation on consecutive elements. There is no dependency between
+// the lanes, so the compiler turns them into SIMD registers without having
+// to reorder floating point additions, and the result does not depend on
+// whether the loop was vectorized. The lanes are combined at the end.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CReduceKernel
+{
+public:
+    // ---------------------------------------------------------------------------
+    // Sum of uCount elements.
+
+    static T Sum(const T * pData, size_t uCount, ESummation eMethod);
+
+    // ---------------------------------------------------------------------------
+    // Sum of the squares and of the absolute values, accumulated in double so
+    // integer elements cannot overflow.
+
+    static double SumSquares(const T * pData, size_t uCount);
+    static double SumAbs(const T * pData, size_t uCount);
+
+    // ---------------------------------------------------------------------------
+    // Index of the smallest or largest element. The first one wins a tie.
+    // uCount must not be zero.
+
+    static size_t MinIndex(const T * pData, size_t uCount);
+    static size_t MaxIndex(const T * pData, size_t uCount);
+
+    // ---------------------------------------------------------------------------
+    // pSum[n] += pRow[n], and the same with the absolute values of pRow
+    // accumulated in double. With pCompensation the addition is compensated
+    // (Kahan), each column keeping its own running error.
+
+    static void AddRow(T * pSum, const T * pRow, size_t uCount, T * pCompensation);
+    static void AddAbsRow(double * pSum, const T * pRow, size_t uCount);
+
+    // ---------------------------------------------------------------------------
+    // a + b with Kahan compensation carried in *pCompensation.
+
+    static inline T KahanAdd(T Sum, T Value, T * pCompensation)
+    {
+        T Corrected = Value - *pCompensation;
+        T NewSum = Sum + Corrected;
+        *pCompensation = (NewSum - Sum) - Corrected;
+        return(NewSum);
+    }
+
+private:
+    enum { LANES = 8, PAIRWISE_BLOCK = 128 };
+
+    static T SumLanes(const T * pData, size_t uCount);
+    static T PairwiseSum(const T * pData, size_t uCount);
+    static T CompensatedSum(const T * pData, size_t uCount);
+
+    static inline double Abs(T Value) { return(Value < T() ? -(double)Value : (double)Value); }
+
+    template <class Better>
+    static size_t BestIndex(const T * pData, size_t uCount, Better IsBetter);
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CReduceKernel<T>::Sum(const T * pData, size_t uCount, ESummation eMethod)
+{
+    switch (eMethod)
+    {
+    case SumPairwise:
+        return(PairwiseSum(pData, uCount));
+
+    case SumKahan:
+        return(CompensatedSum(pData, uCount));
+
+    default:
+        return(SumLanes(pData, uCount));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CReduceKernel<T>::SumLanes(const T * pData, size_t uCount)
+{
+    T Lanes[LANES];
+    size_t uIdx = 0;
+
+    for (size_t uLane = 0; uLane < LANES; uLane++)
+    {
+        Lanes[uLane] = T();
+    }
+
+    for (; uIdx + LANES <= uCount; uIdx += LANES)
+    {
+        for (size_t uLane = 0; uLane < LANES; uLane++)
+        {
+            Lanes[uLane] += pData[uIdx + uLane];
+        }
+    }
+
+    T Sum = ((Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3])) + ((Lanes[4] + Lanes[5]) + (Lanes[6] + Lanes[7]));
+
+    for (; uIdx < uCount; uIdx++)
+    {
+        Sum += pData[uIdx];
+    }
+
+    return(Sum);
+}
+
+// ---------------------------------------------------------------------------
+// The leaves are summed with the lane kernel, which is itself a shallow tree,
+// and the leaves are then added up in halves.
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CReduceKernel<T>::PairwiseSum(const T * pData, size_t uCount)
+{
+    if (uCount <= PAIRWISE_BLOCK)
+    {
+        return(SumLanes(pData, uCount));
+    }
+
+    // Split on a block boundary so the leaves stay full
+
+    size_t uHalf = ((uCount / PAIRWISE_BLOCK + 1) / 2) * PAIRWISE_BLOCK;
+
+    return(PairwiseSum(pData, uHalf) + PairwiseSum(pData + uHalf, uCount - uHalf));
+}
+
+// ---------------------------------------------------------------------------
+// Every lane runs its own compensated sum, then the lanes are combined with
+// one more compensated pass.
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CReduceKernel<T>::CompensatedSum(const T * pData, size_t uCount)
+{
+    T Lanes[LANES];
+    T Errors[LANES];
+    size_t uIdx = 0;
+
+    for (size_t uLane = 0; uLane < LANES; uLane++)
+    {
+        Lanes[uLane] = T();
+        Errors[uLane] = T();
+    }
+
+    for (; uIdx + LANES <= uCount; uIdx += LANES)
+    {
+        for (size_t uLane = 0; uLane < LANES; uLane++)
+        {
+            T Corrected = pData[uIdx + uLane] - Errors[uLane];
+            T NewSum = Lanes[uLane] + Corrected;
+            Errors[uLane] = (NewSum - Lanes[uLane]) - Corrected;
+            Lanes[uLane] = NewSum;
+        }
+    }
+
+    T Sum = T();
+    T Compensation = T();
+
+    for (size_t uLane = 0; uLane < LANES; uLane++)
+    {
+        Sum = KahanAdd(Sum, Lanes[uLane], &Compensation);
+        Sum = KahanAdd(Sum, -Errors[uLane], &Compensation);
+    }
+
+    for (; uIdx < uCount; uIdx++)
+    {
+        Sum = KahanAdd(Sum, pData[uIdx], &Compensation);
+    }
+
+    return(Sum);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+double CReduceKernel<T>::SumSquares(const T * pData, size_t uCount)
+{
+    double Lanes[LANES] = { 0 };
+    size_t uIdx = 0;
+
+    for (; uIdx + LANES <= uCount; uIdx += LANES)
+    {
+        for (size_t uLane = 0; uLane < LANES; uLane++)
+        {
+            double Value = (double)pData[uIdx + uLane];
+            Lanes[uLane] += Value * Value;
+        }
+    }
+
+    double Sum = ((Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3])) + ((Lanes[4] + Lanes[5]) + (Lanes[6] + Lanes[7]));
+
+    for (; uIdx < uCount; uIdx++)
+    {
+        double Value = (double)pData[uIdx];
+        Sum += Value * Value;
+    }
+
+    return(Sum);
+}
+
+template <class T>
+double CReduceKernel<T>::SumAbs(const T * pData, size_t uCount)
+{
+    double Lanes[LANES] = { 0 };
+    size_t uIdx = 0;
+
+    for (; uIdx + LANES <= uCount; uIdx += LANES)
+    {
+        for (size_t uLane = 0; uLane < LANES; uLane++)
+        {
+            Lanes[uLane] += Abs(pData[uIdx + uLane]);
+        }
+    }
+
+    double Sum = ((Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3])) + ((Lanes[4] + Lanes[5]) + (Lanes[6] + Lanes[7]));
+
+    for (; uIdx < uCount; uIdx++)
+    {
+        Sum += Abs(pData[uIdx]);
+    }
+
+    return(Sum);
+}
+
+// ---------------------------------------------------------------------------
+// Each lane tracks the best value it has seen and where. As the lanes walk
+// the data in order, a lane only moves on a strictly better value so it
+// keeps the first of equal values. The lowest index wins among the lanes.
+// ---------------------------------------------------------------------------
+
+template <class T>
+template <class Better>
+size_t CReduceKernel<T>::BestIndex(const T * pData, size_t uCount, Better IsBetter)
+{
+    size_t uBest = 0;
+    size_t uIdx = 0;
+
+    if (uCount >= LANES)
+    {
+        T Values[LANES];
+        size_t Indices[LANES];
+
+        for (size_t uLane = 0; uLane < LANES; uLane++)
+        {
+            Values[uLane] = pData[uLane];
+            Indices[uLane] = uLane;
+        }
+
+        for (uIdx = LANES; uIdx + LANES <= uCount; uIdx += LANES)
+        {
+            for (size_t uLane = 0; uLane < LANES; uLane++)
+            {
+                bool bBetter = IsBetter(pData[uIdx + uLane], Values[uLane]);
+                Values[uLane] = bBetter ? pData[uIdx + uLane] : Values[uLane];
+                Indices[uLane] = bBetter ? uIdx + uLane : Indices[uLane];
+            }
+        }
+
+        uBest = Indices[0];
+
+        for (size_t uLane = 1; uLane < LANES; uLane++)
+        {
+            if (IsBetter(Values[uLane], pData[uBest]) ||
+                (!IsBetter(pData[uBest], Values[uLane]) && Indices[uLane] < uBest))
+            {
+                uBest = Indices[uLane];
+            }
+        }
+    }
+
+    for (; uIdx < uCount; uIdx++)
+    {
+        if (IsBetter(pData[uIdx], pData[uBest]))
+        {
+            uBest = uIdx;
+        }
+    }
+
+    return(uBest);
+}
+
+template <class T>
+size_t CReduceKernel<T>::MinIndex(const T * pData, size_t uCount)
+{
+    return(BestIndex(pData, uCount, [](const T & a, const T & b) { return(a < b); }));
+}
+
+template <class T>
+size_t CReduceKernel<T>::MaxIndex(const T * pData, size_t uCount)
+{
+    return(BestIndex(pData, uCount, [](const T & a, const T & b) { return(b < a); }));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+void CReduceKernel<T>::AddRow(T * pSum, const T * pRow, size_t uCount, T * pCompensation)
+{
+    if (pCompensation == NULL)
+    {
+        for (size_t uIdx = 0; uIdx < uCount; uIdx++)
+        {
+            pSum[uIdx] += pRow[uIdx];
+        }
+
+        return;
+    }
+
+    for (size_t uIdx = 0; uIdx < uCount; uIdx++)
+    {
+        T Corrected = pRow[uIdx] - pCompensation[uIdx];
+        T NewSum = pSum[uIdx] + Corrected;
+        pCompensation[uIdx] = (NewSum - pSum[uIdx]) - Corrected;
+        pSum[uIdx] = NewSum;
+    }
+}
+
+template <class T>
+void CReduceKernel<T>::AddAbsRow(double * pSum, const T * pRow, size_t uCount)
+{
+    for (size_t uIdx = 0; uIdx < uCount; uIdx++)
+    {
+        pSum[uIdx] += Abs(pRow[uIdx]);
+    }
+}
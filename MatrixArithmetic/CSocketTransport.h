@@ -0,0 +1,432 @@
+#pragma once
+
+// ---------------------------------------------------------------------------
+// Transport between processes on the same host using UNIX domain sockets.
+// Every pair of ranks is connected by its own stream socket, so messages
+// between two ranks arrive in the order they were sent.
+//
+// The ranks can either be forked from a common parent (RunProcesses) or be
+// started independently and find each other through socket files in a
+// shared directory.
+//
+// UNIX domain sockets are not available with the Windows SDK this project
+// targets, so on Windows the distributed code runs on CLocalTransport.
+// ---------------------------------------------------------------------------
+
+#ifndef _WIN32
+
+#include "CMatrixTransport.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+class CSocketTransport : public CMatrixTransport
+{
+public:
+    // ---------------------------------------------------------------------------
+    // Wraps already connected sockets. Sockets[n] is connected to rank n and
+    // the entry for our own rank is ignored. The sockets are closed when the
+    // transport is destroyed.
+
+    CSocketTransport(int nRank, const std::vector<int> & Sockets);
+
+    // ---------------------------------------------------------------------------
+    // Rendezvous through socket files in strDirectory. Each rank listens on
+    // "rank<N>.sock", accepts connections from the higher ranks and connects
+    // to the lower ones. Blocks until all nSize ranks are connected.
+
+    CSocketTransport(const string & strDirectory, int nRank, int nSize);
+
+    ~CSocketTransport();
+
+    // ---------------------------------------------------------------------------
+    // Forks nSize child processes that are fully connected with socket pairs
+    // and runs Worker in each of them. Waits for every child to exit and
+    // throws if any of them failed.
+    //
+    // A child only has a copy of the thread that called this. CThreadPool
+    // starts its workers again in the child, but any other thread of the
+    // caller is simply missing there, along with whatever locks it held.
+    // Call this before starting threads of your own, or from a process that
+    // has none.
+
+    static void RunProcesses(int nSize, const std::function<void(CMatrixTransport &)> & Worker);
+
+    inline virtual int Rank() const { return(m_nRank); }
+    inline virtual int Size() const { return((int)m_Sockets.size()); }
+
+    virtual void Send(int nDest, const void * pData, size_t cbSize);
+    virtual void Receive(int nSource, void * pData, size_t cbSize);
+
+private:
+    CSocketTransport(const CSocketTransport &);
+    CSocketTransport & operator=(const CSocketTransport &);
+
+    static void WriteAll(int nSocket, const void * pData, size_t cbSize);
+    static void ReadAll(int nSocket, void * pData, size_t cbSize);
+    static sockaddr_un SocketAddress(const string & strDirectory, int nRank);
+
+    int m_nRank;
+    std::vector<int> m_Sockets;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CSocketTransport::CSocketTransport(int nRank, const std::vector<int> & Sockets)
+{
+    if (nRank < 0 || nRank >= (int)Sockets.size())
+    {
+        throw CAppException("Rank out of range");
+    }
+
+    m_nRank = nRank;
+    m_Sockets = Sockets;
+    m_Sockets[nRank] = -1;
+}
+
+// ---------------------------------------------------------------------------
+// The rank number is sent as the first message of every connection so the
+// accepting side knows which peer it is talking to.
+// ---------------------------------------------------------------------------
+
+inline CSocketTransport::CSocketTransport(const string & strDirectory, int nRank, int nSize)
+{
+    if (nRank < 0 || nRank >= nSize)
+    {
+        throw CAppException("Rank out of range");
+    }
+
+    m_nRank = nRank;
+    m_Sockets.assign(nSize, -1);
+
+    int nListener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un Address = SocketAddress(strDirectory, nRank);
+
+    unlink(Address.sun_path);
+
+    if (nListener < 0 ||
+        bind(nListener, (sockaddr *)&Address, sizeof(Address)) != 0 ||
+        listen(nListener, nSize) != 0)
+    {
+        if (nListener >= 0)
+        {
+            close(nListener);
+        }
+
+        throw CAppException("Unable to listen on " + string(Address.sun_path));
+    }
+
+    try
+    {
+        for (int nPeer = 0; nPeer < nRank; nPeer++)
+        {
+            sockaddr_un PeerAddress = SocketAddress(strDirectory, nPeer);
+            int nSocket = -1;
+
+            // The peer may not have created its socket file yet
+
+            for (int nAttempt = 0; nSocket < 0; nAttempt++)
+            {
+                nSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+                if (connect(nSocket, (sockaddr *)&PeerAddress, sizeof(PeerAddress)) != 0)
+                {
+                    close(nSocket);
+                    nSocket = -1;
+
+                    if (nAttempt == 1000)
+                    {
+                        throw CAppException("Unable to connect to " + string(PeerAddress.sun_path));
+                    }
+
+                    usleep(10000);
+                }
+            }
+
+            m_Sockets[nPeer] = nSocket;
+
+            int32_t nMyRank = nRank;
+            WriteAll(nSocket, &nMyRank, sizeof(nMyRank));
+        }
+
+        for (int nAccepted = nRank + 1; nAccepted < nSize; nAccepted++)
+        {
+            int nSocket = accept(nListener, NULL, NULL);
+
+            if (nSocket < 0)
+            {
+                throw CAppException("Accepting a peer connection failed.");
+            }
+
+            int32_t nPeerRank = -1;
+            ReadAll(nSocket, &nPeerRank, sizeof(nPeerRank));
+
+            if (nPeerRank <= nRank || nPeerRank >= nSize || m_Sockets[nPeerRank] >= 0)
+            {
+                close(nSocket);
+                throw CAppException("Unexpected peer connection.");
+            }
+
+            m_Sockets[nPeerRank] = nSocket;
+        }
+    }
+    catch (...)
+    {
+        close(nListener);
+        unlink(Address.sun_path);
+
+        for (size_t uIdx = 0; uIdx < m_Sockets.size(); uIdx++)
+        {
+            if (m_Sockets[uIdx] >= 0)
+            {
+                close(m_Sockets[uIdx]);
+            }
+        }
+
+        throw;
+    }
+
+    close(nListener);
+    unlink(Address.sun_path);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CSocketTransport::~CSocketTransport()
+{
+    for (size_t uIdx = 0; uIdx < m_Sockets.size(); uIdx++)
+    {
+        if (m_Sockets[uIdx] >= 0)
+        {
+            close(m_Sockets[uIdx]);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// All socket pairs are created before forking. Each child then closes the
+// ends that belong to the other ranks.
+// ---------------------------------------------------------------------------
+
+inline void CSocketTransport::RunProcesses(int nSize, const std::function<void(CMatrixTransport &)> & Worker)
+{
+    if (nSize <= 0)
+    {
+        throw CAppException("At least one rank is needed.");
+    }
+
+    // Mesh[a * nSize + b] is the end rank a uses to talk to rank b
+
+    std::vector<int> Mesh(nSize * nSize, -1);
+
+    for (int nRankA = 0; nRankA < nSize; nRankA++)
+    {
+        for (int nRankB = nRankA + 1; nRankB < nSize; nRankB++)
+        {
+            int Pair[2];
+
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+            {
+                throw CAppException("Unable to create a socket pair.");
+            }
+
+            Mesh[nRankA * nSize + nRankB] = Pair[0];
+            Mesh[nRankB * nSize + nRankA] = Pair[1];
+        }
+    }
+
+    fflush(stdout);
+    std::vector<pid_t> Children;
+
+    for (int nRank = 0; nRank < nSize; nRank++)
+    {
+        pid_t Pid = fork();
+
+        if (Pid == 0)
+        {
+            int nExitCode = 0;
+
+            for (int nIdx = 0; nIdx < nSize * nSize; nIdx++)
+            {
+                if (nIdx / nSize != nRank && Mesh[nIdx] >= 0)
+                {
+                    close(Mesh[nIdx]);
+                }
+            }
+
+            try
+            {
+                CSocketTransport Transport(nRank, std::vector<int>(Mesh.begin() + nRank * nSize, Mesh.begin() + (nRank + 1) * nSize));
+                Worker(Transport);
+            }
+            catch (exception & ex)
+            {
+                fprintf(stderr, "Rank %d: %s\n", nRank, ex.what());
+                nExitCode = 1;
+            }
+            catch (...)
+            {
+                fprintf(stderr, "Rank %d: Unknown exception\n", nRank);
+                nExitCode = 1;
+            }
+
+            fflush(stdout);
+            _exit(nExitCode);
+        }
+        else if (Pid < 0)
+        {
+            fprintf(stderr, "Unable to start rank %d\n", nRank);
+        }
+        else
+        {
+            Children.push_back(Pid);
+        }
+    }
+
+    for (size_t uIdx = 0; uIdx < Mesh.size(); uIdx++)
+    {
+        if (Mesh[uIdx] >= 0)
+        {
+            close(Mesh[uIdx]);
+        }
+    }
+
+    bool bFailed = (int)Children.size() != nSize;
+
+    for (size_t uIdx = 0; uIdx < Children.size(); uIdx++)
+    {
+        int nStatus = 0;
+
+        if (waitpid(Children[uIdx], &nStatus, 0) < 0 || !WIFEXITED(nStatus) || WEXITSTATUS(nStatus) != 0)
+        {
+            bFailed = true;
+        }
+    }
+
+    if (bFailed)
+    {
+        throw CAppException("One or more ranks failed.");
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Every message is preceded by its length so a mismatch between the sender
+// and the receiver is detected instead of corrupting the stream.
+// ---------------------------------------------------------------------------
+
+inline void CSocketTransport::Send(int nDest, const void * pData, size_t cbSize)
+{
+    if (nDest < 0 || nDest >= Size() || nDest == m_nRank)
+    {
+        throw CAppException("Destination rank out of range");
+    }
+
+    uint64_t uLength = cbSize;
+    WriteAll(m_Sockets[nDest], &uLength, sizeof(uLength));
+    WriteAll(m_Sockets[nDest], pData, cbSize);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CSocketTransport::Receive(int nSource, void * pData, size_t cbSize)
+{
+    if (nSource < 0 || nSource >= Size() || nSource == m_nRank)
+    {
+        throw CAppException("Source rank out of range");
+    }
+
+    uint64_t uLength = 0;
+    ReadAll(m_Sockets[nSource], &uLength, sizeof(uLength));
+
+    if (uLength != cbSize)
+    {
+        throw CAppException("Received message has an unexpected size.");
+    }
+
+    ReadAll(m_Sockets[nSource], pData, cbSize);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CSocketTransport::WriteAll(int nSocket, const void * pData, size_t cbSize)
+{
+    const char * pBytes = static_cast<const char *>(pData);
+
+    while (cbSize)
+    {
+        ssize_t cbSent = send(nSocket, pBytes, cbSize, MSG_NOSIGNAL);
+
+        if (cbSent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (cbSent <= 0)
+        {
+            throw CAppException("Sending to a peer failed.");
+        }
+
+        pBytes += cbSent;
+        cbSize -= cbSent;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CSocketTransport::ReadAll(int nSocket, void * pData, size_t cbSize)
+{
+    char * pBytes = static_cast<char *>(pData);
+
+    while (cbSize)
+    {
+        ssize_t cbRead = recv(nSocket, pBytes, cbSize, 0);
+
+        if (cbRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (cbRead <= 0)
+        {
+            throw CAppException("Receiving from a peer failed.");
+        }
+
+        pBytes += cbRead;
+        cbSize -= cbRead;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline sockaddr_un CSocketTransport::SocketAddress(const string & strDirectory, int nRank)
+{
+    string strPath = strDirectory + "/rank" + std::to_string(nRank) + ".sock";
+
+    sockaddr_un Address;
+    memset(&Address, 0, sizeof(Address));
+    Address.sun_family = AF_UNIX;
+
+    if (strPath.size() >= sizeof(Address.sun_path))
+    {
+        throw CAppException("Socket path is too long: " + strPath);
+    }
+
+    memcpy(Address.sun_path, strPath.c_str(), strPath.size());
+    return(Address);
+}
+
+#endif // _WIN32
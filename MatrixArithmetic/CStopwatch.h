@@ -1,20 +1,21 @@
 #pragma once
 
-#include <time.h>
+#include <chrono>
 
+// ---------------------------------------------------------------------------
+// Measures elapsed wall clock time. clock() cannot be used for this as on
+// some platforms it reports the CPU time of the process, which grows with
+// the number of threads instead of shrinking.
+// ---------------------------------------------------------------------------
 
 class CStopwatch
 {
 public:
-    inline CStopwatch() { m_Time = 0; }
-    inline void Start() { m_Time = clock(); }
+    inline CStopwatch() { m_Start = std::chrono::steady_clock::now(); }
+    inline void Start() { m_Start = std::chrono::steady_clock::now(); }
 
-    // warning C4244: 'return': conversion from 'clock_t' to 'float', possible loss of data
-#pragma warning( push )
-#pragma warning( disable : 4244)
-    inline float Stop() { return((clock() - m_Time) / CLOCKS_PER_SEC); }
-#pragma warning( pop ) 
+    inline float Stop() { return(std::chrono::duration<float>(std::chrono::steady_clock::now() - m_Start).count()); }
 
 private:
-    clock_t m_Time;
-};
\ No newline at end of file
+    std::chrono::steady_clock::time_point m_Start;
+};
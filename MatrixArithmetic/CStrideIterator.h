@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+// ---------------------------------------------------------------------------
+// A random access iterator that steps over every n-th element of an array,
+// used to walk a column of a row major matrix. Iterators are only
+// comparable when they walk the same column. T is const qualified for a
+// read only iterator, and a mutable iterator converts to the const one.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CStrideIterator
+{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef typename std::remove_const<T>::type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T * pointer;
+    typedef T & reference;
+
+    CStrideIterator() : m_pFirst(NULL), m_nStride(1), m_nIndex(0) {}
+    CStrideIterator(T * pFirst, difference_type nStride, difference_type nIndex = 0) : m_pFirst(pFirst), m_nStride(nStride), m_nIndex(nIndex) {}
+
+    template <class U, class = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    CStrideIterator(const CStrideIterator<U> & Other) : m_pFirst(Other.First()), m_nStride(Other.Stride()), m_nIndex(Other.Index()) {}
+
+    inline T * First() const { return(m_pFirst); }
+    inline difference_type Stride() const { return(m_nStride); }
+    inline difference_type Index() const { return(m_nIndex); }
+
+    reference operator*() const { return(m_pFirst[m_nIndex * m_nStride]); }
+    pointer operator->() const { return(&m_pFirst[m_nIndex * m_nStride]); }
+    reference operator[](difference_type nOffset) const { return(m_pFirst[(m_nIndex + nOffset) * m_nStride]); }
+
+    CStrideIterator & operator++() { m_nIndex++; return(*this); }
+    CStrideIterator & operator--() { m_nIndex--; return(*this); }
+    CStrideIterator operator++(int) { CStrideIterator Old(*this); m_nIndex++; return(Old); }
+    CStrideIterator operator--(int) { CStrideIterator Old(*this); m_nIndex--; return(Old); }
+
+    CStrideIterator & operator+=(difference_type nOffset) { m_nIndex += nOffset; return(*this); }
+    CStrideIterator & operator-=(difference_type nOffset) { m_nIndex -= nOffset; return(*this); }
+    CStrideIterator operator+(difference_type nOffset) const { return(CStrideIterator(m_pFirst, m_nStride, m_nIndex + nOffset)); }
+    CStrideIterator operator-(difference_type nOffset) const { return(CStrideIterator(m_pFirst, m_nStride, m_nIndex - nOffset)); }
+    friend CStrideIterator operator+(difference_type nOffset, const CStrideIterator & It) { return(It + nOffset); }
+
+    difference_type operator-(const CStrideIterator & Other) const { return(m_nIndex - Other.m_nIndex); }
+
+    bool operator==(const CStrideIterator & Other) const { return(m_nIndex == Other.m_nIndex); }
+    bool operator!=(const CStrideIterator & Other) const { return(m_nIndex != Other.m_nIndex); }
+    bool operator<(const CStrideIterator & Other) const { return(m_nIndex < Other.m_nIndex); }
+    bool operator>(const CStrideIterator & Other) const { return(m_nIndex > Other.m_nIndex); }
+    bool operator<=(const CStrideIterator & Other) const { return(m_nIndex <= Other.m_nIndex); }
+    bool operator>=(const CStrideIterator & Other) const { return(m_nIndex >= Other.m_nIndex); }
+
+private:
+    // The position is kept as an index from the first element so that the
+    // end of a column never forms a pointer past the end of the array.
+
+    T * m_pFirst;
+    difference_type m_nStride;
+    difference_type m_nIndex;
+};
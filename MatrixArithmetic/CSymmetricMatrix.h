@@ -0,0 +1,174 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CGemmKernel.h"
+#include "CMatrix.h"
+#include <algorithm>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// A square matrix equal to its transpose. Only the lower triangle is kept,
+// packed row by row the same way as a lower CTriangularMatrix, so it takes
+// n * (n + 1) / 2 elements instead of n * n. Setting an element sets its
+// mirror image as well.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CSymmetricMatrix
+{
+public:
+    // ---------------------------------------------------------------------------
+    // pPacked holds the lower triangle, n * (n + 1) / 2 elements row by row,
+    // or is NULL for a zero matrix.
+
+    CSymmetricMatrix(unsigned int uSize, const T * pPacked = NULL);
+
+    // ---------------------------------------------------------------------------
+    // Takes the lower triangle of a square matrix, the upper one is ignored.
+
+    explicit CSymmetricMatrix(const CMatrix<T> & Matrix);
+
+    inline unsigned int Size() const { return(m_uSize); }
+
+    T GetAt(unsigned int uRow, unsigned int uCol) const;
+    void SetAt(unsigned int uRow, unsigned int uCol, T Element);
+
+    CMatrix<T> ToMatrix() const;
+
+    // ---------------------------------------------------------------------------
+    // this * Matrix
+
+    CMatrix<T> operator*(const CMatrix<T> & Matrix) const;
+
+private:
+    static size_t Offset(unsigned int uRow, unsigned int uCol)
+    {
+        return((uCol <= uRow) ? (size_t)uRow * (uRow + 1) / 2 + uCol : (size_t)uCol * (uCol + 1) / 2 + uRow);
+    }
+
+    unsigned int m_uSize;
+    std::vector<T> m_Elements;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CSymmetricMatrix<T>::CSymmetricMatrix(unsigned int uSize, const T * pPacked)
+{
+    size_t uCount = (size_t)uSize * (uSize + 1) / 2;
+
+    m_uSize = uSize;
+
+    if (pPacked)
+    {
+        m_Elements.assign(pPacked, pPacked + uCount);
+    }
+    else
+    {
+        m_Elements.assign(uCount, T());
+    }
+}
+
+template <class T>
+CSymmetricMatrix<T>::CSymmetricMatrix(const CMatrix<T> & Matrix)
+{
+    if (Matrix.m_uRows != Matrix.m_uColumns)
+    {
+        throw CAppException("A symmetric matrix must be square.");
+    }
+
+    m_uSize = Matrix.m_uRows;
+    m_Elements.resize((size_t)m_uSize * (m_uSize + 1) / 2);
+
+    for (unsigned int uRow = 0; uRow < m_uSize; uRow++)
+    {
+        const T * pSource = &Matrix.m_pMatrix[(size_t)uRow * m_uSize];
+
+        std::copy(pSource, pSource + uRow + 1, &m_Elements[Offset(uRow, 0)]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+T CSymmetricMatrix<T>::GetAt(unsigned int uRow, unsigned int uCol) const
+{
+    if (uRow >= m_uSize || uCol >= m_uSize)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    return(m_Elements[Offset(uRow, uCol)]);
+}
+
+template <class T>
+void CSymmetricMatrix<T>::SetAt(unsigned int uRow, unsigned int uCol, T Element)
+{
+    if (uRow >= m_uSize || uCol >= m_uSize)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    m_Elements[Offset(uRow, uCol)] = Element;
+}
+
+template <class T>
+CMatrix<T> CSymmetricMatrix<T>::ToMatrix() const
+{
+    CMatrix<T> Matrix(m_uSize, m_uSize, typename CMatrix<T>::CUninitialized());
+
+    for (unsigned int uRow = 0; uRow < m_uSize; uRow++)
+    {
+        for (unsigned int uCol = 0; uCol < m_uSize; uCol++)
+        {
+            Matrix.m_pMatrix[(size_t)uRow * m_uSize + uCol] = m_Elements[Offset(uRow, uCol)];
+        }
+    }
+
+    return(Matrix);
+}
+
+// ---------------------------------------------------------------------------
+// Row n of the symmetric matrix is row n of the stored triangle up to the
+// diagonal, then column n of the triangle below it. Each worker builds its
+// own rows of the product from both parts, so no two workers ever write to
+// the same row. The column part is read with a stride, one element per row
+// update of the product.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CSymmetricMatrix<T>::operator*(const CMatrix<T> & Matrix) const
+{
+    if (Matrix.m_uRows != m_uSize)
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const unsigned int uCols = Matrix.m_uColumns;
+    unsigned long long ullWork = (unsigned long long)m_uSize * m_uSize * uCols;
+    CMatrix<T> Product(m_uSize, uCols);
+
+    CMatrix<T>::ForEachRowChunk(m_uSize, ullWork, CMatrix<T>::ParallelMultiplyAdds(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            const T * pRow = &m_Elements[Offset(uRow, 0)];
+            T * pDest = &Product.m_pMatrix[(size_t)uRow * uCols];
+
+            for (unsigned int uDot = 0; uDot <= uRow; uDot++)
+            {
+                CGemmKernel<T>::MultiplyAddRow(uCols, pRow[uDot], &Matrix.m_pMatrix[(size_t)uDot * uCols], pDest);
+            }
+
+            for (unsigned int uDot = uRow + 1; uDot < m_uSize; uDot++)
+            {
+                CGemmKernel<T>::MultiplyAddRow(uCols, m_Elements[Offset(uDot, uRow)], &Matrix.m_pMatrix[(size_t)uDot * uCols], pDest);
+            }
+        }
+    });
+
+    return(Product);
+}
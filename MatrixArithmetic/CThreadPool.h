@@ -0,0 +1,514 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CNumaTopology.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// How the worker threads are tied to the CPUs of the host.
+// ---------------------------------------------------------------------------
+
+enum EThreadAffinity
+{
+    AffinityNone,       // The OS scheduler is free to move the workers around
+    AffinityNode,       // Each worker may run on any CPU of its own NUMA node
+    AffinityCpu         // Each worker is bound to a single CPU
+};
+
+// ---------------------------------------------------------------------------
+// The worker threads used by the parallel matrix kernels.
+//
+// Work is split statically: ParallelFor always hands the same part of a
+// range to the same worker. Workers are numbered node by node, so worker 0
+// up to some worker k run on the first NUMA node, the next ones on the
+// second node and so on. Together with first-touch placement of the matrix
+// memory (NumaFirstTouch, see CMatrixMemory) this means every worker mostly
+// reads and writes memory that is attached to its own node.
+//
+// A process forked from one that uses the pool gets a copy of the pool but
+// none of its worker threads. The child leaves that copy alone and gets a
+// new pool the first time it needs one, with the same number of workers
+// and the same affinity. A fork waits for a parallel call that is running
+// on another thread to finish; forking from inside a call on one of the
+// workers is not supported.
+// ---------------------------------------------------------------------------
+
+class CThreadPool
+{
+public:
+    // ---------------------------------------------------------------------------
+    // The pool shared by all matrices. It starts with one unpinned worker per
+    // CPU the first time it is used.
+
+    static CThreadPool & Instance();
+
+    ~CThreadPool();
+
+    // ---------------------------------------------------------------------------
+    // Restarts the workers with new settings. A uNumWorkers of zero means one
+    // worker per available CPU. Memory placed by first touch keeps its place,
+    // so it is best to configure the pool before allocating large matrices.
+
+    void Configure(unsigned int uNumWorkers, EThreadAffinity eAffinity);
+
+    inline unsigned int NumWorkers() const { return((unsigned int)m_WorkerNodes.size()); }
+    inline EThreadAffinity Affinity() const { return(m_eAffinity); }
+    inline const CNumaTopology & Topology() const { return(m_Topology); }
+
+    // ---------------------------------------------------------------------------
+    // Index of the topology node a worker is assigned to, and the range of
+    // workers assigned to a node.
+
+    inline unsigned int WorkerNode(unsigned int uWorker) const { return(m_WorkerNodes[uWorker]); }
+    unsigned int NodeFirstWorker(unsigned int uNode) const;
+    unsigned int NodeWorkerCount(unsigned int uNode) const;
+
+    // ---------------------------------------------------------------------------
+    // Runs Body once on every worker and waits for all of them. The first
+    // exception thrown by Body is rethrown on the calling thread.
+
+    void RunOnWorkers(const std::function<void(unsigned int uWorker)> & Body);
+
+    // ---------------------------------------------------------------------------
+    // Splits [0, uCount) into NumWorkers() contiguous chunks and runs Body on
+    // each non-empty chunk. Chunk n always goes to worker n. When called from
+    // a worker the whole range is processed inline on that worker.
+
+    void ParallelFor(unsigned int uCount, const std::function<void(unsigned int uBegin, unsigned int uEnd)> & Body);
+
+    // ---------------------------------------------------------------------------
+    // The part of [0, uCount) that chunk uChunk of uNumChunks covers.
+
+    static void ChunkRange(unsigned int uCount, unsigned int uChunk, unsigned int uNumChunks, unsigned int * puBegin, unsigned int * puEnd);
+
+    // ---------------------------------------------------------------------------
+    // True on the pool's own worker threads.
+
+    static bool InWorker();
+
+private:
+    CThreadPool(unsigned int uNumWorkers, EThreadAffinity eAffinity);
+    CThreadPool(const CThreadPool &);
+    CThreadPool & operator=(const CThreadPool &);
+
+    void Start(unsigned int uNumWorkers);
+    void Stop();
+    void WorkerMain(unsigned int uWorker, unsigned int uCpu, unsigned long long ullSeen);
+
+    static bool & InWorkerFlag();
+
+    // ---------------------------------------------------------------------------
+    // The current pool and the settings a forked child gives its new pool.
+
+    struct CInstance
+    {
+        std::mutex m_Lock;
+        std::atomic<CThreadPool *> m_pPool;
+        std::unique_ptr<CThreadPool> m_pOwned;
+        unsigned int m_uNumWorkers;
+        EThreadAffinity m_eAffinity;
+        bool m_bForkHandlers;
+    };
+
+    static CInstance & InstanceState();
+
+    static void BeforeFork();
+    static void AfterForkInParent();
+    static void AfterForkInChild();
+
+    CNumaTopology m_Topology;
+    EThreadAffinity m_eAffinity;
+    std::vector<unsigned int> m_WorkerNodes;
+    std::vector<std::thread> m_Threads;
+
+    // Only one parallel call runs at a time
+
+    std::mutex m_RunLock;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Done;
+    const std::function<void(unsigned int)> * m_pJob;
+    unsigned long long m_ullGeneration;
+    unsigned int m_uPending;
+    bool m_bStop;
+    std::exception_ptr m_pError;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline CThreadPool::CInstance & CThreadPool::InstanceState()
+{
+    static CInstance State = { {}, { NULL }, {}, 0, AffinityNone, false };
+    return(State);
+}
+
+inline CThreadPool & CThreadPool::Instance()
+{
+    CInstance & State = InstanceState();
+    CThreadPool * pPool = State.m_pPool.load(std::memory_order_acquire);
+
+    if (pPool == NULL)
+    {
+        std::lock_guard<std::mutex> Guard(State.m_Lock);
+        pPool = State.m_pPool.load(std::memory_order_relaxed);
+
+        if (pPool == NULL)
+        {
+            State.m_pOwned.reset(new CThreadPool(State.m_uNumWorkers, State.m_eAffinity));
+            pPool = State.m_pOwned.get();
+            State.m_pPool.store(pPool, std::memory_order_release);
+        }
+
+#ifndef _WIN32
+        if (!State.m_bForkHandlers)
+        {
+            pthread_atfork(&CThreadPool::BeforeFork, &CThreadPool::AfterForkInParent, &CThreadPool::AfterForkInChild);
+            State.m_bForkHandlers = true;
+        }
+#endif
+    }
+
+    return(*pPool);
+}
+
+inline CThreadPool::CThreadPool(unsigned int uNumWorkers, EThreadAffinity eAffinity)
+{
+    m_eAffinity = eAffinity;
+    m_pJob = NULL;
+    m_ullGeneration = 0;
+    m_uPending = 0;
+    m_bStop = false;
+
+    Start(uNumWorkers);
+}
+
+inline CThreadPool::~CThreadPool()
+{
+    Stop();
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline bool & CThreadPool::InWorkerFlag()
+{
+    static thread_local bool bInWorker = false;
+    return(bInWorker);
+}
+
+inline bool CThreadPool::InWorker()
+{
+    return(InWorkerFlag());
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CThreadPool::Configure(unsigned int uNumWorkers, EThreadAffinity eAffinity)
+{
+    if (InWorker())
+    {
+        throw CAppException("The thread pool cannot be configured from one of its workers.");
+    }
+
+    std::lock_guard<std::mutex> RunGuard(m_RunLock);
+
+    Stop();
+    m_eAffinity = eAffinity;
+    Start(uNumWorkers);
+}
+
+// ---------------------------------------------------------------------------
+// The CPUs of all nodes are laid out one node after the other and the
+// workers are spread evenly over that list. Each node therefore gets a
+// share of the workers proportional to its number of CPUs, and the worker
+// numbers grow node by node.
+// ---------------------------------------------------------------------------
+
+inline void CThreadPool::Start(unsigned int uNumWorkers)
+{
+    std::vector<unsigned int> Cpus;
+    std::vector<unsigned int> CpuNodes;
+
+    for (unsigned int uNode = 0; uNode < m_Topology.NumNodes(); uNode++)
+    {
+        const std::vector<unsigned int> & NodeCpus = m_Topology.NodeCpus(uNode);
+
+        Cpus.insert(Cpus.end(), NodeCpus.begin(), NodeCpus.end());
+        CpuNodes.insert(CpuNodes.end(), NodeCpus.size(), uNode);
+    }
+
+    if (uNumWorkers == 0)
+    {
+        uNumWorkers = (unsigned int)Cpus.size();
+    }
+
+    m_bStop = false;
+    m_WorkerNodes.resize(uNumWorkers);
+
+    for (unsigned int uWorker = 0; uWorker < uNumWorkers; uWorker++)
+    {
+        size_t uSlot = ((size_t)uWorker * Cpus.size() / uNumWorkers) % Cpus.size();
+        m_WorkerNodes[uWorker] = CpuNodes[uSlot];
+    }
+
+    for (unsigned int uWorker = 0; uWorker < uNumWorkers; uWorker++)
+    {
+        size_t uSlot = ((size_t)uWorker * Cpus.size() / uNumWorkers) % Cpus.size();
+        m_Threads.push_back(std::thread(&CThreadPool::WorkerMain, this, uWorker, Cpus[uSlot], m_ullGeneration));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> Guard(m_Lock);
+        m_bStop = true;
+    }
+
+    m_Wake.notify_all();
+
+    for (size_t uIdx = 0; uIdx < m_Threads.size(); uIdx++)
+    {
+        m_Threads[uIdx].join();
+    }
+
+    m_Threads.clear();
+    m_WorkerNodes.clear();
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline unsigned int CThreadPool::NodeFirstWorker(unsigned int uNode) const
+{
+    unsigned int uWorker = 0;
+
+    while (uWorker < m_WorkerNodes.size() && m_WorkerNodes[uWorker] < uNode)
+    {
+        uWorker++;
+    }
+
+    return(uWorker);
+}
+
+inline unsigned int CThreadPool::NodeWorkerCount(unsigned int uNode) const
+{
+    unsigned int uCount = 0;
+
+    for (size_t uIdx = 0; uIdx < m_WorkerNodes.size(); uIdx++)
+    {
+        if (m_WorkerNodes[uIdx] == uNode)
+        {
+            uCount++;
+        }
+    }
+
+    return(uCount);
+}
+
+// ---------------------------------------------------------------------------
+// Each worker waits for the job generation to change, runs its part of the
+// job and the last one to finish wakes up the caller. ullSeen is the
+// generation at the time the worker was started.
+// ---------------------------------------------------------------------------
+
+inline void CThreadPool::WorkerMain(unsigned int uWorker, unsigned int uCpu, unsigned long long ullSeen)
+{
+    InWorkerFlag() = true;
+
+    if (m_eAffinity == AffinityCpu)
+    {
+        CNumaTopology::PinToCpu(uCpu);
+    }
+    else if (m_eAffinity == AffinityNode)
+    {
+        m_Topology.PinToNode(m_WorkerNodes[uWorker]);
+    }
+
+    for (;;)
+    {
+        const std::function<void(unsigned int)> * pJob = NULL;
+
+        {
+            std::unique_lock<std::mutex> Guard(m_Lock);
+            m_Wake.wait(Guard, [&]() { return(m_bStop || m_ullGeneration != ullSeen); });
+
+            if (m_bStop)
+            {
+                return;
+            }
+
+            ullSeen = m_ullGeneration;
+            pJob = m_pJob;
+        }
+
+        try
+        {
+            (*pJob)(uWorker);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> Guard(m_Lock);
+
+            if (!m_pError)
+            {
+                m_pError = std::current_exception();
+            }
+        }
+
+        bool bLast = false;
+
+        {
+            std::lock_guard<std::mutex> Guard(m_Lock);
+            bLast = (--m_uPending == 0);
+        }
+
+        if (bLast)
+        {
+            m_Done.notify_one();
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CThreadPool::RunOnWorkers(const std::function<void(unsigned int uWorker)> & Body)
+{
+    if (InWorker())
+    {
+        throw CAppException("RunOnWorkers cannot be called from one of the pool's workers.");
+    }
+
+    std::lock_guard<std::mutex> RunGuard(m_RunLock);
+    std::exception_ptr pError;
+
+    {
+        std::unique_lock<std::mutex> Guard(m_Lock);
+
+        m_pJob = &Body;
+        m_pError = NULL;
+        m_uPending = (unsigned int)m_Threads.size();
+        m_ullGeneration++;
+
+        m_Wake.notify_all();
+        m_Done.wait(Guard, [this]() { return(m_uPending == 0); });
+
+        m_pJob = NULL;
+        pError = m_pError;
+        m_pError = NULL;
+    }
+
+    if (pError)
+    {
+        std::rethrow_exception(pError);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// The fork waits until no pool is being created and, on the forking
+// thread, until no parallel call or Configure is running, so the child
+// sees a whole pool with settings that match. The child cannot use that
+// pool: its locks and conditions may look held or waited on by threads
+// the child does not have, and its workers are gone. It does not touch
+// it at all but leaves it allocated and creates a new pool with the same
+// settings when it is first needed. The locks the forking thread took are
+// its own and are released in both processes.
+// ---------------------------------------------------------------------------
+
+inline void CThreadPool::BeforeFork()
+{
+    CInstance & State = InstanceState();
+    State.m_Lock.lock();
+
+    CThreadPool * pPool = State.m_pPool.load(std::memory_order_relaxed);
+
+    if (pPool != NULL && !InWorker())
+    {
+        pPool->m_RunLock.lock();
+    }
+}
+
+inline void CThreadPool::AfterForkInParent()
+{
+    CInstance & State = InstanceState();
+    CThreadPool * pPool = State.m_pPool.load(std::memory_order_relaxed);
+
+    if (pPool != NULL && !InWorker())
+    {
+        pPool->m_RunLock.unlock();
+    }
+
+    State.m_Lock.unlock();
+}
+
+inline void CThreadPool::AfterForkInChild()
+{
+    CInstance & State = InstanceState();
+    CThreadPool * pPool = State.m_pPool.load(std::memory_order_relaxed);
+
+    if (pPool != NULL)
+    {
+        State.m_uNumWorkers = pPool->NumWorkers();
+        State.m_eAffinity = pPool->m_eAffinity;
+        State.m_pOwned.release();
+        State.m_pPool.store(NULL, std::memory_order_relaxed);
+    }
+
+    State.m_Lock.unlock();
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+inline void CThreadPool::ChunkRange(unsigned int uCount, unsigned int uChunk, unsigned int uNumChunks, unsigned int * puBegin, unsigned int * puEnd)
+{
+    *puBegin = (unsigned int)((unsigned long long)uCount * uChunk / uNumChunks);
+    *puEnd = (unsigned int)((unsigned long long)uCount * (uChunk + 1) / uNumChunks);
+}
+
+inline void CThreadPool::ParallelFor(unsigned int uCount, const std::function<void(unsigned int uBegin, unsigned int uEnd)> & Body)
+{
+    if (uCount == 0)
+    {
+        return;
+    }
+
+    if (InWorker() || NumWorkers() <= 1)
+    {
+        Body(0, uCount);
+        return;
+    }
+
+    unsigned int uNumChunks = NumWorkers();
+
+    RunOnWorkers([&](unsigned int uWorker)
+    {
+        unsigned int uBegin = 0;
+        unsigned int uEnd = 0;
+
+        ChunkRange(uCount, uWorker, uNumChunks, &uBegin, &uEnd);
+
+        if (uBegin < uEnd)
+        {
+            Body(uBegin, uEnd);
+        }
+    });
+}
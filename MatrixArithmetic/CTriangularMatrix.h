@@ -0,0 +1,277 @@
+#pragma once
+
+#include "CAppException.h"
+#include "CGemmKernel.h"
+#include "CMatrix.h"
+#include <algorithm>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Which half of a square matrix holds the elements, diagonal included.
+// ---------------------------------------------------------------------------
+
+enum ETriangle
+{
+    TriangleLower,      // Elements on and below the diagonal
+    TriangleUpper       // Elements on and above the diagonal
+};
+
+// ---------------------------------------------------------------------------
+// A square matrix that is zero on one side of the diagonal. The other side
+// is stored packed row by row, n * (n + 1) / 2 elements instead of n * n:
+//
+//     lower           upper
+//     0               0 1 2
+//     1 2               3 4
+//     3 4 5               5
+//
+// The multiply and the solve only visit the stored half, so they take half
+// the multiply-adds of the dense versions.
+// ---------------------------------------------------------------------------
+
+template <class T>
+class CTriangularMatrix
+{
+public:
+    // ---------------------------------------------------------------------------
+    // pPacked holds the n * (n + 1) / 2 elements in the order above, or is
+    // NULL for a zero matrix.
+
+    CTriangularMatrix(unsigned int uSize, ETriangle eTriangle, const T * pPacked = NULL);
+
+    // ---------------------------------------------------------------------------
+    // Takes one triangle of a square matrix, the other one is ignored.
+
+    CTriangularMatrix(const CMatrix<T> & Matrix, ETriangle eTriangle);
+
+    inline unsigned int Size() const { return(m_uSize); }
+    inline ETriangle Triangle() const { return(m_eTriangle); }
+
+    // ---------------------------------------------------------------------------
+    // Elements outside the triangle read as zero and cannot be set.
+
+    T GetAt(unsigned int uRow, unsigned int uCol) const;
+    void SetAt(unsigned int uRow, unsigned int uCol, T Element);
+
+    CMatrix<T> ToMatrix() const;
+
+    // ---------------------------------------------------------------------------
+    // this * Matrix
+
+    CMatrix<T> operator*(const CMatrix<T> & Matrix) const;
+
+    // ---------------------------------------------------------------------------
+    // The X for which this * X = B, by forward or back substitution. Throws if
+    // a diagonal element is zero. With an integer element type the divisions
+    // are integer divisions, so this is meant for floating point.
+
+    CMatrix<T> Solve(const CMatrix<T> & B) const;
+
+private:
+    // Index in m_Elements of the first stored element of a row, and the
+    // range of columns stored for it.
+
+    size_t RowStart(unsigned int uRow) const;
+    unsigned int FirstColumn(unsigned int uRow) const { return((m_eTriangle == TriangleLower) ? 0 : uRow); }
+    unsigned int EndColumn(unsigned int uRow) const { return((m_eTriangle == TriangleLower) ? uRow + 1 : m_uSize); }
+
+    unsigned int m_uSize;
+    ETriangle m_eTriangle;
+    std::vector<T> m_Elements;
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+CTriangularMatrix<T>::CTriangularMatrix(unsigned int uSize, ETriangle eTriangle, const T * pPacked)
+{
+    size_t uCount = (size_t)uSize * (uSize + 1) / 2;
+
+    m_uSize = uSize;
+    m_eTriangle = eTriangle;
+
+    if (pPacked)
+    {
+        m_Elements.assign(pPacked, pPacked + uCount);
+    }
+    else
+    {
+        m_Elements.assign(uCount, T());
+    }
+}
+
+template <class T>
+CTriangularMatrix<T>::CTriangularMatrix(const CMatrix<T> & Matrix, ETriangle eTriangle)
+{
+    if (Matrix.m_uRows != Matrix.m_uColumns)
+    {
+        throw CAppException("A triangular matrix must be square.");
+    }
+
+    m_uSize = Matrix.m_uRows;
+    m_eTriangle = eTriangle;
+    m_Elements.resize((size_t)m_uSize * (m_uSize + 1) / 2);
+
+    for (unsigned int uRow = 0; uRow < m_uSize; uRow++)
+    {
+        const T * pSource = &Matrix.m_pMatrix[(size_t)uRow * m_uSize];
+
+        std::copy(pSource + FirstColumn(uRow), pSource + EndColumn(uRow), &m_Elements[RowStart(uRow)]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+
+template <class T>
+size_t CTriangularMatrix<T>::RowStart(unsigned int uRow) const
+{
+    if (m_eTriangle == TriangleLower)
+    {
+        return((size_t)uRow * (uRow + 1) / 2);
+    }
+
+    // The rows above hold n, n - 1, ... elements
+
+    return((size_t)uRow * m_uSize - (size_t)uRow * (uRow - 1) / 2);
+}
+
+template <class T>
+T CTriangularMatrix<T>::GetAt(unsigned int uRow, unsigned int uCol) const
+{
+    if (uRow >= m_uSize || uCol >= m_uSize)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    if (uCol < FirstColumn(uRow) || uCol >= EndColumn(uRow))
+    {
+        return(T());
+    }
+
+    return(m_Elements[RowStart(uRow) + uCol - FirstColumn(uRow)]);
+}
+
+template <class T>
+void CTriangularMatrix<T>::SetAt(unsigned int uRow, unsigned int uCol, T Element)
+{
+    if (uRow >= m_uSize || uCol >= m_uSize)
+    {
+        throw CAppException("Index out of range");
+    }
+
+    if (uCol < FirstColumn(uRow) || uCol >= EndColumn(uRow))
+    {
+        throw CAppException("Elements outside the triangle cannot be set.");
+    }
+
+    m_Elements[RowStart(uRow) + uCol - FirstColumn(uRow)] = Element;
+}
+
+template <class T>
+CMatrix<T> CTriangularMatrix<T>::ToMatrix() const
+{
+    CMatrix<T> Matrix(m_uSize, m_uSize);
+
+    for (unsigned int uRow = 0; uRow < m_uSize; uRow++)
+    {
+        std::copy(&m_Elements[RowStart(uRow)], &m_Elements[RowStart(uRow)] + (EndColumn(uRow) - FirstColumn(uRow)),
+                  &Matrix.m_pMatrix[(size_t)uRow * m_uSize + FirstColumn(uRow)]);
+    }
+
+    return(Matrix);
+}
+
+// ---------------------------------------------------------------------------
+// Row n of the product only takes the rows of Matrix that row n of the
+// triangle has elements for. Each of them is added in with a unit stride
+// row update.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CTriangularMatrix<T>::operator*(const CMatrix<T> & Matrix) const
+{
+    if (Matrix.m_uRows != m_uSize)
+    {
+        throw CAppException("Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+    }
+
+    const unsigned int uCols = Matrix.m_uColumns;
+    unsigned long long ullWork = (unsigned long long)m_Elements.size() * uCols;
+    CMatrix<T> Product(m_uSize, uCols);
+
+    CMatrix<T>::ForEachRowChunk(m_uSize, ullWork, CMatrix<T>::ParallelMultiplyAdds(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        for (unsigned int uRow = uBegin; uRow < uEnd; uRow++)
+        {
+            const T * pRow = &m_Elements[RowStart(uRow)] - FirstColumn(uRow);
+            T * pDest = &Product.m_pMatrix[(size_t)uRow * uCols];
+
+            for (unsigned int uDot = FirstColumn(uRow); uDot < EndColumn(uRow); uDot++)
+            {
+                CGemmKernel<T>::MultiplyAddRow(uCols, pRow[uDot], &Matrix.m_pMatrix[(size_t)uDot * uCols], pDest);
+            }
+        }
+    });
+
+    return(Product);
+}
+
+// ---------------------------------------------------------------------------
+// The columns of B are independent systems, so the workers each solve a
+// band of columns. Within a band row n of X is row n of B minus the rows of
+// X already solved, scaled by the triangle's row, divided by the diagonal.
+// ---------------------------------------------------------------------------
+
+template <class T>
+CMatrix<T> CTriangularMatrix<T>::Solve(const CMatrix<T> & B) const
+{
+    if (B.m_uRows != m_uSize)
+    {
+        throw CAppException("Number of rows of the right hand side must equal the size of the matrix.");
+    }
+
+    for (unsigned int uRow = 0; uRow < m_uSize; uRow++)
+    {
+        if (GetAt(uRow, uRow) == T())
+        {
+            throw CAppException("Matrix is singular");
+        }
+    }
+
+    const unsigned int uCols = B.m_uColumns;
+    unsigned long long ullWork = (unsigned long long)m_Elements.size() * uCols;
+    CMatrix<T> X(B);
+
+    CMatrix<T>::ForEachRowChunk(uCols, ullWork, CMatrix<T>::ParallelMultiplyAdds(),
+        [&](unsigned int uBegin, unsigned int uEnd)
+    {
+        unsigned int uWidth = uEnd - uBegin;
+
+        for (unsigned int uStep = 0; uStep < m_uSize; uStep++)
+        {
+            unsigned int uRow = (m_eTriangle == TriangleLower) ? uStep : m_uSize - 1 - uStep;
+            const T * pRow = &m_Elements[RowStart(uRow)] - FirstColumn(uRow);
+            T * pDest = &X.m_pMatrix[(size_t)uRow * uCols + uBegin];
+
+            for (unsigned int uDot = FirstColumn(uRow); uDot < EndColumn(uRow); uDot++)
+            {
+                if (uDot != uRow)
+                {
+                    CGemmKernel<T>::MultiplyAddRow(uWidth, -pRow[uDot], &X.m_pMatrix[(size_t)uDot * uCols + uBegin], pDest);
+                }
+            }
+
+            const T Diagonal = pRow[uRow];
+
+            for (unsigned int uCol = 0; uCol < uWidth; uCol++)
+            {
+                pDest[uCol] /= Diagonal;
+            }
+        }
+    });
+
+    return(X);
+}
@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CBitMatrix.h"
+#include "TestMatrices.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Bit Matrix Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    // The three products from the integer product of the 0/1 matrices
+
+    static void AssertBitProducts(const CMatrix<int> & A, const CMatrix<int> & B)
+    {
+        CBitMatrix a(A);
+        CBitMatrix b(B);
+        CMatrix<int> Counts = A * B;
+        CMatrix<int> Boolean = a.BooleanProduct(b).ToMatrix();
+        CMatrix<int> Xor = a.XorProduct(b).ToMatrix();
+        CMatrix<int> Count = a.CountProduct(b);
+
+        AssertMatrixEqual(Counts.Map([](int nCount) { return((int)(nCount > 0)); }), Boolean);
+        AssertMatrixEqual(Counts.Map([](int nCount) { return(nCount % 2); }), Xor);
+        AssertMatrixEqual(Counts, Count);
+    }
+
+    TEST_CLASS(BitMatrixTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(Conversion)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Conversion")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(Conversion)
+        {
+            int Data[] = { 0, -3, 7, 0, 1, 0 };
+            CBitMatrix m(CMatrix<int>(2, 3, Data));
+
+            Assert::AreEqual(1u, m.WordsPerRow());
+            Assert::IsFalse(m.GetAt(0, 0));
+            Assert::IsTrue(m.GetAt(0, 1));
+            Assert::AreEqual(3ULL, m.Count());
+            Assert::AreEqual(1, m.ToMatrix().GetAt(1, 1));
+            Assert::AreEqual(0, m.ToMatrix().GetAt(1, 2));
+
+            m.SetAt(0, 1, false);
+            m.SetAt(1, 2, true);
+            Assert::AreEqual(0ULL, m.row_ptr(0)[0] & 0x2ULL);
+            Assert::AreEqual(0x6ULL, m.row_ptr(1)[0]);
+
+            // Rows wider than a word
+
+            CMatrix<int> Wide = SeededMatrix<int>(5, 200, 1, 0, 1);
+            CBitMatrix w(Wide);
+
+            Assert::AreEqual(4u, w.WordsPerRow());
+            AssertMatrixEqual(Wide, w.ToMatrix());
+            Assert::IsTrue(w == CBitMatrix(w.ToMatrix()));
+
+            auto OutOfRange = [&m] { m.GetAt(0, 3); };
+            Assert::ExpectException<CAppException>(OutOfRange);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ElementWise)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Element wise")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ElementWise)
+        {
+            CMatrix<int> A = SeededMatrix<int>(70, 130, 3, 0, 1);
+            CMatrix<int> B = SeededMatrix<int>(70, 130, 4, 0, 1);
+            CBitMatrix a(A);
+            CBitMatrix b(B);
+            CMatrix<int> Or = (a | b).ToMatrix();
+            CMatrix<int> And = (a & b).ToMatrix();
+            CMatrix<int> Xor = (a ^ b).ToMatrix();
+
+            for (unsigned int uRow = 0; uRow < 70; uRow++)
+            {
+                for (unsigned int uCol = 0; uCol < 130; uCol++)
+                {
+                    Assert::AreEqual(A.GetAt(uRow, uCol) | B.GetAt(uRow, uCol), Or.GetAt(uRow, uCol));
+                    Assert::AreEqual(A.GetAt(uRow, uCol) & B.GetAt(uRow, uCol), And.GetAt(uRow, uCol));
+                    Assert::AreEqual(A.GetAt(uRow, uCol) ^ B.GetAt(uRow, uCol), Xor.GetAt(uRow, uCol));
+                }
+            }
+
+            Assert::IsTrue((a ^ a).Count() == 0);
+            AssertMatrixEqual(A.Transpose(), a.Transpose().ToMatrix());
+            Assert::IsTrue(a.Transpose().Transpose() == a);
+
+            CBitMatrix c(70, 129);
+            auto WrongSize = [&a, &c] { a | c; };
+            Assert::ExpectException<CAppException>(WrongSize);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(Products)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Products")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(Products)
+        {
+            // Inner sizes that leave a partial table, a sparse case with many
+            // empty lookups, and a product wider than one table
+
+            auto OneInNine = [](int nValue) { return((int)(nValue == 0)); };
+
+            AssertBitProducts(SeededMatrix<int>(37, 75, 5, 0, 1), SeededMatrix<int>(75, 130, 6, 0, 1));
+            AssertBitProducts(SeededMatrix<int>(64, 64, 7, 0, 8).Map(OneInNine), SeededMatrix<int>(64, 64, 8, 0, 8).Map(OneInNine));
+            AssertBitProducts(SeededMatrix<int>(9, 21, 9, 0, 1), SeededMatrix<int>(21, 2100, 10, 0, 1));
+
+            CBitMatrix a(SeededMatrix<int>(30, 30, 11, 0, 1));
+            CBitMatrix Identity = CBitMatrix::Identity(30);
+
+            Assert::IsTrue(a.BooleanProduct(Identity) == a);
+            Assert::IsTrue(Identity.XorProduct(a) == a);
+
+            CBitMatrix b(31, 30);
+            auto WrongSize = [&a, &b] { a.BooleanProduct(b); };
+            Assert::ExpectException<CAppException>(WrongSize);
+
+            auto WrongCount = [&a, &b] { a.CountProduct(b); };
+            Assert::ExpectException<CAppException>(WrongCount);
+        }
+    };
+}
@@ -0,0 +1,269 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CDistributedMatrix.h"
+#include "..\MatrixArithmetic\CSocketTransport.h"
+#include "TestMatrices.h"
+#include <atomic>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Distributed Matrix Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    // Runs SUMMA on a nGridRows * nGridCols grid of threads and compares the
+    // gathered result with the serial product.
+
+    static void CheckSumma(int nGridRows, int nGridCols, unsigned int uM, unsigned int uK, unsigned int uN, unsigned int uBlockSize)
+    {
+        CMatrix<int> A = SeededMatrix<int>(uM, uK, 1);
+        CMatrix<int> B = SeededMatrix<int>(uK, uN, 2);
+        CMatrix<int> Expected = A * B;
+        CMatrix<int> Gathered(0, 0);
+
+        CLocalTransport::Run(nGridRows * nGridCols, [&](CMatrixTransport & Transport)
+        {
+            CProcessGrid Grid(Transport, nGridRows, nGridCols);
+            CDistributedMatrix<int> DistA(Grid, uM, uK, uBlockSize);
+            CDistributedMatrix<int> DistB(Grid, uK, uN, uBlockSize);
+            CDistributedMatrix<int> DistC(Grid, uM, uN, uBlockSize);
+
+            bool bRoot = (Transport.Rank() == 0);
+            DistA.Scatter(bRoot ? &A : NULL);
+            DistB.Scatter(bRoot ? &B : NULL);
+
+            DistC.Multiply(DistA, DistB);
+
+            CMatrix<int> Product = DistC.Gather();
+
+            if (bRoot)
+            {
+                Gathered = Product;
+            }
+        });
+
+        AssertMatrixEqual(Expected, Gathered);
+    }
+
+    TEST_CLASS(DistributedMatrixTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(MultiplyAccumulate)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Local tile multiply")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(MultiplyAccumulate)
+        {
+            int Data1[] = { 1, 2, 3, 4, 5, 6 };
+            int Data2[] = { 7, 8, 9, 10, 11, 12 };
+            int Data3[] = { 1, 1, 1, 1 };
+
+            CMatrix<int> m1(2, 3, Data1);
+            CMatrix<int> m2(3, 2, Data2);
+            CMatrix<int> p(2, 2, Data3);
+
+            p.MultiplyAccumulate(m1, m2);
+
+            Assert::AreEqual(59, p.GetAt(0, 0));
+            Assert::AreEqual(65, p.GetAt(0, 1));
+            Assert::AreEqual(140, p.GetAt(1, 0));
+            Assert::AreEqual(155, p.GetAt(1, 1));
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ScatterGather)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Block cyclic distribution")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ScatterGather)
+        {
+            CMatrix<int> m = SeededMatrix<int>(7, 5, 3);
+            CMatrix<int> Gathered(0, 0);
+            bool bLocalOk = true;
+
+            CLocalTransport::Run(6, [&](CMatrixTransport & Transport)
+            {
+                CProcessGrid Grid(Transport, 2, 3);
+                CDistributedMatrix<int> Dist(Grid, 7, 5, 2);
+
+                Dist.Scatter(Transport.Rank() == 0 ? &m : NULL);
+
+                // Every local cell must hold the global cell it maps to
+
+                const CMatrix<int> & Local = Dist.LocalMatrix();
+
+                for (unsigned int uRow = 0; uRow < Local.NumRows(); uRow++)
+                {
+                    for (unsigned int uCol = 0; uCol < Local.NumColumns(); uCol++)
+                    {
+                        if (Local.GetAt(uRow, uCol) != m.GetAt(Dist.GlobalRow(uRow), Dist.GlobalColumn(uCol)))
+                        {
+                            bLocalOk = false;
+                        }
+                    }
+                }
+
+                CMatrix<int> Product = Dist.Gather();
+
+                if (Transport.Rank() == 0)
+                {
+                    Gathered = Product;
+                }
+            });
+
+            Assert::IsTrue(bLocalOk);
+            AssertMatrixEqual(m, Gathered);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(SummaSquareGrid)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"SUMMA multiply")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SummaSquareGrid)
+        {
+            CheckSumma(2, 2, 16, 16, 16, 4);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(SummaUnevenBlocks)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"SUMMA multiply")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SummaUnevenBlocks)
+        {
+            // Partial blocks at the edges and ranks without any block
+
+            CheckSumma(2, 3, 7, 5, 9, 2);
+            CheckSumma(3, 1, 3, 11, 4, 4);
+            CheckSumma(1, 1, 5, 5, 5, 3);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(SummaSizeMismatch)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"SUMMA multiply")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SummaSizeMismatch)
+        {
+            try
+            {
+                CLocalTransport::Run(1, [&](CMatrixTransport & Transport)
+                {
+                    CProcessGrid Grid(Transport, 1, 1);
+                    CDistributedMatrix<int> DistA(Grid, 2, 3, 2);
+                    CDistributedMatrix<int> DistB(Grid, 2, 3, 2);
+                    CDistributedMatrix<int> DistC(Grid, 2, 3, 2);
+
+                    DistC.Multiply(DistA, DistB);
+                });
+
+                Logger::WriteMessage("An exception was expected to be thrown");
+                Assert::IsFalse(true);
+            }
+            catch (CAppException ex)
+            {
+                Logger::WriteMessage(ex.what());
+                Assert::AreEqual(ex.what(), "Number of columns of the 1st matrix must equal to the number of rows of the 2nd.");
+            }
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(SummaAliasedOperands)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"SUMMA multiply")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SummaAliasedOperands)
+        {
+            std::atomic<unsigned int> uFailures(0);
+
+            CLocalTransport::Run(4, [&](CMatrixTransport & Transport)
+            {
+                CProcessGrid Grid(Transport, 2, 2);
+                CDistributedMatrix<int> DistA(Grid, 8, 8, 2);
+                CDistributedMatrix<int> DistC(Grid, 8, 8, 2);
+
+                try
+                {
+                    DistC.Multiply(DistC, DistA);
+                }
+                catch (CAppException ex)
+                {
+                    uFailures++;
+                }
+
+                try
+                {
+                    DistC.Multiply(DistA, DistC);
+                }
+                catch (CAppException ex)
+                {
+                    uFailures++;
+                }
+            });
+
+            Assert::AreEqual((unsigned int)8, uFailures.load());
+        }
+
+#ifndef _WIN32
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(SummaForkedProcesses)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"SUMMA multiply")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SummaForkedProcesses)
+        {
+            // The same product over socket pairs between forked ranks. The
+            // root checks the gathered product; a failed check fails its
+            // process and with it RunProcesses.
+
+            CMatrix<int> A = SeededMatrix<int>(19, 13, 1);
+            CMatrix<int> B = SeededMatrix<int>(13, 17, 2);
+            CMatrix<int> Expected = A * B;
+
+            CSocketTransport::RunProcesses(4, [&](CMatrixTransport & Transport)
+            {
+                CProcessGrid Grid(Transport, 2, 2);
+                CDistributedMatrix<int> DistA(Grid, 19, 13, 3);
+                CDistributedMatrix<int> DistB(Grid, 13, 17, 3);
+                CDistributedMatrix<int> DistC(Grid, 19, 17, 3);
+
+                bool bRoot = (Transport.Rank() == 0);
+                DistA.Scatter(bRoot ? &A : NULL);
+                DistB.Scatter(bRoot ? &B : NULL);
+
+                DistC.Multiply(DistA, DistB);
+
+                CMatrix<int> Product = DistC.Gather();
+
+                if (bRoot)
+                {
+                    AssertMatrixEqual(Expected, Product);
+                }
+            });
+        }
+
+#endif // _WIN32
+    };
+}
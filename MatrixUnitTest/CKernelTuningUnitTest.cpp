@@ -0,0 +1,260 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CKernelTuner.h"
+#include <fstream>
+#include <stdio.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Kernel Tuning Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    static const char * TUNING_PATH = "MatrixTuningTest.cfg";
+
+    TEST_CLASS(KernelTuningTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(GemmVariants)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Kernel parameters")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(GemmVariants)
+        {
+            // Block sizes that do not divide the matrix sizes, so that every
+            // edge case of both variants is used
+
+            const unsigned int uM = 23;
+            const unsigned int uN = 19;
+            const unsigned int uK = 17;
+
+            std::vector<int> A(uM * uK);
+            std::vector<int> B(uK * uN);
+
+            for (size_t uIdx = 0; uIdx < A.size(); uIdx++)
+            {
+                A[uIdx] = (int)(uIdx % 11) - 5;
+            }
+
+            for (size_t uIdx = 0; uIdx < B.size(); uIdx++)
+            {
+                B[uIdx] = (int)(uIdx % 7) - 3;
+            }
+
+            CKernelParameters Params = CKernelParameters::Defaults();
+            Params.uBlockM = 6;
+            Params.uBlockN = 5;
+            Params.uBlockK = 4;
+
+            const EGemmVariant Variants[] = { GemmSingleRow, GemmFourRows };
+
+            for (unsigned int uVariant = 0; uVariant < 2; uVariant++)
+            {
+                std::vector<int> C(uM * uN, 1);
+
+                Params.eGemmVariant = Variants[uVariant];
+                CGemmKernel<int>::MultiplyAdd(uM, uN, uK, A.data(), uK, B.data(), uN, C.data(), uN, Params);
+
+                for (unsigned int uRow = 0; uRow < uM; uRow++)
+                {
+                    for (unsigned int uCol = 0; uCol < uN; uCol++)
+                    {
+                        int nDot = 1;
+
+                        for (unsigned int uDot = 0; uDot < uK; uDot++)
+                        {
+                            nDot += A[uRow * uK + uDot] * B[uDot * uN + uCol];
+                        }
+
+                        Assert::AreEqual(nDot, C[uRow * uN + uCol]);
+                    }
+                }
+            }
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ProfileRoundTrip)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Profile file")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ProfileRoundTrip)
+        {
+            // A section for another CPU must survive a save
+
+            {
+                std::ofstream File(TUNING_PATH);
+                File << "[Some Other CPU]\n";
+                File << "double.block_m = 8\n";
+            }
+
+            CKernelParameters & Params = CKernelTuning::Parameters<double>();
+
+            Params.uBlockM = 48;
+            Params.eGemmVariant = GemmFourRows;
+            Params.uTransposeTile = 16;
+            Params.ullParallelElements = 12345;
+
+            CKernelTuning::Save(TUNING_PATH);
+
+            Params = CKernelParameters::Defaults();
+            Assert::IsTrue(CKernelTuning::Load(TUNING_PATH));
+
+            Assert::AreEqual((unsigned int)48, Params.uBlockM);
+            Assert::AreEqual((int)GemmFourRows, (int)Params.eGemmVariant);
+            Assert::AreEqual((unsigned int)16, Params.uTransposeTile);
+            Assert::AreEqual(12345ULL, Params.ullParallelElements);
+            Assert::AreEqual(CKernelParameters::Defaults().uBlockK, Params.uBlockK);
+
+            // Kernels still give the right results with the loaded profile
+
+            int Data[] = { 1, 2, 3, 4 };
+            CMatrix<double> m(2, 2);
+            m.SetAt(0, 0, 1.0);
+            m.SetAt(1, 1, 2.0);
+            Assert::AreEqual(4.0, (m * m.Transpose()).GetAt(1, 1));
+            Assert::AreEqual(4, CMatrix<int>(2, 2, Data).Transpose().GetAt(1, 1));
+
+            bool bOtherKept = false;
+            std::ifstream File(TUNING_PATH);
+            std::string strLine;
+
+            while (std::getline(File, strLine))
+            {
+                bOtherKept = bOtherKept || (strLine == "[Some Other CPU]");
+            }
+
+            File.close();
+            Assert::IsTrue(bOtherKept);
+
+            Params = CKernelParameters::Defaults();
+            remove(TUNING_PATH);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ProfileValidation)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Profile file")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ProfileValidation)
+        {
+            CKernelParameters & Params = CKernelTuning::Parameters<float>();
+
+            Assert::IsFalse(CKernelTuning::Load("MatrixTuningMissing.cfg"));
+
+            {
+                std::ofstream File(TUNING_PATH);
+                File << "[" << CKernelTuning::CpuModel() << "]\n";
+                File << "float.block_m = 0\n";
+                File << "float.block_n = abc\n";
+                File << "float.gemm_variant = 7\n";
+                File << "float.block_k = 96\n";
+            }
+
+            Assert::IsTrue(CKernelTuning::Load(TUNING_PATH));
+            remove(TUNING_PATH);
+
+            // Only the valid value is taken
+
+            Assert::AreEqual(CKernelParameters::Defaults().uBlockM, Params.uBlockM);
+            Assert::AreEqual(CKernelParameters::Defaults().uBlockN, Params.uBlockN);
+            Assert::AreEqual((int)GemmSingleRow, (int)Params.eGemmVariant);
+            Assert::AreEqual((unsigned int)96, Params.uBlockK);
+
+            Params = CKernelParameters::Defaults();
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ThresholdWithoutCrossover)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Tuner")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ThresholdWithoutCrossover)
+        {
+            const std::vector<unsigned long long> Work = { 4096, 8192, 16384 };
+            unsigned int uProbes = 0;
+
+            // The pool wins from the second probe on: the search stops there
+
+            unsigned long long ullThreshold = CKernelTuner<int>::Threshold(Work, [&](size_t uProbe)
+            {
+                uProbes++;
+                return(uProbe >= 1);
+            }, "test kernel", NULL);
+
+            Assert::AreEqual(8192ULL, ullThreshold);
+            Assert::AreEqual((unsigned int)2, uProbes);
+
+            // The pool never wins: every size is probed, the largest one
+            // stays serial and anything larger goes parallel
+
+            FILE * pLog = tmpfile();
+            uProbes = 0;
+
+            ullThreshold = CKernelTuner<int>::Threshold(Work, [&](size_t)
+            {
+                uProbes++;
+                return(false);
+            }, "test kernel", pLog);
+
+            Assert::AreEqual(16385ULL, ullThreshold);
+            Assert::AreEqual((unsigned int)3, uProbes);
+
+            char szLine[128] = { 0 };
+            rewind(pLog);
+            Assert::IsTrue(fgets(szLine, sizeof(szLine), pLog) != NULL);
+            fclose(pLog);
+
+            Assert::AreEqual("  no crossover found for test kernel, using the largest probed size\n", (const char *)szLine);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(TuneKeepsResultsRight)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Tuner")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(TuneKeepsResultsRight)
+        {
+            // A whole tuning run with more than one worker, so the
+            // thresholds are measured too. Whatever it picks must be one of
+            // the candidates and must not change any result.
+
+            CThreadPool::Instance().Configure(2, AffinityNone);
+
+            CKernelParameters Params = CKernelTuner<int>::Tune();
+
+            CThreadPool::Instance().Configure(0, AffinityNone);
+
+            Assert::IsTrue(Params.uBlockK >= 64 && Params.uBlockK <= 512);
+            Assert::IsTrue(Params.uBlockN >= 128 && Params.uBlockN <= 1024);
+            Assert::IsTrue(Params.uBlockM >= 16 && Params.uBlockM <= 128);
+            Assert::IsTrue(Params.uTransposeTile >= 8 && Params.uTransposeTile <= 128);
+            Assert::IsTrue(Params.ullParallelElements >= 16ULL * 256 && Params.ullParallelElements <= 16ULL * 1024 * 256 + 1);
+            Assert::IsTrue(Params.ullParallelMultiplyAdds >= 16ULL * 16 * 16 && Params.ullParallelMultiplyAdds <= 512ULL * 512 * 512);
+
+            int Data[] = { 1, 2, 3, 4, 5, 6 };
+            CMatrix<int> m(2, 3, Data);
+            CMatrix<int> Product = m * m.Transpose();
+
+            Assert::AreEqual(14, Product.GetAt(0, 0));
+            Assert::AreEqual(32, Product.GetAt(0, 1));
+            Assert::AreEqual(77, Product.GetAt(1, 1));
+            Assert::AreEqual(4, m.Transpose().GetAt(0, 1));
+
+            CKernelTuning::Parameters<int>() = CKernelParameters::Defaults();
+        }
+    };
+}
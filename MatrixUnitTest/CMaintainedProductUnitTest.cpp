@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMaintainedProduct.h"
+#include "TestMatrices.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Maintained Product Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    TEST_CLASS(MaintainedProductTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(RankUpdates)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Rank update kernels")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(RankUpdates)
+        {
+            CMatrix<int> m = SeededMatrix<int>(7, 9, 1);
+            CMatrix<int> U = SeededMatrix<int>(7, 2, 2);
+            CMatrix<int> V = SeededMatrix<int>(9, 2, 3);
+            CMatrix<int> Expected = m + U * V.Transpose();
+
+            m.RankUpdate(U, V);
+            AssertMatrixEqual(Expected, m);
+
+            // Rank one
+
+            CMatrix<int> u = SeededMatrix<int>(7, 1, 4);
+            CMatrix<int> v = SeededMatrix<int>(9, 1, 5);
+            Expected = m + u * v.Transpose();
+
+            m.RankUpdate(u, v);
+            AssertMatrixEqual(Expected, m);
+
+            auto WrongSize = [&m, &v] { m.RankUpdate(v, v); };
+            Assert::ExpectException<CAppException>(WrongSize);
+
+            // Symmetric
+
+            CMatrix<int> A = SeededMatrix<int>(11, 4, 6);
+            CMatrix<int> s = SeededMatrix<int>(11, 11, 7);
+            Expected = s + A * A.Transpose();
+
+            s.SymmetricRankUpdate(A);
+            AssertMatrixEqual(Expected, s);
+
+            auto NotSquare = [&m, &A] { m.SymmetricRankUpdate(A); };
+            Assert::ExpectException<CAppException>(NotSquare);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(StaleRowsAndColumns)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Maintained product")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(StaleRowsAndColumns)
+        {
+            CMaintainedProduct<int> Product(SeededMatrix<int>(10, 6, 1), SeededMatrix<int>(6, 8, 2));
+
+            int Row[] = { 1, -2, 3, -4, 5, -6 };
+            int Column[] = { 2, 0, -1, 4, 1, 3 };
+
+            Product.SetRowA(3, Row);
+            Product.SetAtA(7, 2, 9);
+            Product.SetAtA(3, 0, -3);
+            Product.SetColumnB(5, Column);
+            Product.SetAtB(0, 1, 8);
+
+            Assert::AreEqual(2u, Product.NumStaleRows());
+            Assert::AreEqual(2u, Product.NumStaleColumns());
+            Assert::AreEqual(-3, Product.MatrixA().GetAt(3, 0));
+            Assert::AreEqual(4, Product.MatrixB().GetAt(3, 5));
+
+            AssertMatrixEqual(Product.MatrixA() * Product.MatrixB(), Product.Product());
+            Assert::AreEqual(0u, Product.NumStaleRows());
+            Assert::AreEqual(0u, Product.NumStaleColumns());
+
+            // More than half of the rows stale takes the full product
+
+            for (unsigned int uRow = 0; uRow < 6; uRow++)
+            {
+                Product.SetAtA(uRow, uRow, 1);
+            }
+
+            AssertMatrixEqual(Product.MatrixA() * Product.MatrixB(), Product.Product());
+
+            auto OutOfRange = [&Product] { Product.SetAtB(6, 0, 1); };
+            Assert::ExpectException<CAppException>(OutOfRange);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(LowRankUpdates)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Maintained product")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(LowRankUpdates)
+        {
+            CMaintainedProduct<int> Product(SeededMatrix<int>(9, 7, 3), SeededMatrix<int>(7, 5, 4));
+
+            Product.RankUpdateA(SeededMatrix<int>(9, 1, 5), SeededMatrix<int>(7, 1, 6));
+            AssertMatrixEqual(Product.MatrixA() * Product.MatrixB(), Product.Product());
+
+            Product.RankUpdateB(SeededMatrix<int>(7, 3, 7), SeededMatrix<int>(5, 3, 8));
+            AssertMatrixEqual(Product.MatrixA() * Product.MatrixB(), Product.Product());
+
+            // Updates mixed with stale rows and columns
+
+            Product.SetAtA(4, 4, 7);
+            Product.SetAtB(2, 3, -7);
+            Product.RankUpdateA(SeededMatrix<int>(9, 2, 9), SeededMatrix<int>(7, 2, 10));
+            Product.RankUpdateB(SeededMatrix<int>(7, 1, 11), SeededMatrix<int>(5, 1, 12));
+            AssertMatrixEqual(Product.MatrixA() * Product.MatrixB(), Product.Product());
+
+            Product.Recompute();
+            AssertMatrixEqual(Product.MatrixA() * Product.MatrixB(), Product.Product());
+
+            CMatrix<int> u = SeededMatrix<int>(9, 1, 1);
+            auto WrongSize = [&Product, &u] { Product.RankUpdateB(u, u); };
+            Assert::ExpectException<CAppException>(WrongSize);
+        }
+    };
+}
@@ -0,0 +1,180 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMatrixCsv.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"CSV Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    static CMatrix<int> ParseInts(const char * pszText, char cSeparator = 0)
+    {
+        return(CMatrixCsv<int>::Parse(pszText, strlen(pszText), cSeparator));
+    }
+
+    // Expects parsing pszText to fail with exactly pszMessage.
+
+    static void CheckParseError(const char * pszText, const char * pszMessage)
+    {
+        try
+        {
+            ParseInts(pszText);
+
+            Logger::WriteMessage("An exception was expected to be thrown");
+            Assert::IsFalse(true);
+        }
+        catch (CAppException ex)
+        {
+            Assert::AreEqual(pszMessage, ex.what());
+        }
+    }
+
+    TEST_CLASS(MatrixCsvTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(ParseIntegers)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Reading")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ParseIntegers)
+        {
+            CMatrix<int> m = ParseInts("\xEF\xBB\xBF" "1,2,3\r\n\r\n -4 , +5,6\r\n  \n");
+
+            Assert::AreEqual((unsigned int)2, m.NumRows());
+            Assert::AreEqual((unsigned int)3, m.NumColumns());
+            Assert::AreEqual(1, m.GetAt(0, 0));
+            Assert::AreEqual(3, m.GetAt(0, 2));
+            Assert::AreEqual(-4, m.GetAt(1, 0));
+            Assert::AreEqual(5, m.GetAt(1, 1));
+            Assert::AreEqual(6, m.GetAt(1, 2));
+
+            // Tab separated, detected from the first line, no final newline
+
+            CMatrix<int> t = ParseInts("7\t8\n9\t10");
+
+            Assert::AreEqual((unsigned int)2, t.NumRows());
+            Assert::AreEqual(10, t.GetAt(1, 1));
+
+            Assert::AreEqual((unsigned int)0, ParseInts("\n\n").NumRows());
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ParseErrors)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Reading")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ParseErrors)
+        {
+            CheckParseError("1,2\n\n3\n", "CSV line 3: too few fields");
+            CheckParseError("1,2\n3,4,5\n", "CSV line 2: too many fields");
+            CheckParseError("1,x\n", "CSV line 1: not a number");
+            CheckParseError("1,2\n3,4.5\n", "CSV line 2: not a number");
+            CheckParseError("1,,2\n", "CSV line 1: not a number");
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(FormatValues)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Writing")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(FormatValues)
+        {
+            int IntData[] = { 1, -20, 300, 0 };
+            CMatrix<int> m(2, 2, IntData);
+
+            Assert::AreEqual(std::string("1,-20\n300,0\n"), CMatrixCsv<int>::Format(m));
+            Assert::AreEqual(std::string("1\t-20\n300\t0\n"), CMatrixCsv<int>::Format(m, '\t'));
+
+            double DoubleData[] = { 0.1, 1.0 / 3.0, -2.5, 1e300 };
+            CMatrix<double> d(1, 4, DoubleData);
+
+            // Shortest text that reads back to the same value
+
+            std::string strText = CMatrixCsv<double>::Format(d);
+            CMatrix<double> Back = CMatrixCsv<double>::Parse(strText.data(), strText.size());
+
+            Assert::AreEqual(std::string("0.1,0.3333333333333333,-2.5,1e+300\n"), strText);
+
+            for (unsigned int uCol = 0; uCol < 4; uCol++)
+            {
+                Assert::AreEqual(DoubleData[uCol], Back.GetAt(0, uCol));
+            }
+
+            Assert::AreEqual(std::string("0.1,0.333,-2.5,1e+300\n"), CMatrixCsv<double>::Format(d, ',', 3));
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(FileRoundTrip)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Reading and writing")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(FileRoundTrip)
+        {
+            // Large enough to be parsed and formatted in parallel chunks
+
+            const unsigned int uRows = 1000;
+            const unsigned int uCols = 150;
+            const char * pszPath = "MatrixCsvTest.csv";
+
+            CThreadPool::Instance().Configure(4, AffinityNone);
+
+            CMatrix<float> m(uRows, uCols);
+
+            for (unsigned int uRow = 0; uRow < uRows; uRow++)
+            {
+                for (unsigned int uCol = 0; uCol < uCols; uCol++)
+                {
+                    m.SetAt(uRow, uCol, (float)(uRow * 1000 + uCol) / 7.0f - 1000.0f);
+                }
+            }
+
+            CMatrixCsv<float>::Write(m, pszPath, '\t');
+            CMatrix<float> Back = CMatrixCsv<float>::Read(pszPath);
+            remove(pszPath);
+
+            Assert::AreEqual(uRows, Back.NumRows());
+            Assert::AreEqual(uCols, Back.NumColumns());
+
+            for (unsigned int uRow = 0; uRow < uRows; uRow++)
+            {
+                for (unsigned int uCol = 0; uCol < uCols; uCol++)
+                {
+                    Assert::AreEqual(m.GetAt(uRow, uCol), Back.GetAt(uRow, uCol));
+                }
+            }
+
+            // Errors in a later chunk still report the right line
+
+            std::string strText = CMatrixCsv<float>::Format(m);
+            strText.replace(strText.rfind('\n', strText.size() - 2) + 1, 1, "?");
+
+            try
+            {
+                CMatrixCsv<float>::Parse(strText.data(), strText.size());
+
+                Logger::WriteMessage("An exception was expected to be thrown");
+                Assert::IsFalse(true);
+            }
+            catch (CAppException ex)
+            {
+                Assert::AreEqual("CSV line 1000: not a number", ex.what());
+            }
+
+            CThreadPool::Instance().Configure(0, AffinityNone);
+        }
+    };
+}
@@ -0,0 +1,178 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMatrix.h"
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Gemm Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    // Element (i, j) of op(X) for a buffer in the given layout
+
+    static int GemmElement(EMatrixLayout eLayout, ETranspose eTrans, const std::vector<int> & X, unsigned int uLd,
+                           unsigned int uRow, unsigned int uCol)
+    {
+        if (eTrans == TransposeYes)
+        {
+            std::swap(uRow, uCol);
+        }
+
+        return((eLayout == LayoutRowMajor) ? X[uRow * uLd + uCol] : X[uCol * uLd + uRow]);
+    }
+
+    TEST_CLASS(GemmTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(KernelCombinations)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Transpose flags and layouts")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(KernelCombinations)
+        {
+            // Small blocks so that every operand is split into several
+            // blocks with ragged edges, and leading dimensions larger than
+            // the matrices
+
+            CKernelParameters & Params = CKernelTuning::Parameters<int>();
+            Params.uBlockM = 5;
+            Params.uBlockN = 4;
+            Params.uBlockK = 3;
+
+            const unsigned int uM = 13;
+            const unsigned int uN = 11;
+            const unsigned int uK = 7;
+            const unsigned int uPad = 2;
+            const EMatrixLayout Layouts[] = { LayoutRowMajor, LayoutColumnMajor };
+            const ETranspose Flags[] = { TransposeNo, TransposeYes };
+
+            for (EMatrixLayout eLayout : Layouts)
+            {
+                for (ETranspose eTransA : Flags)
+                {
+                    for (ETranspose eTransB : Flags)
+                    {
+                        // Stored rows and columns of A, B and C in this layout
+
+                        bool bRowMajor = (eLayout == LayoutRowMajor);
+                        unsigned int uLda = (bRowMajor == (eTransA == TransposeNo) ? uK : uM) + uPad;
+                        unsigned int uLdb = (bRowMajor == (eTransB == TransposeNo) ? uN : uK) + uPad;
+                        unsigned int uLdc = (bRowMajor ? uN : uM) + uPad;
+
+                        std::vector<int> A(uLda * (uM > uK ? uM : uK));
+                        std::vector<int> B(uLdb * (uN > uK ? uN : uK));
+                        std::vector<int> C(uLdc * (uM > uN ? uM : uN));
+
+                        for (size_t uIdx = 0; uIdx < A.size(); uIdx++)
+                        {
+                            A[uIdx] = (int)(uIdx % 9) - 4;
+                        }
+
+                        for (size_t uIdx = 0; uIdx < B.size(); uIdx++)
+                        {
+                            B[uIdx] = (int)(uIdx % 5) - 2;
+                        }
+
+                        for (size_t uIdx = 0; uIdx < C.size(); uIdx++)
+                        {
+                            C[uIdx] = (int)(uIdx % 7) - 3;
+                        }
+
+                        std::vector<int> Original = C;
+
+                        CGemmKernel<int>::Gemm(eLayout, eTransA, eTransB, uM, uN, uK, 3,
+                                               A.data(), uLda, B.data(), uLdb, -2, C.data(), uLdc);
+
+                        for (unsigned int uRow = 0; uRow < uM; uRow++)
+                        {
+                            for (unsigned int uCol = 0; uCol < uN; uCol++)
+                            {
+                                int nDot = 0;
+
+                                for (unsigned int uDot = 0; uDot < uK; uDot++)
+                                {
+                                    nDot += GemmElement(eLayout, eTransA, A, uLda, uRow, uDot) *
+                                            GemmElement(eLayout, eTransB, B, uLdb, uDot, uCol);
+                                }
+
+                                int nExpected = 3 * nDot - 2 * GemmElement(eLayout, TransposeNo, Original, uLdc, uRow, uCol);
+
+                                Assert::AreEqual(nExpected, GemmElement(eLayout, TransposeNo, C, uLdc, uRow, uCol));
+                            }
+                        }
+                    }
+                }
+            }
+
+            Params = CKernelParameters::Defaults();
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(MatrixGemm)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Transpose flags and layouts")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(MatrixGemm)
+        {
+            CMatrix<double> A(6, 4);
+            CMatrix<double> B(6, 5);
+
+            for (unsigned int uIdx = 0; uIdx < 24; uIdx++)
+            {
+                A.SetAt(uIdx / 4, uIdx % 4, 0.5 * (double)(uIdx % 7));
+            }
+
+            for (unsigned int uIdx = 0; uIdx < 30; uIdx++)
+            {
+                B.SetAt(uIdx / 5, uIdx % 5, (double)(uIdx % 3) - 1.0);
+            }
+
+            // A' * B
+
+            CMatrix<double> C(4, 5);
+            C.Gemm(TransposeYes, A, TransposeNo, B, 1.0, 0.0);
+            CMatrix<double> Expected = A.Transpose() * B;
+
+            Assert::IsTrue(std::equal(Expected.begin(), Expected.end(), C.begin()));
+
+            // Adding a scaled A' * B to what is there
+
+            C.Gemm(TransposeYes, A, TransposeNo, B, 2.0, -1.0);
+
+            for (unsigned int uIdx = 0; uIdx < 20; uIdx++)
+            {
+                Assert::AreEqual(Expected.GetAt(uIdx / 5, uIdx % 5), C.GetAt(uIdx / 5, uIdx % 5));
+            }
+
+            // A' * G' and G * A
+
+            CMatrix<double> G = B.SubMatrix(0, 0, 6, 3).Transpose();
+            CMatrix<double> F(4, 3);
+            F.Gemm(TransposeYes, A, TransposeYes, G, 0.5, 0.0);
+            CMatrix<double> FExpected = A.Transpose() * G.Transpose();
+
+            for (unsigned int uIdx = 0; uIdx < 12; uIdx++)
+            {
+                Assert::AreEqual(0.5 * FExpected.GetAt(uIdx / 3, uIdx % 3), F.GetAt(uIdx / 3, uIdx % 3));
+            }
+
+            CMatrix<double> H(3, 4);
+            H.Gemm(TransposeNo, G, TransposeNo, A, 1.0, 0.0);
+            CMatrix<double> HExpected = G * A;
+
+            Assert::IsTrue(std::equal(HExpected.begin(), HExpected.end(), H.begin()));
+
+            auto WrongInner = [&C, &A, &B] { C.Gemm(TransposeNo, A, TransposeNo, B, 1.0, 0.0); };
+            Assert::ExpectException<CAppException>(WrongInner);
+
+            auto Aliased = [&F] { F.Gemm(TransposeNo, F, TransposeNo, F, 1.0, 0.0); };
+            Assert::ExpectException<CAppException>(Aliased);
+        }
+    };
+}
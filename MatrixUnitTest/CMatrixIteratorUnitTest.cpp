@@ -0,0 +1,124 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMatrix.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Matrix Iterator Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    TEST_CLASS(MatrixIteratorTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(ElementIterators)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Element iterators")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ElementIterators)
+        {
+            int Data[] = { 5, 3, 8, 1, 9, 2 };
+            CMatrix<int> m(2, 3, Data);
+
+            Assert::AreEqual((size_t)6, m.size());
+            Assert::AreEqual(28, std::accumulate(m.begin(), m.end(), 0));
+            Assert::AreEqual(28, std::reduce(m.cbegin(), m.cend()));
+            Assert::AreEqual(m.GetAt(1, 1), m.data()[1 * m.NumColumns() + 1]);
+
+            std::sort(m.begin(), m.end());
+            Assert::AreEqual(1, m.GetAt(0, 0));
+            Assert::AreEqual(9, m.GetAt(1, 2));
+
+            int nExpected = 0;
+
+            for (int & nElement : m)
+            {
+                nElement *= 2;
+            }
+
+            for (int nElement : static_cast<const CMatrix<int> &>(m))
+            {
+                nExpected += nElement;
+            }
+
+            Assert::AreEqual(56, nExpected);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(RowIterators)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Row iterators")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(RowIterators)
+        {
+            int Data[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+            CMatrix<int> m(3, 4, Data);
+
+            Assert::AreEqual(26, std::accumulate(m.row_begin(1), m.row_end(1), 0));
+            Assert::IsTrue(m.row_ptr(2) == m.data() + 8);
+
+            std::transform(m.row_begin(0), m.row_end(0), m.row_begin(2), m.row_begin(2), std::plus<int>());
+            Assert::AreEqual(10, m.GetAt(2, 0));
+            Assert::AreEqual(16, m.GetAt(2, 3));
+            Assert::AreEqual(5, m.GetAt(1, 0));
+
+            const CMatrix<int> & c = m;
+            Assert::AreEqual(8, *std::max_element(c.row_begin(1), c.row_end(1)));
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ColumnIterators)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Column iterators")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ColumnIterators)
+        {
+            int Data[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+            CMatrix<int> m(4, 3, Data);
+
+            Assert::AreEqual(4, (int)(m.column_end(1) - m.column_begin(1)));
+            Assert::AreEqual(2 + 5 + 8 + 11, std::accumulate(m.column_begin(1), m.column_end(1), 0));
+
+            CMatrix<int>::column_iterator It = m.column_begin(2);
+            Assert::AreEqual(3, *It);
+            Assert::AreEqual(9, It[2]);
+            Assert::AreEqual(12, *(It + 3));
+            Assert::AreEqual(6, *(1 + It));
+            It += 3;
+            --It;
+            Assert::AreEqual(9, *It);
+            Assert::IsTrue(m.column_begin(2) < It);
+
+            // Reversing a column leaves the other columns alone
+
+            std::reverse(m.column_begin(0), m.column_end(0));
+            Assert::AreEqual(10, m.GetAt(0, 0));
+            Assert::AreEqual(1, m.GetAt(3, 0));
+            Assert::AreEqual(2, m.GetAt(0, 1));
+
+            std::sort(m.column_begin(0), m.column_end(0));
+            Assert::AreEqual(1, m.GetAt(0, 0));
+            Assert::AreEqual(10, m.GetAt(3, 0));
+
+            // A mutable column iterator converts to a const one
+
+            const CMatrix<int> & c = m;
+            CMatrix<int>::const_column_iterator Begin = m.column_begin(1);
+            Assert::AreEqual(26, std::accumulate(Begin, c.column_end(1), 0));
+
+            std::vector<int> Column(c.column_begin(2), c.column_end(2));
+            Assert::AreEqual((size_t)4, Column.size());
+            Assert::AreEqual(12, Column[3]);
+        }
+    };
+}
@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMatrix.h"
+#include <math.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Matrix Power Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    static void AssertNear(const CMatrix<double> & m, unsigned int uRow, unsigned int uCol, double dExpected)
+    {
+        double dTolerance = 1e-12 * (1.0 + fabs(dExpected));
+
+        Assert::IsTrue(fabs(m.GetAt(uRow, uCol) - dExpected) <= dTolerance);
+    }
+
+    TEST_CLASS(MatrixPowerTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(IntegerPower)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Matrix power")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(IntegerPower)
+        {
+            int Data[] = { 1, 1, 0, 1, 0, 1, 2, 0, 1 };
+            CMatrix<int> m(3, 3, Data);
+            CMatrix<int> Expected = m;
+
+            for (unsigned int uExponent = 1; uExponent <= 13; uExponent++)
+            {
+                CMatrix<int> Power = m.Power(uExponent);
+
+                for (unsigned int uIdx = 0; uIdx < 9; uIdx++)
+                {
+                    Assert::AreEqual(Expected.GetAt(uIdx / 3, uIdx % 3), Power.GetAt(uIdx / 3, uIdx % 3));
+                }
+
+                Expected = Expected * m;
+            }
+
+            CMatrix<int> Identity = m.Power(0);
+
+            for (unsigned int uIdx = 0; uIdx < 9; uIdx++)
+            {
+                Assert::AreEqual((uIdx / 3 == uIdx % 3) ? 1 : 0, Identity.GetAt(uIdx / 3, uIdx % 3));
+            }
+
+            // Fibonacci numbers, F(31) and F(30)
+
+            int Fibonacci[] = { 1, 1, 1, 0 };
+            CMatrix<int> f = CMatrix<int>(2, 2, Fibonacci).Power(30);
+
+            Assert::AreEqual(1346269, f.GetAt(0, 0));
+            Assert::AreEqual(832040, f.GetAt(0, 1));
+
+            CMatrix<int> NotSquare(2, 3);
+            auto PowerNotSquare = [&NotSquare] { NotSquare.Power(2); };
+            Assert::ExpectException<CAppException>(PowerNotSquare);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(Exponential)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Matrix exponential")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(Exponential)
+        {
+            // Diagonal, including a norm large enough to need squaring
+
+            double Diagonal[] = { 0.0, 0.0, 0.0, 0.0, -5.0, 0.0, 0.0, 0.0, 10.0 };
+            CMatrix<double> d = CMatrix<double>(3, 3, Diagonal).Exp();
+
+            AssertNear(d, 0, 0, 1.0);
+            AssertNear(d, 1, 1, exp(-5.0));
+            AssertNear(d, 2, 2, exp(10.0));
+            AssertNear(d, 0, 2, 0.0);
+
+            // Nilpotent, the series stops after the linear term
+
+            double Nilpotent[] = { 0.0, 1.0, 0.0, 0.0 };
+            CMatrix<double> n = CMatrix<double>(2, 2, Nilpotent).Exp();
+
+            AssertNear(n, 0, 0, 1.0);
+            AssertNear(n, 0, 1, 1.0);
+            AssertNear(n, 1, 0, 0.0);
+            AssertNear(n, 1, 1, 1.0);
+
+            // A rotation by 3 radians
+
+            double Rotation[] = { 0.0, -3.0, 3.0, 0.0 };
+            CMatrix<double> r = CMatrix<double>(2, 2, Rotation).Exp();
+
+            AssertNear(r, 0, 0, cos(3.0));
+            AssertNear(r, 0, 1, -sin(3.0));
+            AssertNear(r, 1, 0, sin(3.0));
+            AssertNear(r, 1, 1, cos(3.0));
+
+            // e ^ (A + A) = (e ^ A) ^ 2 since A commutes with itself
+
+            CMatrix<double> a(6, 6);
+
+            for (unsigned int uIdx = 0; uIdx < 36; uIdx++)
+            {
+                a.SetAt(uIdx / 6, uIdx % 6, 0.1 * (double)((uIdx * 7) % 11) - 0.5);
+            }
+
+            CMatrix<double> Twice = (a + a).Exp();
+            CMatrix<double> Squared = a.Exp().Power(2);
+
+            for (unsigned int uIdx = 0; uIdx < 36; uIdx++)
+            {
+                Assert::IsTrue(fabs(Twice.GetAt(uIdx / 6, uIdx % 6) - Squared.GetAt(uIdx / 6, uIdx % 6)) < 1e-10);
+            }
+
+            CMatrix<double> NotSquare(3, 2);
+            auto ExpNotSquare = [&NotSquare] { NotSquare.Exp(); };
+            Assert::ExpectException<CAppException>(ExpNotSquare);
+        }
+    };
+}
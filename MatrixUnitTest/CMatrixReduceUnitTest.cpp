@@ -0,0 +1,254 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMatrix.h"
+#include "TestMatrices.h"
+#include <math.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Reduction Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    // Large enough for the reductions to be split over the workers.
+
+    static const unsigned int REDUCE_ROWS = 300;
+    static const unsigned int REDUCE_COLUMNS = 301;
+
+    TEST_CLASS(MatrixReduceTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(SmallReductions)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Reductions")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SmallReductions)
+        {
+            int Data[] = { 3, -7, 2,
+                           -1, 5, -7 };
+
+            CMatrix<int> m(2, 3, Data);
+            unsigned int uRow = 99;
+            unsigned int uCol = 99;
+
+            Assert::AreEqual(-5, m.Sum());
+            Assert::AreEqual(-5, m.Sum(SumNaive));
+            Assert::AreEqual(-5, m.Sum(SumKahan));
+
+            // The first of the two -7 is reported
+
+            Assert::AreEqual(-7, m.Min(&uRow, &uCol));
+            Assert::AreEqual((unsigned int)0, uRow);
+            Assert::AreEqual((unsigned int)1, uCol);
+
+            Assert::AreEqual(5, m.Max(&uRow, &uCol));
+            Assert::AreEqual((unsigned int)1, uRow);
+            Assert::AreEqual((unsigned int)1, uCol);
+
+            Assert::AreEqual(sqrt(137.0), m.FrobeniusNorm(), 1e-12);
+            Assert::AreEqual(12.0, m.OneNorm());
+            Assert::AreEqual(13.0, m.InfinityNorm());
+
+            CMatrix<int> RowSums = m.RowSums();
+            Assert::AreEqual((unsigned int)2, RowSums.NumRows());
+            Assert::AreEqual((unsigned int)1, RowSums.NumColumns());
+            Assert::AreEqual(-2, RowSums.GetAt(0, 0));
+            Assert::AreEqual(-3, RowSums.GetAt(1, 0));
+
+            CMatrix<int> ColumnSums = m.ColumnSums();
+            Assert::AreEqual((unsigned int)1, ColumnSums.NumRows());
+            Assert::AreEqual((unsigned int)3, ColumnSums.NumColumns());
+            Assert::AreEqual(2, ColumnSums.GetAt(0, 0));
+            Assert::AreEqual(-2, ColumnSums.GetAt(0, 1));
+            Assert::AreEqual(-5, ColumnSums.GetAt(0, 2));
+
+            CMatrix<double> ColumnMeans = m.ColumnMeans();
+            Assert::AreEqual(-2.5, ColumnMeans.GetAt(0, 2));
+            Assert::AreEqual(-1.0, m.RowMeans().GetAt(1, 0));
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(LargeReductions)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Reductions")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(LargeReductions)
+        {
+            CThreadPool::Instance().Configure(4, AffinityNone);
+
+            CMatrix<int> m = SeededMatrix<int>(REDUCE_ROWS, REDUCE_COLUMNS, 0, -14, 14);
+
+            // Make the extremes unique except for one tie, in the last chunk
+
+            m.SetAt(250, 17, 1000);
+            m.SetAt(251, 3, 1000);
+            m.SetAt(100, 200, -1000);
+
+            long long llSum = 0;
+            double dSumSquares = 0.0;
+            double dInfinityNorm = 0.0;
+            std::vector<int> RowSums(REDUCE_ROWS, 0);
+            std::vector<int> ColumnSums(REDUCE_COLUMNS, 0);
+            std::vector<double> ColumnAbsSums(REDUCE_COLUMNS, 0.0);
+
+            for (unsigned int uRow = 0; uRow < REDUCE_ROWS; uRow++)
+            {
+                double dRowAbsSum = 0.0;
+
+                for (unsigned int uCol = 0; uCol < REDUCE_COLUMNS; uCol++)
+                {
+                    int nValue = m.GetAt(uRow, uCol);
+
+                    llSum += nValue;
+                    dSumSquares += (double)nValue * nValue;
+                    dRowAbsSum += abs(nValue);
+                    RowSums[uRow] += nValue;
+                    ColumnSums[uCol] += nValue;
+                    ColumnAbsSums[uCol] += abs(nValue);
+                }
+
+                dInfinityNorm = (dRowAbsSum > dInfinityNorm) ? dRowAbsSum : dInfinityNorm;
+            }
+
+            double dOneNorm = 0.0;
+
+            for (unsigned int uCol = 0; uCol < REDUCE_COLUMNS; uCol++)
+            {
+                dOneNorm = (ColumnAbsSums[uCol] > dOneNorm) ? ColumnAbsSums[uCol] : dOneNorm;
+            }
+
+            const ESummation Methods[] = { SumNaive, SumPairwise, SumKahan };
+
+            for (unsigned int uIdx = 0; uIdx < sizeof(Methods) / sizeof(Methods[0]); uIdx++)
+            {
+                Assert::AreEqual((int)llSum, m.Sum(Methods[uIdx]));
+
+                CMatrix<int> Rows = m.RowSums(Methods[uIdx]);
+                CMatrix<int> Columns = m.ColumnSums(Methods[uIdx]);
+
+                for (unsigned int uRow = 0; uRow < REDUCE_ROWS; uRow++)
+                {
+                    Assert::AreEqual(RowSums[uRow], Rows.GetAt(uRow, 0));
+                }
+
+                for (unsigned int uCol = 0; uCol < REDUCE_COLUMNS; uCol++)
+                {
+                    Assert::AreEqual(ColumnSums[uCol], Columns.GetAt(0, uCol));
+                }
+            }
+
+            unsigned int uRow = 0;
+            unsigned int uCol = 0;
+
+            Assert::AreEqual(1000, m.Max(&uRow, &uCol));
+            Assert::AreEqual((unsigned int)250, uRow);
+            Assert::AreEqual((unsigned int)17, uCol);
+
+            Assert::AreEqual(-1000, m.Min(&uRow, &uCol));
+            Assert::AreEqual((unsigned int)100, uRow);
+            Assert::AreEqual((unsigned int)200, uCol);
+
+            Assert::AreEqual(sqrt(dSumSquares), m.FrobeniusNorm(), 1e-9);
+            Assert::AreEqual(dOneNorm, m.OneNorm());
+            Assert::AreEqual(dInfinityNorm, m.InfinityNorm());
+
+            CThreadPool::Instance().Configure(0, AffinityNone);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(CompensatedSum)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Reductions")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(CompensatedSum)
+        {
+            // One large value followed by many values that are each lost
+            // when added to it one at a time in single precision.
+
+            CMatrix<float> m(REDUCE_ROWS, REDUCE_COLUMNS);
+            m.SetAt(0, 0, 1.0e8f);
+
+            for (unsigned int uRow = 0; uRow < REDUCE_ROWS; uRow++)
+            {
+                for (unsigned int uCol = (uRow == 0) ? 1 : 0; uCol < REDUCE_COLUMNS; uCol++)
+                {
+                    m.SetAt(uRow, uCol, 1.0f);
+                }
+            }
+
+            double dExact = 1.0e8 + (double)REDUCE_ROWS * REDUCE_COLUMNS - 1.0;
+
+            Assert::AreEqual(dExact, (double)m.Sum(SumKahan), 8.0);
+            Assert::IsTrue(fabs(dExact - (double)m.Sum(SumPairwise)) <= fabs(dExact - (double)m.Sum(SumNaive)));
+            Assert::AreEqual(dExact, (double)m.ColumnSums(SumKahan).Sum(SumKahan), 8.0);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(EmptyMatrix)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Reductions")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(EmptyMatrix)
+        {
+            CMatrix<int> m(0, 4);
+
+            Assert::AreEqual(0, m.Sum());
+            Assert::AreEqual(0.0, m.FrobeniusNorm());
+            Assert::AreEqual(0, m.ColumnSums().GetAt(0, 3));
+
+            try
+            {
+                m.Min();
+
+                Logger::WriteMessage("An exception was expected to be thrown");
+                Assert::IsFalse(true);
+            }
+            catch (CAppException ex)
+            {
+                Assert::AreEqual(ex.what(), "Matrix is empty");
+            }
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ApplyAndMap)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Element-wise functions")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ApplyAndMap)
+        {
+            CMatrix<int> m = SeededMatrix<int>(REDUCE_ROWS, REDUCE_COLUMNS, 0, -14, 14);
+            CMatrix<int> Original = m;
+
+            CMatrix<double> Halves = m.Map([](int nValue) { return(nValue / 2.0); });
+            CMatrix<bool> Positive = m.Map([](int nValue) { return(nValue > 0); });
+
+            m.Apply([](int nValue) { return(nValue * nValue); });
+
+            for (unsigned int uRow = 0; uRow < REDUCE_ROWS; uRow++)
+            {
+                for (unsigned int uCol = 0; uCol < REDUCE_COLUMNS; uCol++)
+                {
+                    int nValue = Original.GetAt(uRow, uCol);
+
+                    Assert::AreEqual(nValue / 2.0, Halves.GetAt(uRow, uCol));
+                    Assert::AreEqual(nValue > 0, Positive.GetAt(uRow, uCol));
+                    Assert::AreEqual(nValue * nValue, m.GetAt(uRow, uCol));
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,161 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CModularMatrix.h"
+#include "TestMatrices.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Modular Matrix Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    TEST_CLASS(ModularMatrixTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(ElementArithmetic)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Modular arithmetic")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ElementArithmetic)
+        {
+            int Data[] = { -1, 7, 15, -22 };
+            CModularMatrix a(CMatrix<int>(2, 2, Data), 7);
+
+            Assert::AreEqual(6u, a.GetAt(0, 0));
+            Assert::AreEqual(0u, a.GetAt(0, 1));
+            Assert::AreEqual(1u, a.GetAt(1, 0));
+            Assert::AreEqual(6u, a.GetAt(1, 1));
+
+            CModularMatrix b = CModularMatrix::Identity(2, 7).Scale(3);
+            CModularMatrix Sum = a + b;
+            CModularMatrix Difference = a - b;
+
+            Assert::AreEqual(2u, Sum.GetAt(0, 0));
+            Assert::AreEqual(0u, Sum.GetAt(0, 1));
+            Assert::AreEqual(3u, Difference.GetAt(0, 0));
+            Assert::AreEqual(3u, Difference.GetAt(1, 1));
+            Assert::AreEqual(4, a.Scale(3).ToMatrix().GetAt(0, 0));
+
+            // The modulus near 2^31 leaves room for few products only
+
+            const unsigned int uPrime = 2147483647U;
+            CModulus Large(uPrime);
+
+            Assert::IsTrue(Large.LazyProducts() >= 1);
+            Assert::AreEqual(0xFFFFFFFFU, CModulus(2).LazyProducts());
+            Assert::AreEqual((unsigned int)((unsigned long long)(uPrime - 1) * (uPrime - 2) % uPrime), Large.Multiply(uPrime - 1, uPrime - 2));
+            Assert::AreEqual(1u, Large.Multiply(Large.Inverse(123456789), 123456789));
+            Assert::AreEqual((unsigned int)(~0ULL % uPrime), Large.Reduce(~0ULL));
+
+            auto BadModulus = [] { CModulus m(0x80000000U); };
+            Assert::ExpectException<CAppException>(BadModulus);
+
+            CModularMatrix c(2, 2, 11);
+            auto MixedModulus = [&a, &c] { a + c; };
+            Assert::ExpectException<CAppException>(MixedModulus);
+
+            try
+            {
+                a - CModularMatrix(3, 2, 7);
+
+                Logger::WriteMessage("An exception was expected to be thrown");
+                Assert::IsFalse(true);
+            }
+            catch (CAppException ex)
+            {
+                Assert::AreEqual(ex.what(), "Matrixes must be the same size to subtract them.");
+            }
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(LazyProduct)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Modular product")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(LazyProduct)
+        {
+            // A small modulus that never folds, one that folds every few
+            // products, and a composite one
+
+            const unsigned int Moduli[] = { 97, 1000003, 2147483647U, 2147483646U };
+
+            for (unsigned int uModulus : Moduli)
+            {
+                CModularMatrix A(SeededMatrix<int>(9, 37, uModulus, 0, 0x7FFFFFFF), uModulus);
+                CModularMatrix B(SeededMatrix<int>(37, 13, 7, 0, 0x7FFFFFFF), uModulus);
+                CModularMatrix C = A * B;
+
+                for (unsigned int uRow = 0; uRow < 9; uRow++)
+                {
+                    for (unsigned int uCol = 0; uCol < 13; uCol++)
+                    {
+                        unsigned long long ullSum = 0;
+
+                        for (unsigned int uDot = 0; uDot < 37; uDot++)
+                        {
+                            ullSum = (ullSum + (unsigned long long)A.GetAt(uRow, uDot) * B.GetAt(uDot, uCol) % uModulus) % uModulus;
+                        }
+
+                        Assert::AreEqual((unsigned int)ullSum, C.GetAt(uRow, uCol));
+                    }
+                }
+            }
+
+            CModularMatrix A(2, 3, 5);
+            auto WrongSize = [&A] { A * A; };
+            Assert::ExpectException<CAppException>(WrongSize);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ModularInverse)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Modular inverse")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ModularInverse)
+        {
+            const unsigned int Moduli[] = { 1000003, 2147483647U };
+
+            for (unsigned int uModulus : Moduli)
+            {
+                CModularMatrix A(SeededMatrix<int>(12, 12, 11, 0, 0x7FFFFFFF), uModulus);
+                CModularMatrix Product = A * A.Inverse();
+
+                for (unsigned int uRow = 0; uRow < 12; uRow++)
+                {
+                    for (unsigned int uCol = 0; uCol < 12; uCol++)
+                    {
+                        Assert::AreEqual((uRow == uCol) ? 1u : 0u, Product.GetAt(uRow, uCol));
+                    }
+                }
+            }
+
+            // Needs a row swap: the first pivot is zero
+
+            int Data[] = { 0, 1, 1, 0 };
+            CModularMatrix Swap(CMatrix<int>(2, 2, Data), 5);
+            Assert::AreEqual(1u, Swap.Inverse().GetAt(0, 1));
+
+            // Rows equal modulo 5
+
+            int Singular[] = { 1, 2, 6, 7 };
+            CModularMatrix s(CMatrix<int>(2, 2, Singular), 5);
+            auto InvertSingular = [&s] { s.Inverse(); };
+            Assert::ExpectException<CAppException>(InvertSingular);
+
+            // 2 has no inverse modulo 4
+
+            int Even[] = { 2, 0, 0, 1 };
+            CModularMatrix e(CMatrix<int>(2, 2, Even), 4);
+            auto InvertEven = [&e] { e.Inverse(); };
+            Assert::ExpectException<CAppException>(InvertEven);
+        }
+    };
+}
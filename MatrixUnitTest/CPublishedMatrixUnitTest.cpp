@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CPublishedMatrix.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Published Matrix Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    TEST_CLASS(PublishedMatrixTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(SnapshotsStayStable)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Snapshots")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SnapshotsStayStable)
+        {
+            CMatrix<int> Initial(2, 2);
+            Initial.SetAt(0, 0, 1);
+
+            CPublishedMatrix<int> Published(Initial, 2);
+            CPublishedMatrix<int>::CSnapshot First = Published.Snapshot();
+
+            Assert::AreEqual(0ULL, First.Version());
+            Assert::AreEqual(1, First->GetAt(0, 0));
+
+            // The back buffer starts as a copy of the published matrix
+
+            CMatrix<int> & Back = Published.BeginUpdate();
+            Assert::AreEqual(1, Back.GetAt(0, 0));
+            Back.SetAt(0, 0, 2);
+
+            Assert::AreEqual(1, First->GetAt(0, 0));
+            Assert::AreEqual(1, Published.Snapshot()->GetAt(0, 0));
+
+            Published.Publish();
+
+            CPublishedMatrix<int>::CSnapshot Second = Published.Snapshot();
+            Assert::AreEqual(1ULL, Second.Version());
+            Assert::AreEqual(2, (*Second).GetAt(0, 0));
+            Assert::AreEqual(1, First->GetAt(0, 0));
+
+            // Moving a snapshot keeps the buffer held
+
+            CPublishedMatrix<int>::CSnapshot Moved(std::move(First));
+            Assert::AreEqual(0ULL, Moved.Version());
+
+            Moved = std::move(Second);
+            Assert::AreEqual(1ULL, Moved.Version());
+
+            // Nothing holds the first buffer any more, so the writer gets it
+            // back. The size may change with an update.
+
+            Published.BeginUpdate(false) = CMatrix<int>(3, 1);
+            Published.Publish();
+
+            Assert::AreEqual(3u, Published.Snapshot()->NumRows());
+            Assert::AreEqual(2u, Moved->NumRows());
+            Assert::AreEqual(2ULL, Published.Version());
+
+            auto PublishTwice = [&Published] { Published.Publish(); };
+            Assert::ExpectException<CAppException>(PublishTwice);
+
+            auto OneBuffer = [&Initial] { CPublishedMatrix<int> p(Initial, 1); };
+            Assert::ExpectException<CAppException>(OneBuffer);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ConcurrentReaders)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Snapshots")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ConcurrentReaders)
+        {
+            // Every publish fills the whole matrix with its version number,
+            // so a reader that ever sees two different values in one
+            // snapshot has seen a buffer while it was being written.
+
+            const unsigned int uSize = 32;
+            const unsigned long long ullPublishes = 2000;
+
+            CPublishedMatrix<unsigned long long> Published(CMatrix<unsigned long long>(uSize, uSize), 3);
+            std::atomic<bool> bDone(false);
+            std::atomic<unsigned int> uTorn(0);
+            std::atomic<unsigned int> uBackwards(0);
+            std::vector<std::thread> Readers;
+
+            for (unsigned int uReader = 0; uReader < 4; uReader++)
+            {
+                Readers.emplace_back([&]
+                {
+                    unsigned long long ullLast = 0;
+
+                    while (!bDone.load())
+                    {
+                        CPublishedMatrix<unsigned long long>::CSnapshot Snapshot = Published.Snapshot();
+                        const unsigned long long ullVersion = Snapshot.Version();
+
+                        for (unsigned long long ullElement : *Snapshot)
+                        {
+                            if (ullElement != ullVersion)
+                            {
+                                uTorn++;
+                                break;
+                            }
+                        }
+
+                        if (ullVersion < ullLast)
+                        {
+                            uBackwards++;
+                        }
+
+                        ullLast = ullVersion;
+                    }
+                });
+            }
+
+            for (unsigned long long ullVersion = 1; ullVersion <= ullPublishes; ullVersion++)
+            {
+                CMatrix<unsigned long long> & Back = Published.BeginUpdate(false);
+
+                std::fill(Back.begin(), Back.end(), ullVersion);
+                Published.Publish();
+            }
+
+            bDone.store(true);
+
+            for (std::thread & Reader : Readers)
+            {
+                Reader.join();
+            }
+
+            Assert::AreEqual(0u, uTorn.load());
+            Assert::AreEqual(0u, uBackwards.load());
+            Assert::AreEqual(ullPublishes, Published.Snapshot().Version());
+        }
+    };
+}
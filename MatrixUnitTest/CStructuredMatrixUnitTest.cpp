@@ -0,0 +1,240 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CBandedMatrix.h"
+#include "..\MatrixArithmetic\CDiagonalMatrix.h"
+#include "..\MatrixArithmetic\CSymmetricMatrix.h"
+#include "..\MatrixArithmetic\CTriangularMatrix.h"
+#include "TestMatrices.h"
+#include <math.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Structured Matrix Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    TEST_CLASS(StructuredMatrixTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(TriangularMultiply)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Triangular matrix")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(TriangularMultiply)
+        {
+            CMatrix<int> Dense = SeededMatrix<int>(9, 9, 1, -6, 6);
+            CMatrix<int> B = SeededMatrix<int>(9, 5, 4, -6, 6);
+            const ETriangle Triangles[] = { TriangleLower, TriangleUpper };
+
+            for (unsigned int uIdx = 0; uIdx < 2; uIdx++)
+            {
+                CTriangularMatrix<int> t(Dense, Triangles[uIdx]);
+                CMatrix<int> Full = t.ToMatrix();
+
+                for (unsigned int uRow = 0; uRow < 9; uRow++)
+                {
+                    for (unsigned int uCol = 0; uCol < 9; uCol++)
+                    {
+                        bool bInside = (Triangles[uIdx] == TriangleLower) ? (uCol <= uRow) : (uCol >= uRow);
+                        Assert::AreEqual(bInside ? Dense.GetAt(uRow, uCol) : 0, Full.GetAt(uRow, uCol));
+                    }
+                }
+
+                AssertMatrixEqual(Full * B, t * B);
+            }
+
+            // Packed order as documented
+
+            int Packed[] = { 1, 2, 3, 4, 5, 6 };
+            CTriangularMatrix<int> Upper(3, TriangleUpper, Packed);
+
+            Assert::AreEqual(3, Upper.GetAt(0, 2));
+            Assert::AreEqual(5, Upper.GetAt(1, 2));
+            Assert::AreEqual(0, Upper.GetAt(2, 1));
+
+            Upper.SetAt(2, 2, 9);
+            Assert::AreEqual(9, Upper.GetAt(2, 2));
+
+            auto SetOutside = [&Upper] { Upper.SetAt(2, 0, 1); };
+            Assert::ExpectException<CAppException>(SetOutside);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(TriangularSolve)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Triangular matrix")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(TriangularSolve)
+        {
+            const unsigned int uSize = 12;
+            CMatrix<double> Dense(uSize, uSize);
+            CMatrix<double> X(uSize, 7);
+
+            for (unsigned int uRow = 0; uRow < uSize; uRow++)
+            {
+                for (unsigned int uCol = 0; uCol < uSize; uCol++)
+                {
+                    Dense.SetAt(uRow, uCol, (uRow == uCol) ? 4.0 + uRow : 0.25 * (double)((uRow + 2 * uCol) % 5) - 0.5);
+                }
+
+                for (unsigned int uCol = 0; uCol < 7; uCol++)
+                {
+                    X.SetAt(uRow, uCol, (double)((uRow * 5 + uCol) % 9) - 4.0);
+                }
+            }
+
+            const ETriangle Triangles[] = { TriangleLower, TriangleUpper };
+
+            for (unsigned int uIdx = 0; uIdx < 2; uIdx++)
+            {
+                CTriangularMatrix<double> t(Dense, Triangles[uIdx]);
+                CMatrix<double> Solved = t.Solve(t * X);
+
+                for (unsigned int uRow = 0; uRow < uSize; uRow++)
+                {
+                    for (unsigned int uCol = 0; uCol < 7; uCol++)
+                    {
+                        Assert::IsTrue(fabs(X.GetAt(uRow, uCol) - Solved.GetAt(uRow, uCol)) < 1e-9);
+                    }
+                }
+            }
+
+            CTriangularMatrix<double> Singular(3, TriangleLower);
+            CMatrix<double> B(3, 1);
+            auto SolveSingular = [&Singular, &B] { Singular.Solve(B); };
+            Assert::ExpectException<CAppException>(SolveSingular);
+
+            CTriangularMatrix<double> t(Dense, TriangleLower);
+            auto SolveMismatch = [&t, &B] { t.Solve(B); };
+            Assert::ExpectException<CAppException>(SolveMismatch);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(SymmetricMultiply)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Symmetric matrix")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(SymmetricMultiply)
+        {
+            CMatrix<int> Dense = SeededMatrix<int>(10, 10, 2, -6, 6);
+            CMatrix<int> B = SeededMatrix<int>(10, 6, 5, -6, 6);
+            CSymmetricMatrix<int> s(Dense);
+            CMatrix<int> Full = s.ToMatrix();
+
+            for (unsigned int uRow = 0; uRow < 10; uRow++)
+            {
+                for (unsigned int uCol = 0; uCol <= uRow; uCol++)
+                {
+                    Assert::AreEqual(Dense.GetAt(uRow, uCol), Full.GetAt(uRow, uCol));
+                    Assert::AreEqual(Dense.GetAt(uRow, uCol), Full.GetAt(uCol, uRow));
+                }
+            }
+
+            AssertMatrixEqual(Full * B, s * B);
+
+            s.SetAt(1, 8, 42);
+            Assert::AreEqual(42, s.GetAt(8, 1));
+
+            CMatrix<int> NotSquare(2, 3);
+            auto FromNotSquare = [&NotSquare] { CSymmetricMatrix<int> t(NotSquare); };
+            Assert::ExpectException<CAppException>(FromNotSquare);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(BandedMultiply)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Banded matrix")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(BandedMultiply)
+        {
+            // Square, wide and tall, with bands wider than the matrix at the
+            // edges
+
+            const unsigned int Shapes[][4] = { { 11, 11, 1, 1 }, { 6, 10, 2, 3 }, { 10, 6, 4, 0 }, { 4, 4, 6, 6 } };
+
+            for (unsigned int uShape = 0; uShape < 4; uShape++)
+            {
+                unsigned int uRows = Shapes[uShape][0];
+                unsigned int uCols = Shapes[uShape][1];
+                CMatrix<int> Dense = SeededMatrix<int>(uRows, uCols, 3, -6, 6);
+                CMatrix<int> B = SeededMatrix<int>(uCols, 5, 6, -6, 6);
+                CBandedMatrix<int> b(Dense, Shapes[uShape][2], Shapes[uShape][3]);
+                CMatrix<int> Full = b.ToMatrix();
+
+                for (unsigned int uRow = 0; uRow < uRows; uRow++)
+                {
+                    for (unsigned int uCol = 0; uCol < uCols; uCol++)
+                    {
+                        bool bInside = uCol + Shapes[uShape][2] >= uRow && uCol <= uRow + Shapes[uShape][3];
+                        Assert::AreEqual(bInside ? Dense.GetAt(uRow, uCol) : 0, Full.GetAt(uRow, uCol));
+                        Assert::AreEqual(Full.GetAt(uRow, uCol), b.GetAt(uRow, uCol));
+                    }
+                }
+
+                AssertMatrixEqual(Full * B, b * B);
+            }
+
+            CBandedMatrix<int> Tridiagonal(5, 5, 1, 1);
+            Tridiagonal.SetAt(4, 3, 7);
+            Assert::AreEqual(7, Tridiagonal.GetAt(4, 3));
+
+            auto SetOutside = [&Tridiagonal] { Tridiagonal.SetAt(0, 2, 1); };
+            Assert::ExpectException<CAppException>(SetOutside);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(DiagonalMultiply)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Diagonal matrix")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(DiagonalMultiply)
+        {
+            int Diagonal[] = { 2, -1, 3, 5 };
+            CDiagonalMatrix<int> d(4, Diagonal);
+            CMatrix<int> Full = d.ToMatrix();
+            CMatrix<int> Left = SeededMatrix<int>(4, 6, 7, -6, 6);
+            CMatrix<int> Right = SeededMatrix<int>(3, 4, 8, -6, 6);
+
+            AssertMatrixEqual(Full * Left, d * Left);
+            AssertMatrixEqual(Right * Full, Right * d);
+            Assert::AreEqual(5, CDiagonalMatrix<int>(Full).GetAt(3, 3));
+            Assert::AreEqual(0, d.GetAt(1, 2));
+
+            CDiagonalMatrix<double> Scale(2);
+            Scale.SetAt(0, 0, 2.0);
+            Scale.SetAt(1, 1, 0.5);
+
+            CMatrix<double> B(2, 2);
+            B.SetAt(0, 0, 4.0);
+            B.SetAt(1, 1, 3.0);
+
+            CMatrix<double> X = Scale.Solve(B);
+            Assert::AreEqual(2.0, X.GetAt(0, 0));
+            Assert::AreEqual(6.0, X.GetAt(1, 1));
+
+            auto SetOffDiagonal = [&d] { d.SetAt(0, 1, 1); };
+            Assert::ExpectException<CAppException>(SetOffDiagonal);
+
+            auto WrongSize = [&d, &Right] { d * Right; };
+            Assert::ExpectException<CAppException>(WrongSize);
+
+            Scale.SetAt(1, 1, 0.0);
+            auto SolveSingular = [&Scale, &B] { Scale.Solve(B); };
+            Assert::ExpectException<CAppException>(SolveSingular);
+        }
+    };
+}
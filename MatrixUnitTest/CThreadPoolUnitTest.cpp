@@ -0,0 +1,305 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMatrix.h"
+#include "..\MatrixArithmetic\CThreadPool.h"
+#include "..\MatrixArithmetic\CDistributedMatrix.h"
+#include "..\MatrixArithmetic\CSocketTransport.h"
+#include "TestMatrices.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TEST_MY_TRAIT(traitValue) TEST_METHOD_ATTRIBUTE(L"Parallel Kernel Testing", traitValue)
+
+namespace MatrixUnitTest
+{
+    // Large enough for every kernel to take its parallel path and for the
+    // storage to be placed by the NUMA policy.
+
+    static const unsigned int LARGE_SIZE = 300;
+
+    // Checks every kernel of a large matrix against a straightforward
+    // computation done cell by cell.
+
+    static void CheckLargeKernels()
+    {
+        CMatrix<int> A = SeededMatrix<int>(LARGE_SIZE, LARGE_SIZE + 7, 1, -11, 11);
+        CMatrix<int> B = SeededMatrix<int>(LARGE_SIZE, LARGE_SIZE + 7, 2, -11, 11);
+        CMatrix<int> X = SeededMatrix<int>(LARGE_SIZE + 7, 1, 3, -11, 11);
+
+        CMatrix<int> Sum = A + B;
+        CMatrix<int> Difference = A - B;
+        CMatrix<int> Scaled = A * 3;
+        CMatrix<int> Transposed = A.Transpose();
+        CMatrix<int> Vector = A * X;
+
+        for (unsigned int uRow = 0; uRow < A.NumRows(); uRow++)
+        {
+            int nDot = 0;
+
+            for (unsigned int uCol = 0; uCol < A.NumColumns(); uCol++)
+            {
+                Assert::AreEqual(A.GetAt(uRow, uCol) + B.GetAt(uRow, uCol), Sum.GetAt(uRow, uCol));
+                Assert::AreEqual(A.GetAt(uRow, uCol) - B.GetAt(uRow, uCol), Difference.GetAt(uRow, uCol));
+                Assert::AreEqual(A.GetAt(uRow, uCol) * 3, Scaled.GetAt(uRow, uCol));
+                Assert::AreEqual(A.GetAt(uRow, uCol), Transposed.GetAt(uCol, uRow));
+
+                nDot += A.GetAt(uRow, uCol) * X.GetAt(uCol, 0);
+            }
+
+            Assert::AreEqual(nDot, Vector.GetAt(uRow, 0));
+        }
+
+        CMatrix<int> Product = A * Transposed;
+
+        for (unsigned int uRow = 0; uRow < Product.NumRows(); uRow += 37)
+        {
+            for (unsigned int uCol = 0; uCol < Product.NumColumns(); uCol += 41)
+            {
+                int nDot = 0;
+
+                for (unsigned int uDot = 0; uDot < A.NumColumns(); uDot++)
+                {
+                    nDot += A.GetAt(uRow, uDot) * A.GetAt(uCol, uDot);
+                }
+
+                Assert::AreEqual(nDot, Product.GetAt(uRow, uCol));
+            }
+        }
+    }
+
+    TEST_CLASS(ThreadPoolTest)
+    {
+    public:
+        BEGIN_TEST_METHOD_ATTRIBUTE(ParallelForCoversRange)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Thread pool")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ParallelForCoversRange)
+        {
+            CThreadPool & Pool = CThreadPool::Instance();
+            std::vector<int> Hits(1000, 0);
+
+            Pool.ParallelFor((unsigned int)Hits.size(), [&](unsigned int uBegin, unsigned int uEnd)
+            {
+                for (unsigned int uIdx = uBegin; uIdx < uEnd; uIdx++)
+                {
+                    Hits[uIdx]++;
+                }
+            });
+
+            for (size_t uIdx = 0; uIdx < Hits.size(); uIdx++)
+            {
+                Assert::AreEqual(1, Hits[uIdx]);
+            }
+
+            // Worker numbers must grow node by node
+
+            for (unsigned int uWorker = 1; uWorker < Pool.NumWorkers(); uWorker++)
+            {
+                Assert::IsTrue(Pool.WorkerNode(uWorker - 1) <= Pool.WorkerNode(uWorker));
+            }
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ParallelForRethrows)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Thread pool")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ParallelForRethrows)
+        {
+            try
+            {
+                CThreadPool::Instance().ParallelFor(100, [](unsigned int, unsigned int)
+                {
+                    throw CAppException("Worker failed");
+                });
+
+                Logger::WriteMessage("An exception was expected to be thrown");
+                Assert::IsFalse(true);
+            }
+            catch (CAppException ex)
+            {
+                Assert::AreEqual(ex.what(), "Worker failed");
+            }
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(PinnedWorkers)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Thread affinity")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(PinnedWorkers)
+        {
+            CThreadPool & Pool = CThreadPool::Instance();
+
+            Pool.Configure(4, AffinityCpu);
+            Assert::AreEqual((unsigned int)4, Pool.NumWorkers());
+            CheckLargeKernels();
+
+            Pool.Configure(3, AffinityNode);
+            Assert::AreEqual((unsigned int)3, Pool.NumWorkers());
+            CheckLargeKernels();
+
+            Pool.Configure(0, AffinityNone);
+            Assert::AreEqual(Pool.Topology().NumCpus(), Pool.NumWorkers());
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(NumaPolicies)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"NUMA placement")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(NumaPolicies)
+        {
+            CThreadPool::Instance().Configure(4, AffinityNode);
+
+            const ENumaPolicy Policies[] = { NumaLocal, NumaInterleave, NumaBind, NumaFirstTouch };
+
+            for (unsigned int uIdx = 0; uIdx < sizeof(Policies) / sizeof(Policies[0]); uIdx++)
+            {
+                CMatrixMemory::SetPolicy(Policies[uIdx], 0);
+                Assert::AreEqual((int)Policies[uIdx], (int)CMatrixMemory::Policy());
+
+                CheckLargeKernels();
+            }
+
+            CMatrixMemory::SetPolicy(NumaLocal, 0);
+            CThreadPool::Instance().Configure(0, AffinityNone);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(LocalPolicyBypassesPool)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"NUMA placement")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(LocalPolicyBypassesPool)
+        {
+            // A large matrix is allocated on another thread while a parallel
+            // call holds the pool. Under the default policy the allocation
+            // does not wait for it; under first touch it would.
+
+            Assert::AreEqual((int)NumaLocal, (int)CMatrixMemory::Policy());
+
+            CThreadPool & Pool = CThreadPool::Instance();
+            Pool.Configure(2, AffinityNone);
+
+            std::atomic<unsigned int> uStarted(0);
+            std::atomic<bool> bRelease(false);
+            std::atomic<bool> bAllocated(false);
+
+            std::thread Job([&]()
+            {
+                Pool.RunOnWorkers([&](unsigned int)
+                {
+                    uStarted++;
+
+                    while (!bRelease)
+                    {
+                        std::this_thread::yield();
+                    }
+                });
+            });
+
+            while (uStarted < 2)
+            {
+                std::this_thread::yield();
+            }
+
+            std::thread Allocator([&]()
+            {
+                CMatrix<double> Large(LARGE_SIZE, LARGE_SIZE);
+                bAllocated = (Large.GetAt(LARGE_SIZE - 1, LARGE_SIZE - 1) == 0.0);
+            });
+
+            for (int nWait = 0; nWait < 1000 && !bAllocated; nWait++)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            bool bAllocatedWhileBusy = bAllocated;
+
+            bRelease = true;
+            Job.join();
+            Allocator.join();
+            Pool.Configure(0, AffinityNone);
+
+            Assert::IsTrue(bAllocatedWhileBusy);
+        }
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(AssignmentCopies)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"NUMA placement")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(AssignmentCopies)
+        {
+            CMatrix<int> Large = SeededMatrix<int>(LARGE_SIZE, LARGE_SIZE, 5, -11, 11);
+            CMatrix<int> m(2, 2);
+
+            m = Large;
+            Assert::AreEqual(Large.NumRows(), m.NumRows());
+            Assert::AreEqual(Large.GetAt(LARGE_SIZE - 1, LARGE_SIZE - 1), m.GetAt(LARGE_SIZE - 1, LARGE_SIZE - 1));
+
+            m = m;
+            Assert::AreEqual(Large.GetAt(7, 3), m.GetAt(7, 3));
+
+            m = CMatrix<int>(1, 3);
+            Assert::AreEqual((unsigned int)3, m.NumColumns());
+            Assert::AreEqual(0, m.GetAt(0, 2));
+        }
+
+#ifndef _WIN32
+
+        // -------------------------------------------------------------------
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(ForkedProcesses)
+            TEST_OWNER(L"Martin Fallenstedt")
+            TEST_PRIORITY(1)
+            TEST_MY_TRAIT(L"Thread pool")
+            END_TEST_METHOD_ATTRIBUTE()
+
+            TEST_METHOD(ForkedProcesses)
+        {
+            // The children inherit a running pool without its workers. The
+            // local tiles are large enough to be placed through the pool.
+
+            CThreadPool::Instance().Configure(4, AffinityNone);
+            CMatrixMemory::SetPolicy(NumaFirstTouch, 0);
+
+            CSocketTransport::RunProcesses(2, [](CMatrixTransport & Transport)
+            {
+                CProcessGrid Grid(Transport, 1, 2);
+                CDistributedMatrix<double> Dist(Grid, 1024, 1024, 64);
+
+                Assert::AreEqual((unsigned int)4, CThreadPool::Instance().NumWorkers());
+                CheckLargeKernels();
+            });
+
+            CheckLargeKernels();
+            CMatrixMemory::SetPolicy(NumaLocal, 0);
+            CThreadPool::Instance().Configure(0, AffinityNone);
+        }
+
+#endif // _WIN32
+    };
+}
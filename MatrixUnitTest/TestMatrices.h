@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CppUnitTest.h"
+#include "..\MatrixArithmetic\CMatrix.h"
+
+// ---------------------------------------------------------------------------
+// Operands and checks shared by the unit tests.
+// ---------------------------------------------------------------------------
+
+namespace MatrixUnitTest
+{
+    // ---------------------------------------------------------------------------
+    // A uRows * uCols matrix of pseudo random integers in [nLow, nHigh]. The
+    // same seed always gives the same matrix. The default range keeps the
+    // products of test sized matrices small and exact in any element type.
+
+    template <class T>
+    CMatrix<T> SeededMatrix(unsigned int uRows, unsigned int uCols, unsigned int uSeed, int nLow = -5, int nHigh = 5)
+    {
+        CMatrix<T> m(uRows, uCols);
+        const unsigned long long ullRange = (unsigned long long)((long long)nHigh - nLow + 1);
+        unsigned long long ullState = (uSeed + 1) * 0x9E3779B97F4A7C15ULL;
+
+        for (unsigned int uRow = 0; uRow < uRows; uRow++)
+        {
+            for (unsigned int uCol = 0; uCol < uCols; uCol++)
+            {
+                ullState = ullState * 6364136223846793005ULL + 1442695040888963407ULL;
+                m.SetAt(uRow, uCol, (T)(nLow + (long long)((ullState >> 32) % ullRange)));
+            }
+        }
+
+        return(m);
+    }
+
+    // ---------------------------------------------------------------------------
+    // Same size and the same elements, reporting the first element that
+    // differs.
+
+    template <class T>
+    void AssertMatrixEqual(const CMatrix<T> & Expected, const CMatrix<T> & Actual)
+    {
+        using Microsoft::VisualStudio::CppUnitTestFramework::Assert;
+
+        Assert::AreEqual(Expected.NumRows(), Actual.NumRows());
+        Assert::AreEqual(Expected.NumColumns(), Actual.NumColumns());
+
+        for (unsigned int uRow = 0; uRow < Expected.NumRows(); uRow++)
+        {
+            for (unsigned int uCol = 0; uCol < Expected.NumColumns(); uCol++)
+            {
+                Assert::AreEqual(Expected.GetAt(uRow, uCol), Actual.GetAt(uRow, uCol));
+            }
+        }
+    }
+}